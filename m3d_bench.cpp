@@ -0,0 +1,666 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * End-to-end frame benchmark.
+ *
+ * A world is built out of N cubes and spheres laid on a grid, lit by L point
+ * or spot lights, and every selected renderer is driven through the same
+ * deterministic animation (yaw, pitch and roll steps applied to all objects)
+ * at every selected resolution.
+ * Results are printed to stdout as CSV, one line per renderer and resolution.
+ * When the profiler is compiled in (M3D_PROFILE) the mean time per frame of
+ * every pipeline stage is appended to each line.
+ * Rasterizer statistics accumulated over the measured frames can be appended
+ * to a file as JSON, one object per line.
+ */
+
+#define NELEMENTS(x) (sizeof(x) / sizeof(x[0]))
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <errno.h>
+
+#include "m3d_renderer_wireframe.hh"
+#include "m3d_renderer_flat.hh"
+#include "m3d_renderer_gouraud.hh"
+#include "m3d_renderer_phong.hh"
+#include "m3d_display_offscreen.hh"
+#include "m3d_profiler.hh"
+#include "m3d_cpu.hh"
+#include "cubeobject.mes"
+#include "sphereobject.mes"
+
+using namespace std;
+
+static const char *renderer_names[] = {"wireframe", "flat", "shaded", "gouraud", "phong"};
+// Indexed by m3d_renderer::RASTER_*
+static const char *raster_names[] = {"scanline", "halfspace", "tiled"};
+// Indexed by m3d_renderer::SHADING_*
+static const char *shading_names[] = {"forward", "deferred", "prepass", "visibility"};
+// Indexed by m3d_renderer::ORDER_*
+static const char *order_names[] = {"objects", "front", "back"};
+
+// Camera paths: static, orbiting the grid, or static and close to it, so that the objects cross the screen edges
+enum
+{
+	CAMERA_STATIC,
+	CAMERA_ORBIT,
+	CAMERA_CLOSE
+};
+static const char *camera_names[] = {"static", "orbit", "close"};
+
+// Distance between the centers of two objects on the grid
+static const float grid_step = 300.0f;
+
+struct bench_resolution
+{
+	int xres, yres;
+};
+
+struct bench_config
+{
+	unsigned cubes = 3;
+	unsigned spheres = 1;
+	unsigned lights = 1;
+	bool spot = false;
+	unsigned camera = CAMERA_STATIC;
+	bool soa = false;
+	bool objcull = false;
+	unsigned raster = m3d_renderer::RASTER_SCANLINE;
+	unsigned threads = 0;
+	unsigned shading = m3d_renderer::SHADING_FORWARD;
+	unsigned order = m3d_renderer::ORDER_OBJECTS;
+	bool hiz = true;
+	bool lazyclear = true;
+	// m3d_cpu level of the kernels, LEVEL_MAX for the default one
+	unsigned isa = m3d_cpu::LEVEL_MAX;
+	unsigned frames = 360;
+	unsigned warmup = 10;
+	vector<bench_resolution> resolutions;
+	vector<unsigned> renderers;
+	string json;
+};
+
+struct bench_scene
+{
+	vector<m3d_render_object> objects;
+	vector<unique_ptr<m3d_point_light_source>> lights;
+	unique_ptr<m3d_world> world;
+	// Camera distance from the center of the grid
+	float distance;
+};
+
+static void usage(const char *name)
+{
+	cerr << "Usage: " << name << " [options]" << endl
+	     << "  --cubes N          number of cubes (default 3)" << endl
+	     << "  --spheres N        number of spheres (default 1)" << endl
+	     << "  --lights N         number of light sources (default 1)" << endl
+	     << "  --spot             use spot lights instead of point lights" << endl
+	     << "  --camera PATH      static, orbit or close (static, objects partly off screen), default static" << endl
+	     << "  --layout L         vertex storage, aos or soa (default aos)" << endl
+	     << "  --cull C           back face culling, screen or object (default screen)" << endl
+	     << "  --raster R         triangle rasterizer, scanline, halfspace or tiled (default scanline)" << endl
+	     << "  --threads N        threads running the frame, 0 for all the hardware threads (default 0)" << endl
+	     << "  --shading S        shading, forward, deferred (Phong only), prepass (Gouraud and Phong)" << endl
+	     << "                     or visibility (not wireframe), default forward" << endl
+	     << "  --order O          drawing order, objects, front (triangles sorted front to back) or back" << endl
+	     << "                     (back to front with no Z buffer), default objects" << endl
+	     << "  --hiz on|off       hierarchical Z with the half-space rasterizers (default on)" << endl
+	     << "  --clear C          buffers clear, lazy (on demand) or eager (default lazy)" << endl
+	     << "  --isa I            kernels instruction set, scalar, sse4.1, avx2 or avx512 (default the widest supported)" << endl
+	     << "  --res WxH[,WxH]    resolutions (default 1024x768)" << endl
+	     << "  --renderer R[,R]   wireframe, flat, shaded, gouraud, phong or all (default all)" << endl
+	     << "  --frames N         measured frames per run (default 360)" << endl
+	     << "  --warmup N         frames rendered before measuring (default 10)" << endl
+	     << "  --json FILE        append the rasterizer statistics of every run to FILE" << endl;
+}
+
+static bool parse_unsigned(const char *arg, unsigned &out)
+{
+	char *end;
+	unsigned long val;
+
+	if (!arg)
+	{
+		return false;
+	}
+
+	val = strtoul(arg, &end, 10);
+	if ((end == arg) || *end)
+	{
+		return false;
+	}
+
+	out = (unsigned)val;
+	return true;
+}
+
+static bool parse_resolutions(const char *arg, vector<bench_resolution> &out)
+{
+	stringstream list(arg ? arg : "");
+	string item;
+	bench_resolution res;
+	char x;
+
+	while (getline(list, item, ','))
+	{
+		stringstream parse(item);
+		if (!(parse >> res.xres >> x >> res.yres) || (x != 'x') || (res.xres < 1) || (res.yres < 1) ||
+		    (res.xres > INT16_MAX) || (res.yres > INT16_MAX))
+		{
+			return false;
+		}
+		out.push_back(res);
+	}
+
+	return !out.empty();
+}
+
+static bool parse_renderers(const char *arg, vector<unsigned> &out)
+{
+	stringstream list(arg ? arg : "");
+	string item;
+	unsigned i;
+
+	while (getline(list, item, ','))
+	{
+		if (item == "all")
+		{
+			for (i = 0; i < NELEMENTS(renderer_names); i++)
+			{
+				out.push_back(i);
+			}
+			continue;
+		}
+
+		for (i = 0; i < NELEMENTS(renderer_names); i++)
+		{
+			if (item == renderer_names[i])
+			{
+				out.push_back(i);
+				break;
+			}
+		}
+
+		if (i == NELEMENTS(renderer_names))
+		{
+			return false;
+		}
+	}
+
+	return !out.empty();
+}
+
+static int parse_args(int argc, char *argv[], bench_config &cfg)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *opt = argv[i];
+		const char *arg = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		bool ok = true;
+
+		if (!strcmp(opt, "--cubes"))
+		{
+			ok = parse_unsigned(arg, cfg.cubes);
+			i++;
+		}
+		else if (!strcmp(opt, "--spheres"))
+		{
+			ok = parse_unsigned(arg, cfg.spheres);
+			i++;
+		}
+		else if (!strcmp(opt, "--lights"))
+		{
+			ok = parse_unsigned(arg, cfg.lights);
+			i++;
+		}
+		else if (!strcmp(opt, "--spot"))
+		{
+			cfg.spot = true;
+		}
+		else if (!strcmp(opt, "--camera"))
+		{
+			ok = false;
+			for (unsigned j = 0; arg && (j < NELEMENTS(camera_names)); j++)
+			{
+				if (!strcmp(arg, camera_names[j]))
+				{
+					cfg.camera = j;
+					ok = true;
+				}
+			}
+			i++;
+		}
+		else if (!strcmp(opt, "--layout"))
+		{
+			ok = arg && (!strcmp(arg, "aos") || !strcmp(arg, "soa"));
+			cfg.soa = ok && !strcmp(arg, "soa");
+			i++;
+		}
+		else if (!strcmp(opt, "--cull"))
+		{
+			ok = arg && (!strcmp(arg, "screen") || !strcmp(arg, "object"));
+			cfg.objcull = ok && !strcmp(arg, "object");
+			i++;
+		}
+		else if (!strcmp(opt, "--raster"))
+		{
+			ok = false;
+			for (unsigned j = 0; arg && (j < NELEMENTS(raster_names)); j++)
+			{
+				if (!strcmp(arg, raster_names[j]))
+				{
+					cfg.raster = j;
+					ok = true;
+				}
+			}
+			i++;
+		}
+		else if (!strcmp(opt, "--threads"))
+		{
+			ok = parse_unsigned(arg, cfg.threads);
+			i++;
+		}
+		else if (!strcmp(opt, "--shading"))
+		{
+			ok = false;
+			for (unsigned j = 0; arg && (j < NELEMENTS(shading_names)); j++)
+			{
+				if (!strcmp(arg, shading_names[j]))
+				{
+					cfg.shading = j;
+					ok = true;
+				}
+			}
+			i++;
+		}
+		else if (!strcmp(opt, "--order"))
+		{
+			ok = false;
+			for (unsigned j = 0; arg && (j < NELEMENTS(order_names)); j++)
+			{
+				if (!strcmp(arg, order_names[j]))
+				{
+					cfg.order = j;
+					ok = true;
+				}
+			}
+			i++;
+		}
+		else if (!strcmp(opt, "--hiz"))
+		{
+			ok = arg && (!strcmp(arg, "on") || !strcmp(arg, "off"));
+			cfg.hiz = ok && !strcmp(arg, "on");
+			i++;
+		}
+		else if (!strcmp(opt, "--clear"))
+		{
+			ok = arg && (!strcmp(arg, "lazy") || !strcmp(arg, "eager"));
+			cfg.lazyclear = ok && !strcmp(arg, "lazy");
+			i++;
+		}
+		else if (!strcmp(opt, "--isa"))
+		{
+			cfg.isa = arg ? m3d_cpu::find_level(arg) : (unsigned)m3d_cpu::LEVEL_MAX;
+			ok = cfg.isa < m3d_cpu::LEVEL_MAX;
+			i++;
+		}
+		else if (!strcmp(opt, "--res"))
+		{
+			ok = parse_resolutions(arg, cfg.resolutions);
+			i++;
+		}
+		else if (!strcmp(opt, "--renderer"))
+		{
+			ok = parse_renderers(arg, cfg.renderers);
+			i++;
+		}
+		else if (!strcmp(opt, "--frames"))
+		{
+			ok = parse_unsigned(arg, cfg.frames) && cfg.frames;
+			i++;
+		}
+		else if (!strcmp(opt, "--warmup"))
+		{
+			ok = parse_unsigned(arg, cfg.warmup);
+			i++;
+		}
+		else if (!strcmp(opt, "--json"))
+		{
+			ok = (arg != nullptr);
+			cfg.json = ok ? arg : "";
+			i++;
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			return (EINVAL);
+		}
+	}
+
+	if ((cfg.cubes + cfg.spheres) == 0)
+	{
+		return (EINVAL);
+	}
+
+	if (cfg.resolutions.empty())
+	{
+		cfg.resolutions.push_back({1024, 768});
+	}
+
+	if (cfg.renderers.empty())
+	{
+		parse_renderers("all", cfg.renderers);
+	}
+
+	return (0);
+}
+
+static m3d_renderer *create_renderer(unsigned index, m3d_display *display)
+{
+	switch (index)
+	{
+	case 0:
+		return new m3d_renderer_wireframe(display);
+	case 1:
+		return new m3d_renderer_flat(display);
+	case 2:
+		return new m3d_renderer_shaded(display);
+	case 3:
+		return new m3d_renderer_shaded_gouraud(display);
+	default:
+		return new m3d_renderer_shaded_phong(display);
+	}
+}
+
+/*
+ * Place the camera on a circle around the Y axis, at an angle in degrees,
+ * always looking at the center of the grid.
+ */
+static void place_camera(bench_scene &scene, float angle)
+{
+	float rad = angle * 3.14159265f / 180.0f;
+	float d = scene.distance / sqrtf(3.0f);
+	struct m3d_input_point position = {{d * sqrtf(2.0f) * cosf(rad), d, d * sqrtf(2.0f) * sinf(rad), 1.0f}};
+	struct m3d_input_point at = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+	scene.world->camera.set_position(position, at);
+}
+
+/*
+ * Build the objects on a square grid centered on the origin, cubes first and
+ * spheres last, and a ring of lights above the grid.
+ * The camera distance is chosen so that the whole grid fits the view at any
+ * angle of the orbit, but for the close camera.
+ */
+static int build_scene(const bench_config &cfg, const bench_resolution &res, bench_scene &scene)
+{
+	static const m3d_color palette[] = {m3d_color(255, 1, 1, 0),
+					    m3d_color(1, 255, 1, 0),
+					    m3d_color(1, 1, 255, 0),
+					    m3d_color(64, 128, 255, 0)};
+	m3d_color white(255, 255, 255, 0);
+	unsigned count = cfg.cubes + cfg.spheres;
+	unsigned side = (unsigned)ceilf(sqrtf((float)count));
+	float half = grid_step * (float)(side - 1) / 2.0f;
+	float ring = half + 500.0f;
+	struct m3d_input_point origin = {{0.0f, 0.0f, 0.0f, 1.0f}};
+	int retcode;
+
+	scene.distance = 1800.0f + 3.5f * half;
+	if (cfg.camera == CAMERA_CLOSE)
+	{
+		// The triangles cross all the edges of the screen
+		scene.distance /= 3.0f;
+	}
+	scene.world = make_unique<m3d_world>(m3d_ambient_light(white, 0.4f),
+					     m3d_camera(origin, origin, (int16_t)res.xres, (int16_t)res.yres));
+	place_camera(scene, 45.0f);
+
+	// Every object is an instance of one of the two meshes
+	shared_ptr<const m3d_mesh> cubeshape = m3d_mesh::make(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh));
+	shared_ptr<const m3d_mesh> sphereshape = m3d_mesh::make(sphere, NELEMENTS(sphere), spheremesh, NELEMENTS(spheremesh));
+
+	if (!cubeshape || !sphereshape)
+	{
+		return (EINVAL);
+	}
+
+	// The world stores pointers, objects must not be moved once added
+	scene.objects.resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		m3d_render_object &obj = scene.objects[i];
+		m3d_color color(palette[i % NELEMENTS(palette)]);
+
+		if (i < cfg.cubes)
+		{
+			retcode = obj.create(cubeshape, color);
+		}
+		else
+		{
+			retcode = obj.create(sphereshape, color);
+		}
+
+		if (!retcode && cfg.soa)
+		{
+			retcode = obj.set_vertex_layout(m3d_object::VERTEX_SOA);
+		}
+
+		if (retcode)
+		{
+			return (retcode);
+		}
+
+		obj.move(m3d_vector(grid_step * (float)(i % side) - half, 0.0f, grid_step * (float)(i / side) - half));
+		scene.world->add_object(obj);
+	}
+
+	for (unsigned i = 0; i < cfg.lights; i++)
+	{
+		float rad = 2.0f * 3.14159265f * (float)i / (float)cfg.lights;
+		struct m3d_input_point position = {{ring * cosf(rad), 500.0f, ring * sinf(rad), 1.0f}};
+
+		if (cfg.spot)
+		{
+			scene.lights.push_back(make_unique<m3d_spot_light_source>(origin, position, white, 100.0f, 1.0f, 0.1f, 20000.0f));
+		}
+		else
+		{
+			scene.lights.push_back(make_unique<m3d_point_light_source>(position, white, 100.0f, 1.0f, 0.1f, 20000.0f));
+		}
+		scene.world->add_light_source(*scene.lights.back());
+	}
+
+	return (0);
+}
+
+/*
+ * Advance the animation by one frame, same steps as the animation loop in main.cpp
+ */
+static void animate(bench_scene &scene, const bench_config &cfg, float &stepping, unsigned frame)
+{
+	for (auto &obj : scene.objects)
+	{
+		obj.yaw(stepping);
+		obj.pitch(stepping);
+		obj.roll(stepping);
+	}
+
+	stepping = (stepping < 359.0f) ? stepping + 0.07f : 1.0f;
+
+	if (cfg.camera == CAMERA_ORBIT)
+	{
+		place_camera(scene, 45.0f + (float)frame);
+	}
+}
+
+static int run(const bench_config &cfg, const bench_resolution &res, unsigned index)
+{
+	bench_scene scene;
+	vector<double> times;
+	unsigned long triangles;
+	float stepping = 1.0f;
+	double total = 0.0;
+	int retcode;
+
+	retcode = build_scene(cfg, res, scene);
+	if (retcode)
+	{
+		cerr << "Could not build the scene: " << retcode << endl;
+		return (retcode);
+	}
+
+	m3d_display_offscreen display(res.xres, res.yres);
+	unique_ptr<m3d_renderer> renderer(create_renderer(index, &display));
+
+	renderer->set_culling(cfg.objcull ? m3d_render_object::CULL_OBJECT : m3d_render_object::CULL_SCREEN);
+	renderer->set_rasterizer(cfg.raster);
+	renderer->set_threads(cfg.threads);
+	renderer->set_shading(cfg.shading);
+	renderer->set_order(cfg.order);
+	renderer->set_hiz(cfg.hiz);
+	renderer->set_lazy_clear(cfg.lazyclear);
+
+	for (unsigned frame = 0; frame < cfg.warmup; frame++)
+	{
+		animate(scene, cfg, stepping, frame);
+		renderer->render(*scene.world);
+	}
+
+	m3d_profiler::inst().reset();
+	renderer->reset_stats();
+	times.reserve(cfg.frames);
+	for (unsigned frame = 0; frame < cfg.frames; frame++)
+	{
+		animate(scene, cfg, stepping, cfg.warmup + frame);
+
+		auto start = chrono::steady_clock::now();
+		renderer->render(*scene.world);
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+		times.push_back(elapsed.count());
+		total += elapsed.count();
+	}
+
+	const m3d_render_stats &stats = renderer->get_total_stats();
+	triangles = stats.triangles_rasterized;
+
+	sort(times.begin(), times.end());
+	size_t p99 = (size_t)ceil(0.99 * (double)times.size()) - 1;
+
+	cout << renderer_names[index] << ","
+	     << res.xres << "," << res.yres << ","
+	     << cfg.cubes << "," << cfg.spheres << "," << cfg.lights << ","
+	     << (cfg.spot ? "spot" : "point") << ","
+	     << camera_names[cfg.camera] << ","
+	     << (cfg.soa ? "soa" : "aos") << ","
+	     << (cfg.objcull ? "object" : "screen") << ","
+	     << raster_names[cfg.raster] << ","
+	     << renderer->get_threads() << ","
+	     << shading_names[cfg.shading] << ","
+	     << order_names[cfg.order] << ","
+	     << (cfg.hiz ? "on" : "off") << ","
+	     << (cfg.lazyclear ? "lazy" : "eager") << ","
+	     << m3d_cpu::level_name(m3d_cpu::get_level()) << ","
+	     << cfg.frames << ","
+	     << times.front() << ","
+	     << total / (double)times.size() << ","
+	     << times[p99] << ","
+	     << (double)triangles / (double)cfg.frames << ","
+	     << ((total > 0.0) ? (double)triangles * 1000.0 / total : 0.0) << ",";
+	if (stats.has_overdraw())
+		cout << stats.overdraw();
+	else
+		cout << "n/a";
+
+#ifdef M3D_PROFILE
+	const m3d_profiler::stats &stages = m3d_profiler::inst().get_total_stats();
+	for (unsigned i = 0; i < m3d_profiler::STAGE_MAX; i++)
+	{
+		cout << "," << stages.ms(i) / (double)m3d_profiler::inst().get_frames();
+	}
+#endif
+	cout << endl;
+
+	if (!cfg.json.empty())
+	{
+		ofstream json(cfg.json, ios::out | ios::app);
+		json << "{\"renderer\":\"" << renderer_names[index] << "\",\"xres\":" << res.xres << ",\"yres\":" << res.yres
+		     << ",\"frames\":" << cfg.frames << ",\"stats\":";
+		stats.dump_json(json);
+		json << "}" << endl;
+	}
+
+	return (0);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_config cfg;
+
+	if (parse_args(argc, argv, cfg))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (cfg.isa < m3d_cpu::LEVEL_MAX)
+	{
+		m3d_cpu::set_level(cfg.isa);
+	}
+
+	cout << "renderer,xres,yres,cubes,spheres,lights,light_type,camera,layout,cull,raster,threads,shading,order,hiz,clear,isa,frames,"
+	     << "min_ms,mean_ms,p99_ms,triangles_per_frame,triangles_per_sec,overdraw";
+#ifdef M3D_PROFILE
+	for (unsigned i = 0; i < m3d_profiler::STAGE_MAX; i++)
+	{
+		cout << "," << m3d_profiler::stage_name(i) << "_ms";
+	}
+#endif
+	cout << endl;
+
+	for (auto &res : cfg.resolutions)
+	{
+		for (auto index : cfg.renderers)
+		{
+			if (run(cfg, res, index))
+			{
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -27,6 +27,7 @@ using namespace std;
 m3d_camera::m3d_camera() : position(), transform(), frustum(0.0f, 0, 0, 1.0f, INFINITY)
 {
 	screen_resolution.x = screen_resolution.y = 0;
+	update_planes();
 }
 
 m3d_camera::~m3d_camera()
@@ -41,6 +42,89 @@ m3d_camera::m3d_camera(const struct m3d_input_point &position,
 {
 	screen_resolution.x = xres;
 	screen_resolution.y = yres;
+	update_planes();
+}
+
+void m3d_camera::set_position(const struct m3d_input_point &position, const struct m3d_input_point &at)
+{
+	this->position = position;
+	transform = m3d_matrix_camera(position, at);
+	update_planes();
+}
+
+void m3d_camera::update_planes()
+{
+	m3d_matrix clip(frustum);
+
+	/*
+	 * Points inside the frustum have homogeneous clip coordinates
+	 * -T <= X, Y, Z <= T, the planes are the sum and the difference of the T row
+	 * and the X, Y, Z rows of the world to clip space matrix (Gribb, Hartmann).
+	 */
+	clip.multiply(transform);
+	planescount = 0;
+	for (unsigned row = X_C; row <= Z_C; row++)
+	{
+		for (float sign = 1.0f; sign >= -1.0f; sign -= 2.0f)
+		{
+			m3d_vector &plane = planes[planescount];
+
+			for (unsigned i = 0; i < m3d_vector_size; i++)
+			{
+				plane[i] = clip.mymatrix[T_C][i] + sign * clip.mymatrix[row][i];
+			}
+
+			float norm = plane.module();
+			// A null normal is a plane at infinity, every point is inside
+			if (norm > 0.0f)
+			{
+				for (unsigned i = 0; i < m3d_vector_size; i++)
+				{
+					plane[i] /= norm;
+				}
+				planescount++;
+			}
+		}
+	}
+}
+
+bool m3d_camera::sphere_in_frustum(const m3d_point &center, float radius) const
+{
+	for (unsigned i = 0; i < planescount; i++)
+	{
+		const m3d_vector &plane = planes[i];
+		float distance = plane[X_C] * center[X_C] + plane[Y_C] * center[Y_C] + plane[Z_C] * center[Z_C] + plane[T_C];
+
+		if (distance < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool m3d_camera::box_in_frustum(const m3d_point &center, const m3d_vector halfsides[3]) const
+{
+	for (unsigned i = 0; i < planescount; i++)
+	{
+		const m3d_vector &plane = planes[i];
+		float distance = plane[X_C] * center[X_C] + plane[Y_C] * center[Y_C] + plane[Z_C] * center[Z_C] + plane[T_C];
+		float extent = 0.0f;
+
+		// Projection of the box on the plane normal
+		for (unsigned j = 0; j < 3; j++)
+		{
+			extent += fabsf(plane[X_C] * halfsides[j][X_C] + plane[Y_C] * halfsides[j][Y_C] + plane[Z_C] * halfsides[j][Z_C]);
+		}
+
+		if (distance < -extent)
+		{
+			return false;
+		}
+	}
+
+	return true;
 }
 
 void m3d_camera::to_camera(m3d_point &pointsrc, m3d_point &pointdst)
@@ -84,6 +168,56 @@ void m3d_camera::projection_to_screen(m3d_point &pointsrc, m3d_point &pointdst,
 	to_screen(pointdst, pix);
 }
 
+void m3d_camera::to_camera(const m3d_vector *vecsrc, m3d_vector *vecdst, size_t n, size_t srcstride, size_t dststride)
+{
+	transform.transform_many(vecsrc, vecdst, n, srcstride, dststride);
+}
+
+void m3d_camera::projection(const m3d_vector *vecsrc, m3d_vector *vecdst, size_t n, size_t srcstride, size_t dststride)
+{
+	transform.transform_many(vecsrc, vecdst, n, srcstride, dststride);
+	frustum.transform_many(vecdst, vecdst, n, dststride, dststride);
+}
+
+void m3d_camera::projection_to_screen(m3d_vertex *vertices, size_t n)
+{
+	transform.transform_many(&vertices->tposition, &vertices->prjposition, n, sizeof(m3d_vertex), sizeof(m3d_vertex));
+	frustum.transform_many(&vertices->prjposition, &vertices->prjposition, n, sizeof(m3d_vertex), sizeof(m3d_vertex));
+	for (size_t i = 0; i < n; i++, vertices++)
+	{
+		m3d_point &pointdst = vertices->prjposition;
+
+		pointdst[X_C] /= pointdst[T_C];
+		pointdst[Y_C] /= pointdst[T_C];
+		pointdst[Z_C] /= pointdst[T_C];
+		to_screen(pointdst, vertices->scrposition);
+	}
+}
+
+void m3d_camera::projection_to_screen(m3d_vertex_soa &vertices)
+{
+	projection_to_screen(vertices, 0, vertices.size());
+}
+
+void m3d_camera::projection_to_screen(m3d_vertex_soa &vertices, size_t first, size_t n)
+{
+	m3d_soa_vector &src = vertices.tposition;
+	m3d_soa_vector &dst = vertices.prjposition;
+
+	transform.transform_soa(src.x + first, src.y + first, src.z + first, 1.0f, dst.x + first, dst.y + first, dst.z + first, nullptr, n);
+	frustum.transform_soa(dst.x + first, dst.y + first, dst.z + first, 1.0f, dst.x + first, dst.y + first, dst.z + first, vertices.prjw + first, n);
+	for (size_t i = first; i < first + n; i++)
+	{
+		float w = vertices.prjw[i];
+
+		dst.x[i] /= w;
+		dst.y[i] /= w;
+		dst.z[i] /= w;
+		vertices.scrx[i] = (int)floorf((dst.x[i] + 1.0f) * screen_resolution.x / 2);
+		vertices.scry[i] = (int)floorf((-dst.y[i] + 1.0f) * screen_resolution.y / 2);
+	}
+}
+
 bool m3d_camera::is_visible(m3d_point &point, m3d_vector &normal)
 {
 	m3d_point temp(point);
@@ -24,6 +24,7 @@
 
 #include "m3d_math.hh"
 #include "m3d_vertex.hh"
+#include "m3d_vertex_soa.hh"
 
 class m3d_camera
 {
@@ -36,13 +37,19 @@ public:
 	m3d_camera(const m3d_camera &other) : position(other.position),
 					      transform(other.transform),
 					      frustum(other.frustum),
-					      screen_resolution(other.screen_resolution) {};
+					      screen_resolution(other.screen_resolution)
+	{
+		update_planes();
+	}
 
 	m3d_camera(const struct m3d_input_point &position,
 		   const struct m3d_input_point &at,
 		   int16_t xres,
 		   int16_t yres);
 
+	// Move the camera to position, looking at point at; the frustum is unchanged
+	void set_position(const struct m3d_input_point &position, const struct m3d_input_point &at);
+
 	// Transform a world coordinates point inside the view frustum to camera coordinates
 	void to_camera(m3d_point &pointsrc, m3d_point &pointdst);
 	// Transform a world coordinates vector inside the view frustum to camera coordinates
@@ -55,6 +62,19 @@ public:
 	void to_screen(m3d_point &point, m3d_display_point &pix);
 	// Project point from world coordinates to screen
 	void projection_to_screen(m3d_point &pointsrc, m3d_point &pointdst, m3d_display_point &pix);
+	// Batch versions of the above, strides are the distances in bytes between consecutive vectors
+	void to_camera(const m3d_vector *vecsrc, m3d_vector *vecdst, size_t n, size_t srcstride, size_t dststride);
+	void projection(const m3d_vector *vecsrc, m3d_vector *vecdst, size_t n, size_t srcstride, size_t dststride);
+	// Project the transformed positions of n vertices to homogeneous clip space and to screen
+	void projection_to_screen(m3d_vertex *vertices, size_t n);
+	void projection_to_screen(m3d_vertex_soa &vertices);
+	// Same as above, for the n vertices starting at first
+	void projection_to_screen(m3d_vertex_soa &vertices, size_t first, size_t n);
+	// Return false if the sphere, in world coordinates, is completely outside the view frustum
+	bool sphere_in_frustum(const m3d_point &center, float radius) const;
+	// Return false if the oriented box, given by its center and three half sides in world
+	// coordinates, is completely outside the view frustum
+	bool box_in_frustum(const m3d_point &center, const m3d_vector halfsides[3]) const;
 	// Compute visibility using normal as a surface normal vector and point to compute
 	// the vector going from camera to point itself in world coordinates.
 	bool is_visible(m3d_point &point, m3d_vector &normal);
@@ -67,6 +87,9 @@ public:
 	}
 
 private:
+	// Extract the view frustum planes from the camera and projection matrices
+	void update_planes(void);
+
 	// Position of the camera in world coordinates
 	m3d_point position;
 	// Trasformation matrix from world to camera coordinates
@@ -75,6 +98,14 @@ private:
 	m3d_frustum frustum;
 	// The screen resolution in pixels
 	m3d_display_point screen_resolution;
+	/*
+	 * View frustum planes in world coordinates, normalized, with the normals
+	 * pointing inside the frustum: a point P is inside when
+	 * X*Px + Y*Py + Z*Pz + T >= 0 for every plane.
+	 * Planes at infinity (the far plane) are not stored.
+	 */
+	m3d_vector planes[6];
+	unsigned planescount;
 };
 
 #endif // M3D_CAMERA_H
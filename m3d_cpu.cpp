@@ -0,0 +1,140 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "m3d_cpu.hh"
+
+#if defined(M3D_CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static const char *level_names[m3d_cpu::LEVEL_MAX] = {
+    "scalar",
+    "sse4.1",
+    "avx2",
+    "avx512"};
+
+#if defined(M3D_CPU_X86) && defined(_MSC_VER)
+/*
+ * MSVC has no __builtin_cpu_supports: read the CPUID feature bits, and the
+ * register states saved by the OS from XCR0
+ */
+static unsigned detect_msvc(void)
+{
+	int regs[4];
+	unsigned long long xcr0;
+	bool sse41, avx, avx2, avx512;
+
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return m3d_cpu::LEVEL_SCALAR;
+
+	__cpuid(regs, 1);
+	sse41 = (regs[2] & (1 << 19)) != 0;
+	avx = ((regs[2] & (1 << 28)) != 0) && ((regs[2] & (1 << 27)) != 0);
+	if (!sse41)
+		return m3d_cpu::LEVEL_SCALAR;
+	if (!avx)
+		return m3d_cpu::LEVEL_SSE41;
+
+	// XMM and YMM, then opmask, ZMM0-15 upper halves and ZMM16-31
+	xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x06) != 0x06)
+		return m3d_cpu::LEVEL_SSE41;
+
+	__cpuidex(regs, 7, 0);
+	avx2 = (regs[1] & (1 << 5)) != 0;
+	avx512 = ((regs[1] & (1 << 16)) != 0) && ((xcr0 & 0xe6) == 0xe6);
+	if (!avx2)
+		return m3d_cpu::LEVEL_SSE41;
+	return avx512 ? m3d_cpu::LEVEL_AVX512 : m3d_cpu::LEVEL_AVX2;
+}
+#endif
+
+unsigned m3d_cpu::detect()
+{
+#if defined(M3D_CPU_X86) && defined(__GNUC__)
+	// The checks include the OS support of the AVX registers
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return LEVEL_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return LEVEL_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return LEVEL_SSE41;
+	return LEVEL_SCALAR;
+#elif defined(M3D_CPU_X86) && defined(_MSC_VER)
+	return detect_msvc();
+#else
+	return LEVEL_SCALAR;
+#endif
+}
+
+/*
+ * The widest level supported, narrowed by M3D_ISA
+ */
+static unsigned initial_level(void)
+{
+	unsigned level = m3d_cpu::detect();
+	const char *name = getenv("M3D_ISA");
+
+	if (name && (m3d_cpu::find_level(name) < level))
+		level = m3d_cpu::find_level(name);
+	return level;
+}
+
+static std::atomic<unsigned> &current_level(void)
+{
+	static std::atomic<unsigned> level(initial_level());
+
+	return level;
+}
+
+unsigned m3d_cpu::get_level()
+{
+	return current_level().load(std::memory_order_relaxed);
+}
+
+unsigned m3d_cpu::set_level(unsigned level)
+{
+	static const unsigned supported = detect();
+
+	level = (level < supported) ? level : supported;
+	current_level().store(level, std::memory_order_relaxed);
+	return level;
+}
+
+const char *m3d_cpu::level_name(unsigned level)
+{
+	return (level < LEVEL_MAX) ? level_names[level] : "unknown";
+}
+
+unsigned m3d_cpu::find_level(const char *name)
+{
+	for (unsigned level = LEVEL_SCALAR; level < LEVEL_MAX; level++)
+	{
+		if (!strcmp(name, level_names[level]))
+			return level;
+	}
+	return LEVEL_MAX;
+}
@@ -0,0 +1,86 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_CPU_HH_INCLUDED
+#define M3D_CPU_HH_INCLUDED
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define M3D_CPU_X86
+#endif
+
+/*
+ * Compile a function for an instruction set the rest of the program does not
+ * assume, e.g. M3D_TARGET("avx2"). It must be called only when the CPU
+ * supports it. MSVC compiles intrinsics of any instruction set without flags.
+ */
+#if defined(__GNUC__)
+#define M3D_TARGET(isa) __attribute__((target(isa)))
+#else
+#define M3D_TARGET(isa)
+#endif
+
+/*
+ * Instruction set levels of the kernels selected at run time, every level
+ * includes the previous ones.
+ *
+ * The kernels of the matrix batches, of the spans and of the buffer fills
+ * have a variant for every level, and dispatch on get_level() when called.
+ * The level in use is the widest supported one, unless the M3D_ISA
+ * environment variable names a narrower level (scalar, sse4.1, avx2 or
+ * avx512) or set_level() forces one, e.g. to compare levels in a benchmark.
+ * All the levels give the same results.
+ */
+class m3d_cpu
+{
+public:
+	enum
+	{
+		LEVEL_SCALAR,
+		LEVEL_SSE41,
+		LEVEL_AVX2,
+		LEVEL_AVX512,
+		LEVEL_MAX
+	};
+
+	/*
+	 * Return the widest level supported by the CPU and enabled by the
+	 * operating system
+	 */
+	static unsigned detect(void);
+
+	/*
+	 * The level of the kernels in use
+	 */
+	static unsigned get_level(void);
+
+	/*
+	 * Force the level of the kernels, a level the CPU does not support is
+	 * lowered to the widest supported. Return the level set.
+	 */
+	static unsigned set_level(unsigned level);
+
+	static const char *level_name(unsigned level);
+
+	/*
+	 * Return the level named name, or LEVEL_MAX if there is none
+	 */
+	static unsigned find_level(const char *name);
+};
+
+#endif
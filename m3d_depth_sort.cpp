@@ -0,0 +1,96 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include "m3d_depth_sort.hh"
+
+using namespace std;
+
+uint32_t m3d_depth_sort::key(float z)
+{
+	uint32_t bits;
+
+	// Negated so that NaN is clamped to 1
+	if (!(z < 1.0f))
+		z = 1.0f;
+	else if (z < 0.0f)
+		z = 0.0f;
+
+	memcpy(&bits, &z, sizeof(bits));
+	// The bits of 1.0f are 0x3f800000
+	return bits >> (30 - M3D_DEPTH_KEY_BITS);
+}
+
+bool m3d_depth_sort::resize(size_t n)
+{
+	try
+	{
+		items.resize(n);
+		temp.resize(n);
+		order.resize(n);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return false;
+	}
+	return true;
+}
+
+const uint32_t *m3d_depth_sort::sort()
+{
+	size_t n = items.size();
+	size_t count[256];
+
+	for (unsigned shift = 32; shift < 32 + M3D_DEPTH_KEY_BITS; shift += 8)
+	{
+		size_t sum = 0;
+
+		memset(count, 0, sizeof(count));
+		for (size_t i = 0; i < n; i++)
+		{
+			count[(items[i] >> shift) & 0xff]++;
+		}
+		// These 8 bits are the same for all the keys
+		if ((n == 0) || (count[(items[0] >> shift) & 0xff] == n))
+			continue;
+
+		for (unsigned b = 0; b < 256; b++)
+		{
+			size_t c = count[b];
+
+			count[b] = sum;
+			sum += c;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			temp[count[(items[i] >> shift) & 0xff]++] = items[i];
+		}
+		items.swap(temp);
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		order[i] = (uint32_t)items[i];
+	}
+	return order.data();
+}
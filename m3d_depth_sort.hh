@@ -0,0 +1,78 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_DEPTH_SORT_HH_INCLUDED
+#define M3D_DEPTH_SORT_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Bits of the depth keys
+ */
+#define M3D_DEPTH_KEY_BITS (24)
+#define M3D_DEPTH_KEY_MAX ((1u << M3D_DEPTH_KEY_BITS) - 1)
+
+/*
+ * Radix sort of the triangles of a frame by depth.
+ *
+ * Depths are quantized to keys of M3D_DEPTH_KEY_BITS bits, and sorted 8 bits
+ * per pass from the lowest ones, a pass being skipped when all the keys have
+ * the same 8 bits. Keys equal keep their order, so that the triangles at the
+ * same depth are drawn in submission order.
+ * The buffers are kept from one frame to the next, sorting every frame does
+ * not allocate once they have grown.
+ */
+class m3d_depth_sort
+{
+public:
+	/*
+	 * Key of depth z, from 0 for z = 0 to the largest for z = 1, the depth
+	 * cleared in the Z buffer; depths out of [0, 1] are clamped. The bits of
+	 * a positive float are in the order of its value: their highest ones are
+	 * the key, so that keys are finer near 0 but distinguish depths near 1
+	 * by 2^-17 of their value. M3D_DEPTH_KEY_MAX - key(z) sorts back to
+	 * front.
+	 */
+	static uint32_t key(float z);
+
+	/*
+	 * Make room for n keys, return false if there is not enough memory
+	 */
+	bool resize(size_t n);
+
+	/*
+	 * Set key i, concurrently with other keys
+	 */
+	inline void set(size_t i, uint32_t key) { items[i] = ((uint64_t)key << 32) | (uint32_t)i; }
+
+	/*
+	 * Sort the keys ascending, and return the indexes of the keys in sorted
+	 * order, until the next resize()
+	 */
+	const uint32_t *sort(void);
+
+private:
+	// Every key in the high bits, its index in the low ones
+	std::vector<uint64_t> items, temp;
+	std::vector<uint32_t> order;
+};
+
+#endif
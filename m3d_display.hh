@@ -28,8 +28,8 @@ class m3d_display
 {
 public:
         /** Default constructor */
-        m3d_display() : xmax(0), ymax(0) {};
-        m3d_display(int xres, int yres) : xmax(xres), ymax(yres) {};
+        m3d_display() : xmax(0), ymax(0), owner(nullptr) {};
+        m3d_display(int xres, int yres) : xmax(xres), ymax(yres), owner(nullptr) {};
         /** Default destructor */
         virtual ~m3d_display() {};
 
@@ -49,9 +49,18 @@ public:
         virtual void clear_renderer(void) = 0;
         virtual void show_renderer(void) = 0;
 
+        /*
+         * The renderer which drew the last frame. A renderer clearing only
+         * the parts of the buffer it drew checks it, to find out whether
+         * another renderer drew in the meantime.
+         */
+        void set_owner(const void *renderer) { owner = renderer; }
+        const void *get_owner(void) const { return owner; }
+
 protected:
         // The window resolution
         int xmax, ymax;
+        const void *owner;
 };
 
 #endif
\ No newline at end of file
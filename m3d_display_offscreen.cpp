@@ -0,0 +1,171 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <errno.h>
+
+#include "m3d_display_offscreen.hh"
+#include "m3d_color.hh"
+
+using namespace std;
+
+static const int pixels_per_line = M3D_CACHE_LINE / sizeof(uint32_t);
+
+m3d_display_offscreen::m3d_display_offscreen(int xres, int yres) : m3d_display(xres, yres), color(0), frames(0)
+{
+	pitch = (xres + pixels_per_line - 1) & ~(pixels_per_line - 1);
+	pixels = (uint32_t *)::operator new((size_t)pitch * (size_t)yres * sizeof(uint32_t), align_val_t(M3D_CACHE_LINE));
+
+	// Fill the surface black
+	clear_buffer();
+}
+
+/** Default destructor */
+m3d_display_offscreen::~m3d_display_offscreen()
+{
+	if (pixels)
+	{
+		::operator delete(pixels, align_val_t(M3D_CACHE_LINE));
+	}
+}
+
+uint32_t *m3d_display_offscreen::get_video_buffer(int x0, int y0)
+{
+	return pixels + (y0 * pitch) + x0;
+}
+
+void m3d_display_offscreen::set_color(uint8_t red, uint8_t green, uint8_t blue)
+{
+	m3d_color temp(red, green, blue, 0);
+	color = temp.getColor();
+}
+
+void m3d_display_offscreen::fill_buffer()
+{
+	uint32_t *pix = pixels;
+	uint32_t *end = pixels + pitch * ymax;
+
+	while (pix < end)
+	{
+		*pix++ = color;
+	}
+}
+
+void m3d_display_offscreen::show_buffer()
+{
+	// Nothing to present, the buffer is the output
+	frames++;
+}
+
+void m3d_display_offscreen::clear_buffer()
+{
+	memset(pixels, 0, (size_t)pitch * (size_t)ymax * sizeof(uint32_t));
+}
+
+void m3d_display_offscreen::clear_renderer()
+{
+	clear_buffer();
+}
+
+/*
+ * Bresenham line drawing, pixels falling outside the buffer are discarded.
+ */
+void m3d_display_offscreen::draw_line(m3d_display_point &p0, m3d_display_point &p1)
+{
+	int x = p0.x;
+	int y = p0.y;
+	int dx = abs(p1.x - p0.x);
+	int dy = -abs(p1.y - p0.y);
+	int sx = (p0.x < p1.x) ? 1 : -1;
+	int sy = (p0.y < p1.y) ? 1 : -1;
+	int err = dx + dy;
+	int err2;
+
+	while (true)
+	{
+		if ((x >= 0) && (x < xmax) && (y >= 0) && (y < ymax))
+		{
+			pixels[y * pitch + x] = color;
+		}
+
+		if ((x == p1.x) && (y == p1.y))
+		{
+			break;
+		}
+
+		err2 = 2 * err;
+		if (err2 >= dy)
+		{
+			err += dy;
+			x += sx;
+		}
+		if (err2 <= dx)
+		{
+			err += dx;
+			y += sy;
+		}
+	}
+}
+
+void m3d_display_offscreen::draw_lines(m3d_display_point pts[], unsigned ptsnum)
+{
+	for (unsigned i = 1; i < ptsnum; i++)
+	{
+		draw_line(pts[i - 1], pts[i]);
+	}
+}
+
+void m3d_display_offscreen::show_renderer()
+{
+	show_buffer();
+}
+
+int m3d_display_offscreen::dump(const char *filename)
+{
+	ofstream out(filename, ios::out | ios::binary);
+	m3d_color pixel;
+	char rgb[3];
+
+	if (!out)
+	{
+		cerr << "Could not open " << filename << endl;
+		return (EIO);
+	}
+
+	out << "P6\n"
+	    << xmax << " " << ymax << "\n255\n";
+
+	for (int y = 0; y < ymax; y++)
+	{
+		for (int x = 0; x < xmax; x++)
+		{
+			pixel = m3d_color(pixels[y * pitch + x]);
+			rgb[0] = (char)pixel.getChannel(m3d_color::R_CHANNEL);
+			rgb[1] = (char)pixel.getChannel(m3d_color::G_CHANNEL);
+			rgb[2] = (char)pixel.getChannel(m3d_color::B_CHANNEL);
+			out.write(rgb, sizeof(rgb));
+		}
+	}
+
+	return (out) ? 0 : EIO;
+}
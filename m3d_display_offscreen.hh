@@ -0,0 +1,86 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_DISPLAY_OFFSCREEN_H
+#define M3D_DISPLAY_OFFSCREEN_H
+
+#include <cstdint>
+
+#include "m3d_display.hh"
+
+/*
+ * Headless display.
+ * The display owns an ARGB 32 bits framebuffer in main memory, no window system
+ * is involved: renderers draw straight into the buffer, and show_buffer() does not
+ * copy anything, it just counts the presented frames.
+ * The buffer can be dumped to a binary PPM file for inspection.
+ */
+class m3d_display_offscreen : public m3d_display
+{
+public:
+	/** Default constructor */
+	m3d_display_offscreen() : m3d_display(), pixels(nullptr), pitch(0), color(0), frames(0) {};
+	m3d_display_offscreen(int xres, int yres);
+	/** Default destructor */
+	virtual ~m3d_display_offscreen();
+
+	virtual uint32_t *get_video_buffer(int x0, int y0);
+
+	/** Act directly on the surface buffer */
+	virtual void fill_buffer(void);
+	virtual void show_buffer(void);
+	virtual void clear_buffer(void);
+
+	/** Act on the renderer */
+	virtual void set_color(uint8_t red, uint8_t green, uint8_t blue);
+	virtual void draw_lines(m3d_display_point pts[], unsigned ptsnum);
+	virtual void clear_renderer(void);
+	virtual void show_renderer(void);
+
+	/*
+	 * Number of pixels between the start of two consecutive rows, rows are
+	 * padded to a multiple of the cache line size.
+	 */
+	int get_pitch(void) { return pitch; }
+
+	/*
+	 * Number of frames presented with show_buffer() or show_renderer()
+	 */
+	unsigned long get_frames(void) { return frames; }
+
+	/*
+	 * Write the framebuffer to filename as a binary PPM (P6) image.
+	 * Return 0 on success or an errno value.
+	 */
+	int dump(const char *filename);
+
+private:
+	void draw_line(m3d_display_point &p0, m3d_display_point &p1);
+
+	// Backbuffer memory pointer, aligned to M3D_CACHE_LINE
+	uint32_t *pixels;
+	// Row length in pixels
+	int pitch;
+	// Renderer color
+	uint32_t color;
+	// Presented frames
+	unsigned long frames;
+};
+
+#endif
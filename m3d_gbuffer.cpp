@@ -0,0 +1,77 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#include "m3d_gbuffer.hh"
+
+using namespace std;
+
+bool m3d_gbuffer::allocate(int newxres, int newyres)
+{
+	if (allocated() && (newxres == xres) && (newyres == yres))
+		return true;
+
+	xres = newxres;
+	yres = newyres;
+	pitch = (xres + M3D_GBUFFER_BLOCK - 1) / M3D_GBUFFER_BLOCK;
+	try
+	{
+		texels.resize((size_t)xres * (size_t)yres);
+		// Epoch 0 is never current
+		tags.assign((size_t)xres * (size_t)yres, 0);
+		blocks.assign((size_t)pitch * (size_t)((yres + M3D_GBUFFER_BLOCK - 1) / M3D_GBUFFER_BLOCK), 0);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		release();
+		return false;
+	}
+	epoch = 1;
+	return true;
+}
+
+void m3d_gbuffer::release()
+{
+	vector<m3d_gbuffer_texel>().swap(texels);
+	vector<uint32_t>().swap(tags);
+	vector<uint32_t>().swap(blocks);
+	xres = yres = pitch = 0;
+}
+
+void m3d_gbuffer::invalidate()
+{
+	if (++epoch == 0)
+	{
+		// Texels stored 2^32 epochs ago would look current
+		fill(tags.begin(), tags.end(), 0);
+		fill(blocks.begin(), blocks.end(), 0);
+		epoch = 1;
+	}
+}
+
+void m3d_gbuffer::block_area(size_t index, int &xs, int &ys, int &xe, int &ye) const
+{
+	xs = (int)(index % (size_t)pitch) * M3D_GBUFFER_BLOCK;
+	ys = (int)(index / (size_t)pitch) * M3D_GBUFFER_BLOCK;
+	xe = min(xs + M3D_GBUFFER_BLOCK, xres) - 1;
+	ye = min(ys + M3D_GBUFFER_BLOCK, yres) - 1;
+}
@@ -0,0 +1,126 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_GBUFFER_HH_INCLUDED
+#define M3D_GBUFFER_HH_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Side in pixels of the square blocks of the G-buffer. The tiles of the tiled
+ * rasterizer must be made of whole blocks.
+ */
+#define M3D_GBUFFER_BLOCK (32)
+
+/*
+ * What the lighting of a pixel needs: normal and position in world
+ * coordinates, and the color of the object
+ */
+struct m3d_gbuffer_texel
+{
+	float normal[3];
+	float position[3];
+	uint32_t color;
+};
+
+/*
+ * G-buffer of the deferred shading: the rasterizer stores the attributes of
+ * the pixels passing the depth test, then every pixel is shaded once.
+ *
+ * As the Z buffer, it is never cleared: texels and blocks of
+ * M3D_GBUFFER_BLOCK * M3D_GBUFFER_BLOCK pixels are tagged with the epoch they
+ * were written in, and invalidate() starts a new epoch. A block not written
+ * in the current epoch has no texel to shade. Tags are apart from the texels,
+ * so that finding the texels to shade reads 4 bytes per pixel.
+ * Threads can store texels concurrently into different blocks.
+ */
+class m3d_gbuffer
+{
+public:
+	m3d_gbuffer() : xres(0), yres(0), pitch(0), epoch(1) {}
+
+	/*
+	 * Allocate the buffer for xres * yres pixels, if not done yet.
+	 * Return false if there is not enough memory.
+	 */
+	bool allocate(int xres, int yres);
+
+	/*
+	 * Release the memory, until the next allocate()
+	 */
+	void release(void);
+
+	bool allocated(void) const { return !texels.empty(); }
+
+	/*
+	 * Start a new epoch: all the texels become stale
+	 */
+	void invalidate(void);
+
+	inline void store(int x, int y, const float normal[3], const float position[3], uint32_t color)
+	{
+		size_t index = (size_t)y * (size_t)xres + (size_t)x;
+		m3d_gbuffer_texel &texel = texels[index];
+
+		for (unsigned i = 0; i < 3; i++)
+		{
+			texel.normal[i] = normal[i];
+			texel.position[i] = position[i];
+		}
+		texel.color = color;
+		tags[index] = epoch;
+		blocks[(size_t)((y / M3D_GBUFFER_BLOCK) * pitch + x / M3D_GBUFFER_BLOCK)] = epoch;
+	}
+
+	/*
+	 * Return the texel of pixel (x, y) if it was stored in the current epoch,
+	 * or nullptr
+	 */
+	inline const m3d_gbuffer_texel *at(int x, int y) const
+	{
+		size_t index = (size_t)y * (size_t)xres + (size_t)x;
+
+		return (tags[index] == epoch) ? &texels[index] : nullptr;
+	}
+
+	/*
+	 * Number of blocks, and whether block index was written in the current
+	 * epoch. Blocks are numbered by rows.
+	 */
+	size_t block_count(void) const { return blocks.size(); }
+	inline bool block_written(size_t index) const { return blocks[index] == epoch; }
+
+	/*
+	 * Pixels of block index, limits are included
+	 */
+	void block_area(size_t index, int &xs, int &ys, int &xe, int &ye) const;
+
+private:
+	std::vector<m3d_gbuffer_texel> texels;
+	// Epoch of the last store into every texel and every block, and the current epoch
+	std::vector<uint32_t> tags;
+	std::vector<uint32_t> blocks;
+	int xres, yres;
+	// Blocks in a row
+	int pitch;
+	uint32_t epoch;
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cfloat>
+
+#include "m3d_halfspace.hh"
+
+static inline int m3d_min3(int a, int b, int c)
+{
+	int m = (a < b) ? a : b;
+	return (m < c) ? m : c;
+}
+
+static inline int m3d_max3(int a, int b, int c)
+{
+	int m = (a > b) ? a : b;
+	return (m > c) ? m : c;
+}
+
+bool m3d_halfspace_triangle::setup(m3d_vertex *vtx[3], int xres, int yres)
+{
+	int x[3], y[3];
+	int64_t area;
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		x[i] = vtx[i]->scrposition.x;
+		y[i] = vtx[i]->scrposition.y;
+	}
+
+	x0 = x[0];
+	y0 = y[0];
+	e1x = x[1] - x[0];
+	e1y = y[1] - y[0];
+	e2x = x[2] - x[0];
+	e2y = y[2] - y[0];
+	area = (int64_t)e1x * e2y - (int64_t)e2x * e1y;
+	if (area == 0)
+	{
+		return false;
+	}
+	invarea = 1.0f / (float)area;
+
+	minx = m3d_min3(x[0], x[1], x[2]);
+	miny = m3d_min3(y[0], y[1], y[2]);
+	maxx = m3d_max3(x[0], x[1], x[2]);
+	maxy = m3d_max3(y[0], y[1], y[2]);
+	minx = (minx < 0) ? 0 : minx;
+	miny = (miny < 0) ? 0 : miny;
+	maxx = (maxx >= xres) ? xres - 1 : maxx;
+	maxy = (maxy >= yres) ? yres - 1 : maxy;
+	if ((minx > maxx) || (miny > maxy))
+	{
+		return false;
+	}
+
+	/*
+	 * The edge function of edge i is negative on the side of the opposite
+	 * vertex when the signed area is positive: flip the signs in that case.
+	 */
+	int64_t sign = (area > 0) ? -1 : 1;
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		unsigned j = (i + 1) % 3;
+		int64_t ex = x[j] - x[i];
+		int64_t ey = y[j] - y[i];
+
+		dx[i] = sign * ey;
+		dy[i] = -sign * ex;
+		origin[i] = sign * (((int64_t)minx - x[i]) * ey - ((int64_t)miny - y[i]) * ex);
+	}
+
+	return true;
+}
+
+void m3d_halfspace_triangle::plane(float v0, float v1, float v2, m3d_halfspace_plane &out) const
+{
+	float d1 = v1 - v0;
+	float d2 = v2 - v0;
+
+	out.dx = (d1 * (float)e2y - d2 * (float)e1y) * invarea;
+	out.dy = (d2 * (float)e1x - d1 * (float)e2x) * invarea;
+	out.origin = v0 + out.dx * (float)(minx - x0) + out.dy * (float)(miny - y0);
+}
+
+float m3d_halfspace_triangle::nearest(const m3d_halfspace_plane &zp) const
+{
+	float z0 = zp.at(zp.row(y0 - miny), x0 - minx);
+	float z1 = zp.at(zp.row(y0 + e1y - miny), x0 + e1x - minx);
+	float z2 = zp.at(zp.row(y0 + e2y - miny), x0 + e2x - minx);
+
+	return std::min(z0, std::min(z1, z2));
+}
+
+float m3d_halfspace_triangle::farthest(const m3d_halfspace_plane &zp) const
+{
+	float z0 = zp.at(zp.row(y0 - miny), x0 - minx);
+	float z1 = zp.at(zp.row(y0 + e1y - miny), x0 + e1x - minx);
+	float z2 = zp.at(zp.row(y0 + e2y - miny), x0 + e2x - minx);
+
+	return std::max(z0, std::max(z1, z2));
+}
+
+bool m3d_halfspace_triangle::row_span(int y, int &xs, int &xe) const
+{
+	int64_t w[3];
+	int64_t first = 0, last = xe - xs;
+
+	edges_at(xs, y, w);
+	for (unsigned i = 0; i < 3; i++)
+	{
+		/*
+		 * Pixel xs + k is inside edge i when w + dx * k >= 0: edges with
+		 * dx > 0 bound k from below, edges with dx < 0 from above.
+		 */
+		if (dx[i] > 0)
+		{
+			if (w[i] < 0)
+				first = std::max(first, (-w[i] + dx[i] - 1) / dx[i]);
+		}
+		else if (dx[i] < 0)
+		{
+			if (w[i] < 0)
+				return false;
+			last = std::min(last, w[i] / -dx[i]);
+		}
+		else if (w[i] < 0)
+		{
+			return false;
+		}
+	}
+	if (first > last)
+		return false;
+
+	xe = xs + (int)last;
+	xs += (int)first;
+	return true;
+}
+
+/*
+ * Z of a triangle is computed from the offsets to the corner of its bounding
+ * box, first along Y and then along X: rounding is monotonic, so the computed
+ * values are monotonic along both directions too, and the nearest depth of a
+ * rectangle is exactly the nearest of its corners.
+ */
+static inline float m3d_plane_min(const m3d_halfspace_triangle &tri, const m3d_halfspace_plane &zp, int xs, int ys, int xe, int ye)
+{
+	float top = zp.row(ys - tri.miny);
+	float bottom = zp.row(ye - tri.miny);
+	float z0 = zp.at(top, xs - tri.minx);
+	float z1 = zp.at(top, xe - tri.minx);
+	float z2 = zp.at(bottom, xs - tri.minx);
+	float z3 = zp.at(bottom, xe - tri.minx);
+	float m = (z0 < z1) ? z0 : z1;
+
+	m = (m < z2) ? m : z2;
+	return (m < z3) ? m : z3;
+}
+
+/*
+ * Nearest depth of the triangle plane on row y, from column xs to xe
+ */
+static inline float m3d_row_min(const m3d_halfspace_triangle &tri, const m3d_halfspace_plane &zp, float row, int xs, int xe)
+{
+	float z0 = zp.at(row, xs - tri.minx);
+	float z1 = zp.at(row, xe - tri.minx);
+
+	return (z0 < z1) ? z0 : z1;
+}
+
+bool m3d_halfspace_target::hiz_reject(const m3d_halfspace_triangle &tri, const m3d_halfspace_plane &zp) const
+{
+	const float *blocks;
+	int xs, ys, xe, ye;
+	int side, pitch;
+	float farthest = -FLT_MAX;
+
+	if (!hizcoarse || !clip(tri, xs, ys, xe, ye))
+	{
+		return false;
+	}
+
+	// Small triangles are tested against the fine blocks, that are closer to them
+	if ((xe - xs < 4 * M3D_HIZ_FINE) && (ye - ys < 4 * M3D_HIZ_FINE))
+	{
+		blocks = hizfine;
+		side = M3D_HIZ_FINE;
+		pitch = finepitch;
+	}
+	else
+	{
+		blocks = hizcoarse;
+		side = M3D_HIZ_COARSE;
+		pitch = coarsepitch;
+	}
+
+	for (int by = (ys - y0) / side; by <= (ye - y0) / side; by++)
+	{
+		for (int bx = (xs - x0) / side; bx <= (xe - x0) / side; bx++)
+		{
+			float z = blocks[by * pitch + bx];
+
+			farthest = (z > farthest) ? z : farthest;
+		}
+	}
+
+	return m3d_plane_min(tri, zp, xs, ys, xe, ye) > farthest;
+}
+
+bool m3d_halfspace_target::hiz_span(const m3d_halfspace_triangle &tri, const m3d_halfspace_plane &zp, int y, int &xs, int &xe) const
+{
+	const float *blocks;
+	float row;
+
+	if (!hizfine)
+	{
+		return true;
+	}
+
+	blocks = hizfine + ((y - y0) / M3D_HIZ_FINE) * finepitch;
+	row = zp.row(y - tri.miny);
+	while (xs <= xe)
+	{
+		int bx = (xs - x0) / M3D_HIZ_FINE;
+		int end = x0 + (bx + 1) * M3D_HIZ_FINE - 1;
+
+		end = (end < xe) ? end : xe;
+		if (m3d_row_min(tri, zp, row, xs, end) <= blocks[bx])
+		{
+			break;
+		}
+		xs = end + 1;
+	}
+
+	while (xe > xs)
+	{
+		int bx = (xe - x0) / M3D_HIZ_FINE;
+		int start = x0 + bx * M3D_HIZ_FINE;
+
+		start = (start > xs) ? start : xs;
+		if (m3d_row_min(tri, zp, row, start, xe) <= blocks[bx])
+		{
+			break;
+		}
+		xe = start - 1;
+	}
+
+	return xs <= xe;
+}
+
+void m3d_halfspace_target::hiz_begin()
+{
+	dirtyx0 = dirtyy0 = 0;
+	dirtyx1 = dirtyy1 = -1;
+	written = 0;
+}
+
+void m3d_halfspace_target::hiz_written(int xs, int ys, int xe, int ye, unsigned long n)
+{
+	if (!hizfine)
+	{
+		return;
+	}
+
+	if (dirtyx0 > dirtyx1)
+	{
+		dirtyx0 = xs;
+		dirtyy0 = ys;
+		dirtyx1 = xe;
+		dirtyy1 = ye;
+	}
+	else
+	{
+		dirtyx0 = (xs < dirtyx0) ? xs : dirtyx0;
+		dirtyy0 = (ys < dirtyy0) ? ys : dirtyy0;
+		dirtyx1 = (xe > dirtyx1) ? xe : dirtyx1;
+		dirtyy1 = (ye > dirtyy1) ? ye : dirtyy1;
+	}
+	written += n;
+
+	if (2 * written >= (unsigned long)(dirtyx1 - dirtyx0 + 1) * (unsigned long)(dirtyy1 - dirtyy0 + 1))
+	{
+		hiz_flush();
+	}
+}
+
+void m3d_halfspace_target::hiz_flush()
+{
+	if (dirtyx0 <= dirtyx1)
+	{
+		hiz_update(dirtyx0, dirtyy0, dirtyx1, dirtyy1);
+	}
+	hiz_begin();
+}
+
+/*
+ * Farthest depth of a fine block, rows are reduced in columns first so that
+ * the compiler can use vector instructions
+ */
+static inline float m3d_block_max(const float *depth, int pitch, int width, int height)
+{
+	float column[M3D_HIZ_FINE];
+	float farthest = -FLT_MAX;
+
+	if ((width == M3D_HIZ_FINE) && (height == M3D_HIZ_FINE))
+	{
+		for (int x = 0; x < M3D_HIZ_FINE; x++)
+		{
+			column[x] = depth[x];
+		}
+		for (int y = 1; y < M3D_HIZ_FINE; y++)
+		{
+			const float *z = depth + y * pitch;
+
+			for (int x = 0; x < M3D_HIZ_FINE; x++)
+			{
+				column[x] = (z[x] > column[x]) ? z[x] : column[x];
+			}
+		}
+		for (int x = 0; x < M3D_HIZ_FINE; x++)
+		{
+			farthest = (column[x] > farthest) ? column[x] : farthest;
+		}
+		return farthest;
+	}
+
+	// Blocks cut by the right or bottom border
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float z = depth[y * pitch + x];
+
+			farthest = (z > farthest) ? z : farthest;
+		}
+	}
+	return farthest;
+}
+
+void m3d_halfspace_target::hiz_update(int xs, int ys, int xe, int ye)
+{
+	int fx0, fy0, fx1, fy1;
+
+	if (!hizfine)
+	{
+		return;
+	}
+
+	fx0 = (xs - x0) / M3D_HIZ_FINE;
+	fy0 = (ys - y0) / M3D_HIZ_FINE;
+	fx1 = (xe - x0) / M3D_HIZ_FINE;
+	fy1 = (ye - y0) / M3D_HIZ_FINE;
+	for (int by = fy0; by <= fy1; by++)
+	{
+		int py = y0 + by * M3D_HIZ_FINE;
+		int height = (py + M3D_HIZ_FINE - 1 < y1) ? M3D_HIZ_FINE : y1 - py + 1;
+
+		for (int bx = fx0; bx <= fx1; bx++)
+		{
+			int px = x0 + bx * M3D_HIZ_FINE;
+			int width = (px + M3D_HIZ_FINE - 1 < x1) ? M3D_HIZ_FINE : x1 - px + 1;
+
+			hizfine[by * finepitch + bx] = m3d_block_max(depth_at(px, py), zpitch, width, height);
+		}
+	}
+
+	// Coarse blocks are the farthest of the fine blocks they contain
+	int lastx = (x1 - x0) / M3D_HIZ_FINE;
+	int lasty = (y1 - y0) / M3D_HIZ_FINE;
+	int ratio = M3D_HIZ_COARSE / M3D_HIZ_FINE;
+
+	for (int by = fy0 / ratio; by <= fy1 / ratio; by++)
+	{
+		for (int bx = fx0 / ratio; bx <= fx1 / ratio; bx++)
+		{
+			float farthest = -FLT_MAX;
+
+			for (int fy = by * ratio; (fy < (by + 1) * ratio) && (fy <= lasty); fy++)
+			{
+				for (int fx = bx * ratio; (fx < (bx + 1) * ratio) && (fx <= lastx); fx++)
+				{
+					float z = hizfine[fy * finepitch + fx];
+
+					farthest = (z > farthest) ? z : farthest;
+				}
+			}
+			hizcoarse[by * coarsepitch + bx] = farthest;
+		}
+	}
+}
@@ -0,0 +1,262 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_HALFSPACE_HH_INCLUDED
+#define M3D_HALFSPACE_HH_INCLUDED
+
+#include <cstdint>
+
+#include "m3d_vertex.hh"
+#include "m3d_zbuffer.hh"
+
+class m3d_render_object;
+
+/*
+ * Plane equation of an attribute over the screen:
+ *
+ * value(x, y) = origin + dx * (x - minx) + dy * (y - miny)
+ *
+ * (minx, miny) is the top left corner of the triangle bounding box, so that
+ * values are computed close to the triangle and keep their precision.
+ * Values are computed from the offsets to the corner rather than stepped
+ * from pixel to pixel: a pixel gets the same value wherever the
+ * rasterization of the triangle starts, e.g. in a tile.
+ */
+struct m3d_halfspace_plane
+{
+	float origin;
+	float dx, dy;
+
+	// Value at the start of the row oy rows below the corner
+	inline float row(int oy) const { return origin + dy * (float)oy; }
+	// Value ox pixels to the right of the start of the row
+	inline float at(float rowvalue, int ox) const { return rowvalue + dx * (float)ox; }
+};
+
+/*
+ * Triangle setup for the half-space rasterizer.
+ *
+ * Every edge of the triangle splits the screen into two half planes, the
+ * edge function
+ *
+ * E(x, y) = (x - xi) * (yj - yi) - (y - yi) * (xj - xi)
+ *
+ * is zero on the edge and has opposite signs on the two sides. A pixel is
+ * inside the triangle when it is on the inner side of the three edges.
+ * Edge functions and attribute planes are linear, so they are evaluated once
+ * in a corner of the bounding box and then stepped by constant increments.
+ * Pixels on the edges are inside, as the scanline rasterizer draws both ends
+ * of every span.
+ */
+class m3d_halfspace_triangle
+{
+public:
+	m3d_halfspace_triangle() : minx(0), miny(0), maxx(-1), maxy(-1), x0(0), y0(0), e1x(0), e1y(0), e2x(0), e2y(0), invarea(0.0f)
+	{
+		for (unsigned i = 0; i < 3; i++)
+		{
+			origin[i] = dx[i] = dy[i] = 0;
+		}
+	}
+
+	/*
+	 * Compute bounding box and edge functions of the triangle with screen vertices vtx,
+	 * the bounding box is clipped to the screen area xres * yres.
+	 * Return false if there is nothing to draw: the triangle has no area, or it
+	 * lies outside the screen.
+	 */
+	bool setup(m3d_vertex *vtx[3], int xres, int yres);
+
+	/*
+	 * Compute the plane equation of an attribute with values v0, v1, v2 on the
+	 * vertices passed to setup()
+	 */
+	void plane(float v0, float v1, float v2, m3d_halfspace_plane &out) const;
+
+	/*
+	 * Compute the edge functions in pixel (x, y)
+	 */
+	void edges_at(int x, int y, int64_t w[3]) const
+	{
+		for (unsigned i = 0; i < 3; i++)
+		{
+			w[i] = origin[i] + dx[i] * (x - minx) + dy[i] * (y - miny);
+		}
+	}
+
+	/*
+	 * Narrow the columns xs to xe of row y to the pixels inside the triangle,
+	 * solving the edge functions for x instead of testing every pixel.
+	 * Return false if there are none.
+	 */
+	bool row_span(int y, int &xs, int &xe) const;
+
+	/*
+	 * The smallest and the largest value of plane zp on the vertices, the
+	 * nearest and the farthest depth of the triangle when zp is its Z plane
+	 */
+	float nearest(const m3d_halfspace_plane &zp) const;
+	float farthest(const m3d_halfspace_plane &zp) const;
+
+	/*
+	 * Return true if all the edge functions are not negative
+	 */
+	static inline bool inside(int64_t w0, int64_t w1, int64_t w2)
+	{
+		return (w0 | w1 | w2) >= 0;
+	}
+
+	/*
+	 * Bounding box, limits are included
+	 */
+	int minx, miny, maxx, maxy;
+	/*
+	 * Edge functions in (minx, miny), and their increments for a step along X and along Y.
+	 * Signs are set so that the inner side of every edge is positive.
+	 */
+	int64_t origin[3];
+	int64_t dx[3], dy[3];
+
+private:
+	// Vertex 0, the edges from vertex 0 to vertices 1 and 2, and the inverse of twice the signed area
+	int x0, y0;
+	int e1x, e1y, e2x, e2y;
+	float invarea;
+};
+
+/*
+ * Number of attribute planes, enough for Z plus normal and position in world
+ * coordinates (Phong)
+ */
+#define M3D_HALFSPACE_PLANES (7)
+
+/*
+ * A triangle ready to be rasterized: edge functions and the plane equations
+ * of Z (always planes[0]) and of the attributes used by the renderer, plus the
+ * constant color, the object for per pixel lighting and the id of the
+ * triangle in the visibility buffer.
+ */
+struct m3d_halfspace_setup
+{
+	m3d_halfspace_triangle tri;
+	m3d_halfspace_plane planes[M3D_HALFSPACE_PLANES];
+	uint32_t color;
+	m3d_render_object *obj;
+	uint32_t id;
+};
+
+/*
+ * A rectangle of the color and depth buffers to rasterize into, limits are
+ * included. color and depth point to pixel (x0, y0), pitches are in pixels.
+ * The whole screen is a target, and so is a tile.
+ * hizfine and hizcoarse point to the hierarchical Z blocks starting at
+ * (x0, y0), pitches are in blocks; (x0, y0) must be aligned to M3D_HIZ_COARSE.
+ * They are null when the hierarchical Z is not used.
+ * Depth tests are counted in the target, so that every thread counts its own.
+ * With equal set, pixels pass the depth test only if their depth equals the
+ * Z buffer, for the shading pass after a depth pre-pass. With painter set,
+ * all the pixels are written with no test, counted in passes only, and the
+ * Z buffer is neither read nor written, for triangles drawn back to front:
+ * depth then points to a buffer of one row, with zpitch 0, so that the
+ * addresses computed stay valid.
+ */
+struct m3d_halfspace_target
+{
+	uint32_t *color;
+	float *depth;
+	int cpitch, zpitch;
+	int x0, y0, x1, y1;
+	float *hizfine, *hizcoarse;
+	int finepitch, coarsepitch;
+	// Rectangle written since the hierarchical Z was last recomputed, and the pixels written into it
+	int dirtyx0, dirtyy0, dirtyx1, dirtyy1;
+	unsigned long written;
+	unsigned long tests, passes;
+	bool equal;
+	bool painter;
+
+	inline uint32_t *color_at(int x, int y) { return color + (y - y0) * cpitch + (x - x0); }
+	inline float *depth_at(int x, int y) { return depth + (y - y0) * zpitch + (x - x0); }
+
+	inline bool test_update(float *zbuf, float z)
+	{
+		if (painter)
+		{
+			// Written with no test
+			passes++;
+			return true;
+		}
+		tests++;
+		if (equal ? (z == *zbuf) : (z <= *zbuf))
+		{
+			*zbuf = z;
+			passes++;
+			return true;
+		}
+		return false;
+	}
+
+	/*
+	 * Clip the bounding box of tri to the target.
+	 * Return false if they do not overlap.
+	 */
+	inline bool clip(const m3d_halfspace_triangle &tri, int &xs, int &ys, int &xe, int &ye) const
+	{
+		xs = (tri.minx > x0) ? tri.minx : x0;
+		ys = (tri.miny > y0) ? tri.miny : y0;
+		xe = (tri.maxx < x1) ? tri.maxx : x1;
+		ye = (tri.maxy < y1) ? tri.maxy : y1;
+		return (xs <= xe) && (ys <= ye);
+	}
+
+	/*
+	 * Return true if the hierarchical Z proves the whole triangle hidden in
+	 * the target: its nearest depth is farther than the coarse blocks it overlaps.
+	 * zp is the plane of Z.
+	 */
+	bool hiz_reject(const m3d_halfspace_triangle &tri, const m3d_halfspace_plane &zp) const;
+
+	/*
+	 * Narrow the columns xs to xe of row y to the fine blocks where the
+	 * triangle may be visible, dropping the hidden blocks at both ends.
+	 * Return false if the whole row is hidden.
+	 */
+	bool hiz_span(const m3d_halfspace_triangle &tri, const m3d_halfspace_plane &zp, int y, int &xs, int &xe) const;
+
+	/*
+	 * Recomputing the blocks after every triangle would read again the pixels
+	 * it wrote, and many more for small triangles. The rectangles written are
+	 * merged instead, and their blocks are recomputed once the pixels written
+	 * are as many as the merged rectangle holds, i.e. when it is likely
+	 * covered: stale blocks are still upper bounds, they only reject less.
+	 * hiz_begin() empties the rectangle, hiz_written() adds the rectangle
+	 * from (xs, ys) to (xe, ye) where n pixels have been written, hiz_flush()
+	 * recomputes the blocks of the rectangle.
+	 */
+	void hiz_begin(void);
+	void hiz_written(int xs, int ys, int xe, int ye, unsigned long n);
+	void hiz_flush(void);
+
+	/*
+	 * Recompute the blocks overlapping the rectangle from (xs, ys) to (xe, ye)
+	 */
+	void hiz_update(int xs, int ys, int xe, int ye);
+};
+
+#endif
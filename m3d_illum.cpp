@@ -18,6 +18,7 @@
  */
 
 #include "m3d_illum.hh"
+#include "m3d_profiler.hh"
 #include <iostream>
 
 static inline float m3d_max(float a, float b)
@@ -30,18 +31,32 @@ m3d_illumination::m3d_illumination()
 }
 
 // TBD: consider all lights as white RGB(255,255,255) to reduce computation
-void m3d_illumination::ambient_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out)
+void m3d_illumination::ambient_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out) const
 {
+	ambient_lighting(vtx, obj.color, world, out);
+}
+
+void m3d_illumination::ambient_lighting(m3d_vertex &vtx, const m3d_color &color, m3d_world &world, struct m3d_render_color &out) const
+{
+	M3D_PROFILE_SCOPE(STAGE_LIGHTING);
+
 	// Ambient light does not depend on position anyway...
 	float lightint = world.ambient_light.get_intensity(vtx.tposition);
-	out.Kamb = obj.color;
+	out.Kamb = color;
 	out.Kamb.brighten(lightint);
 	out.ambint = lightint;
 }
 
 // TBD: consider all lights as white RGB(255,255,255) to reduce computation
-void m3d_illumination::diffuse_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out)
+void m3d_illumination::diffuse_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out) const
+{
+	diffuse_lighting(vtx, obj.color, world, out);
+}
+
+void m3d_illumination::diffuse_lighting(m3d_vertex &vtx, const m3d_color &color, m3d_world &world, struct m3d_render_color &out) const
 {
+	M3D_PROFILE_SCOPE(STAGE_LIGHTING);
+
 	float lightint = 0.0f;
 	m3d_vector vtxworld(vtx.tposition);
 	//  Now we sum all diffuse contributions considering light position w.r.t. vtx position and the surface normal.
@@ -53,14 +68,21 @@ void m3d_illumination::diffuse_lighting(m3d_vertex &vtx, m3d_render_object &obj,
 		float dot = L.dot_product(vtx.tnormal);
 		lightint += lights->get_intensity(vtx.tposition) * m3d_max(dot, 0.0f);
 	}
-	out.Kdiff = obj.color;
+	out.Kdiff = color;
 	out.Kdiff.brighten(lightint);
 	out.diffint = lightint;
 }
 
 // Using halfway vector
-void m3d_illumination::specular_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out)
+void m3d_illumination::specular_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out) const
+{
+	specular_lighting(vtx, obj.color, world, out);
+}
+
+void m3d_illumination::specular_lighting(m3d_vertex &vtx, const m3d_color &color, m3d_world &world, struct m3d_render_color &out) const
 {
+	M3D_PROFILE_SCOPE(STAGE_LIGHTING);
+
 	float lightint = 0.0f;
 	m3d_vector V(vtx.tposition);
 	// Now we sum all specular contributions considering light position w.r.t. vtx position and the surface normal.
@@ -82,14 +104,14 @@ void m3d_illumination::specular_lighting(m3d_vertex &vtx, m3d_render_object &obj
 			lightint += lights->get_intensity(vtx.tposition) * m3d_max(dot, 0.0f);
 		}
 	}
-	out.Kspec = obj.color;
+	out.Kspec = color;
 	out.Kspec.brighten(lightint);
 	out.specint = lightint;
 }
 
-m3d_illumination &m3d_illum::inst()
+const m3d_illumination &m3d_illum::inst()
 {
-	static m3d_illumination instance;
+	static const m3d_illumination instance;
 
 	return instance;
 }
\ No newline at end of file
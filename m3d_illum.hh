@@ -23,22 +23,38 @@
 #include "m3d_world.hh"
 #include "m3d_render_color.hh"
 
+/*
+ * Lighting models.
+ * The illumination has no state: results depend on the arguments only and are
+ * written to out, so that threads can light vertices and pixels concurrently
+ * as long as every thread has its own out.
+ */
 class m3d_illumination
 {
 public:
 	m3d_illumination();
 
-	void ambient_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out);
+	void ambient_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out) const;
+
+	void diffuse_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out) const;
+
+	void specular_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out) const;
+
+	/*
+	 * The same, for a surface of the given color rather than of the object
+	 * color, e.g. a pixel read back from a G-buffer
+	 */
+	void ambient_lighting(m3d_vertex &vtx, const m3d_color &color, m3d_world &world, struct m3d_render_color &out) const;
 
-	void diffuse_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out);
+	void diffuse_lighting(m3d_vertex &vtx, const m3d_color &color, m3d_world &world, struct m3d_render_color &out) const;
 
-	void specular_lighting(m3d_vertex &vtx, m3d_render_object &obj, m3d_world &world, struct m3d_render_color &out);
+	void specular_lighting(m3d_vertex &vtx, const m3d_color &color, m3d_world &world, struct m3d_render_color &out) const;
 };
 
 class m3d_illum : public m3d_illumination
 {
 public:
-	static m3d_illumination &inst(void);
+	static const m3d_illumination &inst(void);
 };
 
 #endif
\ No newline at end of file
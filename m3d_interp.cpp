@@ -137,7 +137,8 @@ m3d_interpolation_color::m3d_interpolation_color(const unsigned int steps, m3d_c
 	{
 		for (unsigned i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
 		{
-			delta[i] = acc[i] = 0;
+			delta[i] = 0;
+			acc[i] = ((unsigned)val.channels[i] << 24) + (1U << 23);
 		}
 	}
 	else
@@ -172,7 +173,8 @@ void m3d_interpolation_color::init(const unsigned int step, m3d_color &val1, m3d
 	{
 		for (unsigned i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
 		{
-			delta[i] = acc[i] = 0;
+			delta[i] = 0;
+			acc[i] = ((unsigned)val.channels[i] << 24) + (1U << 23);
 		}
 	}
 	else
@@ -224,6 +226,16 @@ void m3d_interpolation_color::valuearray(uint32_t *out)
 	}
 }
 
+void m3d_interpolation_color::span(m3d_span_color &out) const
+{
+	for (unsigned i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
+	{
+		out.acc[i] = acc[i];
+		out.delta[i] = delta[i];
+	}
+	out.alpha = start.color & ((uint32_t)UCHAR_MAX << m3d_color::A_SHIFT);
+}
+
 m3d_interpolation_float_perspective::m3d_interpolation_float_perspective(const unsigned int steps, float z1, float z2, float val1, float val2) : m3d_interpolation(steps), val1(val1), val(val1)
 {
 	if (steps == 1)
@@ -249,6 +261,15 @@ void m3d_interpolation_float_perspective::step()
 	}
 }
 
+void m3d_interpolation_float_perspective::span(m3d_span_perspective &out) const
+{
+	out.first = val;
+	out.num = val1;
+	out.dnum = deltav;
+	out.den = z1inv;
+	out.dden = deltazinv;
+}
+
 void m3d_interpolation_float_perspective::valuearray(float *out)
 {
 	while (steps--)
@@ -333,4 +354,143 @@ void m3d_interpolation_vector_perspective::valuearray(m3d_vector *out)
 		val = vector1;
 		val.scale(1.0f / z1inv);
 	}
-}
\ No newline at end of file
+}
+
+void m3d_lerp_perspective::set(const unsigned int steps, float z1, float z2, float val1, float val2, const unsigned int every)
+{
+	nsteps = (steps > 0) ? steps : 1;
+	this->every = (every > 0) ? every : 1;
+	p.first = p.num = val1;
+
+	if (nsteps == 1)
+	{
+		p.dnum = p.den = p.dden = 0.0f;
+	}
+	else
+	{
+		p.dnum = (val2 / z2 - val1 / z1) / (float)(nsteps - 1);
+		p.dden = (1.0f / z2 - 1.0f / z1) / (float)(nsteps - 1);
+		p.den = 1.0f / z1;
+	}
+}
+
+void m3d_lerp_perspective::skip(const unsigned int n)
+{
+	if (n == 0)
+		return;
+
+	p.first = at(n);
+	p.num += p.dnum * (float)n;
+	p.den += p.dden * (float)n;
+	nsteps = (nsteps > n) ? nsteps - n : 1;
+}
+
+m3d_span_perspective m3d_lerp_perspective::run(const unsigned int i, unsigned int &count) const
+{
+	unsigned int last = nsteps - 1, next;
+	m3d_span_perspective r;
+
+	// The exact values at i and next, linear in between: the last run ends with the last value
+	if (last - i > every)
+	{
+		next = i + every;
+		count = every;
+	}
+	else
+	{
+		next = last;
+		count = last - i + 1;
+	}
+
+	r.first = r.num = at(i);
+	r.dnum = (next == i) ? 0.0f : (at(next) - r.num) / (float)(next - i);
+	r.den = 1.0f;
+	r.dden = 0.0f;
+	return r;
+}
+
+void m3d_lerp_perspective::fill(const unsigned int n, float *out) const
+{
+	unsigned int count;
+
+	if (every == 1)
+	{
+		for (unsigned int i = 0; i < n; i++)
+			out[i] = at(i);
+		return;
+	}
+
+	for (unsigned int i = 0; i < n; i += count)
+	{
+		m3d_span_perspective r = run(i, count);
+
+		for (unsigned int j = 0; (j < count) && (i + j < n); j++)
+			out[i + j] = r.num + r.dnum * (float)j;
+	}
+}
+
+void m3d_lerp_color::set(const unsigned int steps, m3d_color &val1, m3d_color &val2)
+{
+	nsteps = (steps > 0) ? steps : 1;
+	c.alpha = val1.getColor() & ((uint32_t)UCHAR_MAX << m3d_color::A_SHIFT);
+
+	for (unsigned i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
+	{
+		if (nsteps == 1)
+		{
+			c.delta[i] = 0;
+		}
+		else if (val2.getChannel(i) >= val1.getChannel(i))
+		{
+			c.delta[i] = ((unsigned)(val2.getChannel(i) - val1.getChannel(i)) << 24) / (nsteps - 1);
+		}
+		else
+		{
+			c.delta[i] = UINT_MAX - ((unsigned)(val1.getChannel(i) - val2.getChannel(i)) << 24) / (nsteps - 1);
+		}
+		c.acc[i] = ((unsigned)val1.getChannel(i) << 24) + (1U << 23);
+	}
+}
+
+void m3d_lerp_color::fill(const unsigned int n, uint32_t *out) const
+{
+	for (unsigned int i = 0; i < n; i++)
+		out[i] = at(i);
+}
+
+void m3d_lerp_color::skip(const unsigned int n)
+{
+	// The unsigned sums wrap around as the stepped ones
+	for (unsigned i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
+	{
+		c.acc[i] += c.delta[i] * n;
+	}
+	nsteps = (nsteps > n) ? nsteps - n : 1;
+}
+
+void m3d_lerp_vector::set(const unsigned int steps, const m3d_vector &v1, const m3d_vector &v2)
+{
+	nsteps = (steps > 0) ? steps : 1;
+
+	for (unsigned i = X_C; i <= Z_C; i++)
+	{
+		start[i] = v1.myvector[i];
+		delta[i] = (nsteps == 1) ? 0.0f : (v2.myvector[i] - v1.myvector[i]) / (float)(nsteps - 1);
+	}
+	start[T_C] = v1.myvector[T_C];
+}
+
+void m3d_lerp_vector::fill(const unsigned int n, m3d_vector *out) const
+{
+	for (unsigned int i = 0; i < n; i++)
+		at(i, out[i]);
+}
+
+void m3d_lerp_vector::skip(const unsigned int n)
+{
+	for (unsigned i = X_C; i <= Z_C; i++)
+	{
+		start[i] += delta[i] * (float)n;
+	}
+	nsteps = (nsteps > n) ? nsteps - n : 1;
+}
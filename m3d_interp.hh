@@ -22,8 +22,10 @@
 
 #include <cmath>
 #include <cstdint>
+#include <type_traits>
 #include "m3d_math_vector.hh"
 #include "m3d_color.hh"
+#include "m3d_span.hh"
 
 /*
  * Interpolation classes
@@ -147,6 +149,11 @@ public:
 
 	inline uint32_t value(void) { return val.color; }
 
+	/*
+	 * Fill the span kernel parameters computing the colors of all the steps
+	 */
+	void span(m3d_span_color &out) const;
+
 private:
 	union m3d_color::m3d_color_channels start, val;
 	unsigned delta[3];
@@ -175,6 +182,11 @@ public:
 
 	inline float value(void) { return val; }
 
+	/*
+	 * Fill the span kernel parameters computing the values of all the steps
+	 */
+	void span(m3d_span_perspective &out) const;
+
 private:
 	float val1, z1inv, deltav, deltazinv, val;
 };
@@ -226,4 +238,187 @@ private:
 	m3d_vector vector1, deltavector, val;
 };
 
+/*
+ * Span interpolators.
+ *
+ * The classes above step one value at a time through virtual functions. The
+ * ones below are final and trivially constructible, so that they cost nothing
+ * to declare on the stack for every edge of every triangle: set() computes
+ * the increments as the classes above, at() computes value i, and fill(n, out)
+ * stores the first n values at once with the m3d_span kernels of the level in
+ * use. skip(n) drops the first n values, for the spans clipped to the screen. Value i is computed from i rather than stepped, as the span kernels do,
+ * so that every level gives the same values.
+ */
+class m3d_lerp_float final
+{
+public:
+	m3d_lerp_float() = default;
+
+	inline void set(unsigned int steps, float val1, float val2)
+	{
+		nsteps = (steps > 0) ? steps : 1;
+		start = val1;
+		delta = (nsteps == 1) ? 0.0f : (val2 - val1) / (float)(nsteps - 1);
+	}
+
+	inline float at(unsigned int i) const { return start + delta * (float)i; }
+
+	inline void fill(unsigned int n, float *out) const { m3d_span::inst().ramp(out, n, start, delta); }
+
+	inline void skip(unsigned int n)
+	{
+		start = at(n);
+		nsteps = (nsteps > n) ? nsteps - n : 1;
+	}
+
+	inline unsigned int stepsvalue(void) const { return nsteps; }
+
+	inline float value(void) const { return start; }
+
+	inline float deltavalue(void) const { return delta; }
+
+private:
+	unsigned int nsteps;
+	float start, delta;
+};
+
+/*
+ * As m3d_interpolation_short, 16.16 fixed point. The values are the ones of
+ * the stepped sums, being integers.
+ */
+class m3d_lerp_short final
+{
+public:
+	m3d_lerp_short() = default;
+
+	inline void set(unsigned int steps, short val1, short val2)
+	{
+		nsteps = (steps > 0) ? steps : 1;
+		start = val1 * 65536;
+		delta = (nsteps == 1) ? 0 : (val2 - val1) * 65536 / (int)(nsteps - 1);
+	}
+
+	inline short at(unsigned int i) const { return (short)((int32_t)((uint32_t)start + (uint32_t)delta * i + 0x8000u) >> 16); }
+
+	inline void fill(unsigned int n, short *out) const { m3d_span::inst().ramp_fixed(out, n, start, delta); }
+
+	inline unsigned int stepsvalue(void) const { return nsteps; }
+
+	inline int deltavalue(void) const { return delta; }
+
+private:
+	unsigned int nsteps;
+	int32_t start, delta;
+};
+
+/*
+ * As m3d_interpolation_float_perspective. With every > 1 fill() divides only
+ * for one value in every, at the values i multiple of every and at the last
+ * one, and interpolates linearly the ones in between: the error grows with
+ * every and with the depth range of the span, 8 or 16 are the usual choices
+ * for long spans. run() gives the same values to the span kernels.
+ */
+class m3d_lerp_perspective final
+{
+public:
+	m3d_lerp_perspective() = default;
+
+	void set(unsigned int steps, float z1, float z2, float val1, float val2, unsigned int every = 1);
+
+	inline float at(unsigned int i) const { return (i == 0) ? p.first : (p.num + p.dnum * (float)i) / (p.den + p.dden * (float)i); }
+
+	void fill(unsigned int n, float *out) const;
+
+	void skip(unsigned int n);
+
+	inline unsigned int stepsvalue(void) const { return nsteps; }
+
+	/*
+	 * The span kernel parameters
+	 */
+	inline const m3d_span_perspective &span(void) const { return p; }
+
+	/*
+	 * With every > 1, the span kernel parameters of the values from i to the
+	 * next one divided for, interpolated linearly, and their number in count
+	 */
+	m3d_span_perspective run(unsigned int i, unsigned int &count) const;
+
+private:
+	unsigned int nsteps, every;
+	m3d_span_perspective p;
+};
+
+/*
+ * As m3d_interpolation_color, 8.24 fixed point. The values are the ones of
+ * the stepped sums, the unsigned sums wrapping around in the same way.
+ */
+class m3d_lerp_color final
+{
+public:
+	m3d_lerp_color() = default;
+
+	void set(unsigned int steps, m3d_color &val1, m3d_color &val2);
+
+	inline uint32_t at(unsigned int i) const
+	{
+		return c.alpha |
+		       (((c.acc[m3d_color::R_CHANNEL] + c.delta[m3d_color::R_CHANNEL] * i) >> 24) << m3d_color::R_SHIFT) |
+		       (((c.acc[m3d_color::G_CHANNEL] + c.delta[m3d_color::G_CHANNEL] * i) >> 24) << m3d_color::G_SHIFT) |
+		       (((c.acc[m3d_color::B_CHANNEL] + c.delta[m3d_color::B_CHANNEL] * i) >> 24) << m3d_color::B_SHIFT);
+	}
+
+	void fill(unsigned int n, uint32_t *out) const;
+
+	void skip(unsigned int n);
+
+	inline unsigned int stepsvalue(void) const { return nsteps; }
+
+	/*
+	 * The span kernel parameters
+	 */
+	inline const m3d_span_color &span(void) const { return c; }
+
+private:
+	unsigned int nsteps;
+	m3d_span_color c;
+};
+
+/*
+ * As m3d_interpolation_vector: the X, Y and Z components are interpolated,
+ * T keeps the one of the first vector.
+ */
+class m3d_lerp_vector final
+{
+public:
+	m3d_lerp_vector() = default;
+
+	void set(unsigned int steps, const m3d_vector &v1, const m3d_vector &v2);
+
+	inline void at(unsigned int i, m3d_vector &out) const
+	{
+		out.myvector[X_C] = start[X_C] + delta[X_C] * (float)i;
+		out.myvector[Y_C] = start[Y_C] + delta[Y_C] * (float)i;
+		out.myvector[Z_C] = start[Z_C] + delta[Z_C] * (float)i;
+		out.myvector[T_C] = start[T_C];
+	}
+
+	void fill(unsigned int n, m3d_vector *out) const;
+
+	void skip(unsigned int n);
+
+	inline unsigned int stepsvalue(void) const { return nsteps; }
+
+private:
+	unsigned int nsteps;
+	float start[4], delta[3];
+};
+
+static_assert(std::is_trivially_default_constructible_v<m3d_lerp_float> &&
+		  std::is_trivially_default_constructible_v<m3d_lerp_short> &&
+		  std::is_trivially_default_constructible_v<m3d_lerp_perspective> &&
+		  std::is_trivially_default_constructible_v<m3d_lerp_color> &&
+		  std::is_trivially_default_constructible_v<m3d_lerp_vector>,
+	      "The span interpolators must be trivially constructible");
+
 #endif
@@ -0,0 +1,203 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "m3d_jobs.hh"
+
+using namespace std;
+
+/*
+ * The job system whose worker is the calling thread, and its index there.
+ * Every renderer has a job system of its own: the index is valid only in
+ * thread_owner, the owner thread and the threads of other job systems are 0.
+ */
+static thread_local const m3d_jobs *thread_owner = nullptr;
+static thread_local unsigned thread_id = 0;
+
+m3d_jobs::m3d_jobs() : queued(0), quit(false)
+{
+	queues.push_back(make_unique<queue>());
+}
+
+m3d_jobs::~m3d_jobs()
+{
+	stop();
+}
+
+void m3d_jobs::stop()
+{
+	{
+		lock_guard<mutex> guard(sleeplock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &it : workers)
+	{
+		it.join();
+	}
+	workers.clear();
+	queues.resize(1);
+	quit = false;
+}
+
+void m3d_jobs::set_threads(unsigned n)
+{
+	if (n == 0)
+	{
+		n = thread::hardware_concurrency();
+		n = (n > 0) ? n : 1;
+	}
+
+	if (n == get_threads())
+	{
+		return;
+	}
+
+	stop();
+	for (unsigned i = 1; i < n; i++)
+	{
+		queues.push_back(make_unique<queue>());
+	}
+	for (unsigned i = 1; i < n; i++)
+	{
+		workers.emplace_back(&m3d_jobs::worker, this, i);
+	}
+}
+
+void m3d_jobs::push(unsigned id, const job &j)
+{
+	{
+		lock_guard<mutex> guard(queues[id]->lock);
+		queues[id]->jobs.push_back(j);
+	}
+	queued.fetch_add(1, memory_order_release);
+	{
+		// A worker testing queued under sleeplock either sees the job or gets the notification
+		lock_guard<mutex> guard(sleeplock);
+	}
+	wake.notify_one();
+}
+
+bool m3d_jobs::pop(unsigned id, job &j)
+{
+	lock_guard<mutex> guard(queues[id]->lock);
+
+	if (queues[id]->jobs.empty())
+	{
+		return false;
+	}
+	j = queues[id]->jobs.back();
+	queues[id]->jobs.pop_back();
+	queued.fetch_sub(1, memory_order_relaxed);
+	return true;
+}
+
+bool m3d_jobs::steal(unsigned id, job &j)
+{
+	size_t n = queues.size();
+
+	// Start from the next thread, so that victims are spread
+	for (size_t i = 1; i < n; i++)
+	{
+		queue &victim = *queues[(id + i) % n];
+		lock_guard<mutex> guard(victim.lock);
+
+		if (!victim.jobs.empty())
+		{
+			j = victim.jobs.front();
+			victim.jobs.pop_front();
+			queued.fetch_sub(1, memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void m3d_jobs::execute(unsigned id, job j)
+{
+	while (j.last - j.first > j.grain)
+	{
+		// Split at a multiple of grain, the second half is left to thieves
+		size_t chunks = (j.last - j.first + j.grain - 1) / j.grain;
+		size_t mid = j.first + (chunks / 2) * j.grain;
+
+		push(id, {j.body, mid, j.last, j.grain, j.pending});
+		j.last = mid;
+	}
+
+	(*j.body)(j.first, j.last, id);
+	j.pending->fetch_sub(j.last - j.first, memory_order_acq_rel);
+}
+
+void m3d_jobs::worker(unsigned id)
+{
+	job j;
+
+	thread_owner = this;
+	thread_id = id;
+	for (;;)
+	{
+		if (pop(id, j) || steal(id, j))
+		{
+			execute(id, j);
+			continue;
+		}
+
+		unique_lock<mutex> guard(sleeplock);
+		wake.wait(guard, [this]
+			  { return quit || (queued.load(memory_order_acquire) > 0); });
+		if (quit)
+		{
+			return;
+		}
+	}
+}
+
+void m3d_jobs::parallel_for(size_t begin, size_t end, size_t grain, const body_t &body)
+{
+	unsigned id = (thread_owner == this) ? thread_id : 0;
+	atomic<size_t> pending(end - begin);
+	job j;
+
+	if (begin >= end)
+	{
+		return;
+	}
+
+	if (workers.empty())
+	{
+		body(begin, end, 0);
+		return;
+	}
+
+	grain = (grain > 0) ? grain : 1;
+	execute(id, {&body, begin, end, grain, &pending});
+
+	// Help with any job while the ranges of this loop are completed
+	while (pending.load(memory_order_acquire) > 0)
+	{
+		if (pop(id, j) || steal(id, j))
+		{
+			execute(id, j);
+		}
+		else
+		{
+			this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_JOBS_HH_INCLUDED
+#define M3D_JOBS_HH_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing job system.
+ *
+ * A job is a range of indexes of a parallel_for. Every thread has a deque of
+ * jobs: a thread splits the range it is running in halves, pushes one half at
+ * the back of its own deque and keeps splitting the other half until it is no
+ * larger than the grain, then runs it. Threads take jobs from the back of
+ * their own deque (the most recent, smallest ranges, whose data is still in
+ * cache), and idle threads steal from the front of the other deques (the
+ * oldest, largest ranges).
+ * A thread waiting for a parallel_for to complete runs jobs meanwhile, so
+ * parallel_for can be nested: e.g. a loop over objects can run a loop over
+ * the vertices of every object.
+ *
+ * parallel_for must be called by the thread owning the job system, or from
+ * inside a job.
+ */
+class m3d_jobs
+{
+public:
+	typedef std::function<void(size_t first, size_t last, unsigned thread)> body_t;
+
+	m3d_jobs();
+	~m3d_jobs();
+
+	m3d_jobs(const m3d_jobs &) = delete;
+	m3d_jobs &operator=(const m3d_jobs &) = delete;
+
+	/*
+	 * Set the number of threads running the jobs, the owner thread included.
+	 * 0 selects the number of hardware threads.
+	 */
+	void set_threads(unsigned n);
+
+	unsigned get_threads(void) const { return (unsigned)workers.size() + 1; }
+
+	/*
+	 * Call body(first, last, thread) on ranges covering [begin, end), return
+	 * when all the calls are over.
+	 * Ranges start at begin plus a multiple of grain and are at most grain
+	 * long, except when the system has a single thread: body is then called
+	 * once on the whole range.
+	 * thread identifies the thread running the call, from 0 to get_threads() - 1;
+	 * the owner thread is thread 0. A thread runs a single call at a time,
+	 * unless body itself calls parallel_for.
+	 */
+	void parallel_for(size_t begin, size_t end, size_t grain, const body_t &body);
+
+private:
+	struct job
+	{
+		const body_t *body;
+		size_t first, last, grain;
+		// Indexes not processed yet in the parallel_for owning this job
+		std::atomic<size_t> *pending;
+	};
+
+	struct queue
+	{
+		std::mutex lock;
+		std::deque<job> jobs;
+	};
+
+	void worker(unsigned id);
+	void stop(void);
+	void push(unsigned id, const job &j);
+	bool pop(unsigned id, job &j);
+	bool steal(unsigned id, job &j);
+	void execute(unsigned id, job j);
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<queue>> queues;
+	// Jobs queued in any deque, idle workers sleep while it is zero
+	std::atomic<size_t> queued;
+	std::mutex sleeplock;
+	std::condition_variable wake;
+	bool quit;
+};
+
+#endif
@@ -35,6 +35,7 @@ public:
 	m3d_light_source() : color(), sintensity(0.0f) {};
 	virtual ~m3d_light_source() {};
 	m3d_light_source(const m3d_light_source &other) : color(other.color), sintensity(other.sintensity) {};
+	m3d_light_source &operator=(const m3d_light_source &other) = default;
 	m3d_light_source(const m3d_color &color, float src_intensity) : color(color), sintensity(src_intensity) {};
 
 	virtual float get_intensity(const m3d_point &objpos) = 0;
@@ -63,6 +64,7 @@ public:
 	virtual ~m3d_ambient_light() {};
 
 	m3d_ambient_light(const m3d_ambient_light &other) : m3d_light_source(other) {};
+	m3d_ambient_light &operator=(const m3d_ambient_light &other) = default;
 
 	m3d_ambient_light(const m3d_color &color,
 			  const float src_intensity) : m3d_light_source(color, src_intensity) {}
@@ -54,6 +54,12 @@
 #define Z_C (2)
 #define T_C (3)
 
+/*
+ * Size in bytes of a cache line, large buffers (framebuffers, vertex arrays)
+ * are aligned to this value.
+ */
+#define M3D_CACHE_LINE (64)
+
 struct m3d_input_point
 {
 #if defined(_MSC_VER)
@@ -22,10 +22,17 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <cstring>
 #include "m3d_math_data.hh"
 #include "m3d_math_axis.hh"
 #include "m3d_math_matrix.hh"
 
+#include "m3d_cpu.hh"
+
+#if defined(M3D_CPU_X86)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 #define INV_RAD ((float)M_PI / 180.0f)
@@ -218,6 +225,403 @@ void m3d_matrix::transform(m3d_vector &veca, m3d_vector &out)
 	out = temp;
 }
 
+/*
+ * Batch kernels for rotate_many() and transform_many(), one for every
+ * m3d_cpu level.
+ * Every output vector is the sum of the matrix columns scaled by the input
+ * components; the columns are loaded once and kept in registers for the whole
+ * batch. Products are summed in the same order as in rotate() and transform(),
+ * so results are bit-identical to the single vector versions.
+ * Rotations sum the first 3 columns only and copy T from the input vector.
+ */
+typedef void (*batch_t)(const float matrix[][m3d_vector_size],
+			const char *src,
+			char *dst,
+			size_t n,
+			size_t instride,
+			size_t outstride,
+			bool rotation);
+
+static void batch_scalar(const float matrix[][m3d_vector_size],
+			 const char *src,
+			 char *dst,
+			 size_t n,
+			 size_t instride,
+			 size_t outstride,
+			 bool rotation)
+{
+	float temp[m3d_vector_size];
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const float *v = (const float *)src;
+
+		for (unsigned j = 0; j < m3d_vector_size; j++)
+		{
+			temp[j] = v[X_C] * matrix[j][X_C] +
+				  v[Y_C] * matrix[j][Y_C] +
+				  v[Z_C] * matrix[j][Z_C];
+			if (!rotation)
+			{
+				temp[j] += v[T_C] * matrix[j][T_C];
+			}
+		}
+		if (rotation)
+		{
+			temp[T_C] = v[T_C];
+		}
+		memcpy(dst, temp, sizeof(temp));
+		src += instride;
+		dst += outstride;
+	}
+}
+
+/*
+ * Batch kernel for transform_soa(): transforms the vectors from i on, as many
+ * as the vector width allows, and returns the index of the first one left.
+ * tm holds the translation scaled by t, rows the number of outputs.
+ */
+typedef size_t (*soa_t)(const float matrix[][m3d_vector_size],
+			const float *tm,
+			unsigned rows,
+			float t,
+			const float *inx,
+			const float *iny,
+			const float *inz,
+			float *const *out,
+			size_t i,
+			size_t n);
+
+static size_t soa_scalar(const float matrix[][m3d_vector_size],
+			 const float *tm,
+			 unsigned rows,
+			 float t,
+			 const float *inx,
+			 const float *iny,
+			 const float *inz,
+			 float *const *out,
+			 size_t i,
+			 size_t n)
+{
+	for (; i < n; i++)
+	{
+		float x = inx[i], y = iny[i], z = inz[i];
+
+		for (unsigned j = 0; j < rows; j++)
+		{
+			float r = x * matrix[j][X_C] + y * matrix[j][Y_C] + z * matrix[j][Z_C];
+
+			out[j][i] = (t != 0.0f) ? r + tm[j] : r;
+		}
+	}
+	return i;
+}
+
+#if defined(M3D_CPU_X86)
+M3D_TARGET("sse4.1")
+static void batch_sse41(const float matrix[][m3d_vector_size],
+			const char *src,
+			char *dst,
+			size_t n,
+			size_t instride,
+			size_t outstride,
+			bool rotation)
+{
+	__m128 col0 = _mm_setr_ps(matrix[X_C][X_C], matrix[Y_C][X_C], matrix[Z_C][X_C], matrix[T_C][X_C]);
+	__m128 col1 = _mm_setr_ps(matrix[X_C][Y_C], matrix[Y_C][Y_C], matrix[Z_C][Y_C], matrix[T_C][Y_C]);
+	__m128 col2 = _mm_setr_ps(matrix[X_C][Z_C], matrix[Y_C][Z_C], matrix[Z_C][Z_C], matrix[T_C][Z_C]);
+	__m128 col3 = _mm_setr_ps(matrix[X_C][T_C], matrix[Y_C][T_C], matrix[Z_C][T_C], matrix[T_C][T_C]);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		__m128 v = _mm_load_ps((const float *)src);
+		__m128 r = _mm_mul_ps(_mm_shuffle_ps(v, v, 0x00), col0);
+
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0x55), col1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xAA), col2));
+		if (rotation)
+		{
+			// X, Y, Z from the result and T from the input vector
+			r = _mm_blend_ps(r, v, 0x08);
+		}
+		else
+		{
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xFF), col3));
+		}
+		_mm_store_ps((float *)dst, r);
+		src += instride;
+		dst += outstride;
+	}
+}
+
+M3D_TARGET("sse4.1")
+static size_t soa_sse41(const float matrix[][m3d_vector_size],
+			const float *tm,
+			unsigned rows,
+			float t,
+			const float *inx,
+			const float *iny,
+			const float *inz,
+			float *const *out,
+			size_t i,
+			size_t n)
+{
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(inx + i);
+		__m128 y = _mm_loadu_ps(iny + i);
+		__m128 z = _mm_loadu_ps(inz + i);
+		__m128 r[m3d_vector_size];
+
+		for (unsigned j = 0; j < rows; j++)
+		{
+			r[j] = _mm_mul_ps(x, _mm_set1_ps(matrix[j][X_C]));
+			r[j] = _mm_add_ps(r[j], _mm_mul_ps(y, _mm_set1_ps(matrix[j][Y_C])));
+			r[j] = _mm_add_ps(r[j], _mm_mul_ps(z, _mm_set1_ps(matrix[j][Z_C])));
+			if (t != 0.0f)
+			{
+				r[j] = _mm_add_ps(r[j], _mm_set1_ps(tm[j]));
+			}
+		}
+		// Inputs are consumed before storing, outputs can overwrite them
+		for (unsigned j = 0; j < rows; j++)
+		{
+			_mm_storeu_ps(out[j] + i, r[j]);
+		}
+	}
+	return i;
+}
+
+/*
+ * Two vectors per iteration, one for every 128 bits lane
+ */
+M3D_TARGET("avx2")
+static void batch_avx2(const float matrix[][m3d_vector_size],
+		       const char *src,
+		       char *dst,
+		       size_t n,
+		       size_t instride,
+		       size_t outstride,
+		       bool rotation)
+{
+	__m128 col0 = _mm_setr_ps(matrix[X_C][X_C], matrix[Y_C][X_C], matrix[Z_C][X_C], matrix[T_C][X_C]);
+	__m128 col1 = _mm_setr_ps(matrix[X_C][Y_C], matrix[Y_C][Y_C], matrix[Z_C][Y_C], matrix[T_C][Y_C]);
+	__m128 col2 = _mm_setr_ps(matrix[X_C][Z_C], matrix[Y_C][Z_C], matrix[Z_C][Z_C], matrix[T_C][Z_C]);
+	__m128 col3 = _mm_setr_ps(matrix[X_C][T_C], matrix[Y_C][T_C], matrix[Z_C][T_C], matrix[T_C][T_C]);
+	__m256 col0x2 = _mm256_set_m128(col0, col0);
+	__m256 col1x2 = _mm256_set_m128(col1, col1);
+	__m256 col2x2 = _mm256_set_m128(col2, col2);
+	__m256 col3x2 = _mm256_set_m128(col3, col3);
+	size_t i = 0;
+
+	for (; i + 2 <= n; i += 2)
+	{
+		__m256 v = _mm256_set_m128(_mm_load_ps((const float *)(src + instride)), _mm_load_ps((const float *)src));
+		__m256 r = _mm256_mul_ps(_mm256_permute_ps(v, 0x00), col0x2);
+
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(v, 0x55), col1x2));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(v, 0xAA), col2x2));
+		if (rotation)
+		{
+			r = _mm256_blend_ps(r, v, 0x88);
+		}
+		else
+		{
+			r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(v, 0xFF), col3x2));
+		}
+		_mm_store_ps((float *)dst, _mm256_castps256_ps128(r));
+		_mm_store_ps((float *)(dst + outstride), _mm256_extractf128_ps(r, 1));
+		src += 2 * instride;
+		dst += 2 * outstride;
+	}
+	batch_sse41(matrix, src, dst, n - i, instride, outstride, rotation);
+}
+
+M3D_TARGET("avx2")
+static size_t soa_avx2(const float matrix[][m3d_vector_size],
+		       const float *tm,
+		       unsigned rows,
+		       float t,
+		       const float *inx,
+		       const float *iny,
+		       const float *inz,
+		       float *const *out,
+		       size_t i,
+		       size_t n)
+{
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(inx + i);
+		__m256 y = _mm256_loadu_ps(iny + i);
+		__m256 z = _mm256_loadu_ps(inz + i);
+		__m256 r[m3d_vector_size];
+
+		for (unsigned j = 0; j < rows; j++)
+		{
+			r[j] = _mm256_mul_ps(x, _mm256_set1_ps(matrix[j][X_C]));
+			r[j] = _mm256_add_ps(r[j], _mm256_mul_ps(y, _mm256_set1_ps(matrix[j][Y_C])));
+			r[j] = _mm256_add_ps(r[j], _mm256_mul_ps(z, _mm256_set1_ps(matrix[j][Z_C])));
+			if (t != 0.0f)
+			{
+				r[j] = _mm256_add_ps(r[j], _mm256_set1_ps(tm[j]));
+			}
+		}
+		for (unsigned j = 0; j < rows; j++)
+		{
+			_mm256_storeu_ps(out[j] + i, r[j]);
+		}
+	}
+	return soa_sse41(matrix, tm, rows, t, inx, iny, inz, out, i, n);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+/*
+ * Four vectors per iteration, one for every 128 bits lane
+ */
+M3D_TARGET("avx512f")
+static void batch_avx512(const float matrix[][m3d_vector_size],
+			 const char *src,
+			 char *dst,
+			 size_t n,
+			 size_t instride,
+			 size_t outstride,
+			 bool rotation)
+{
+	__m512 col0 = _mm512_broadcast_f32x4(_mm_setr_ps(matrix[X_C][X_C], matrix[Y_C][X_C], matrix[Z_C][X_C], matrix[T_C][X_C]));
+	__m512 col1 = _mm512_broadcast_f32x4(_mm_setr_ps(matrix[X_C][Y_C], matrix[Y_C][Y_C], matrix[Z_C][Y_C], matrix[T_C][Y_C]));
+	__m512 col2 = _mm512_broadcast_f32x4(_mm_setr_ps(matrix[X_C][Z_C], matrix[Y_C][Z_C], matrix[Z_C][Z_C], matrix[T_C][Z_C]));
+	__m512 col3 = _mm512_broadcast_f32x4(_mm_setr_ps(matrix[X_C][T_C], matrix[Y_C][T_C], matrix[Z_C][T_C], matrix[T_C][T_C]));
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m512 v = _mm512_castps128_ps512(_mm_load_ps((const float *)src));
+		__m512 r;
+
+		v = _mm512_insertf32x4(v, _mm_load_ps((const float *)(src + instride)), 1);
+		v = _mm512_insertf32x4(v, _mm_load_ps((const float *)(src + 2 * instride)), 2);
+		v = _mm512_insertf32x4(v, _mm_load_ps((const float *)(src + 3 * instride)), 3);
+		r = _mm512_mul_ps(_mm512_permute_ps(v, 0x00), col0);
+		r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_permute_ps(v, 0x55), col1));
+		r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_permute_ps(v, 0xAA), col2));
+		if (rotation)
+		{
+			r = _mm512_mask_blend_ps(0x8888, r, v);
+		}
+		else
+		{
+			r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_permute_ps(v, 0xFF), col3));
+		}
+		_mm_store_ps((float *)dst, _mm512_castps512_ps128(r));
+		_mm_store_ps((float *)(dst + outstride), _mm512_extractf32x4_ps(r, 1));
+		_mm_store_ps((float *)(dst + 2 * outstride), _mm512_extractf32x4_ps(r, 2));
+		_mm_store_ps((float *)(dst + 3 * outstride), _mm512_extractf32x4_ps(r, 3));
+		src += 4 * instride;
+		dst += 4 * outstride;
+	}
+	batch_avx2(matrix, src, dst, n - i, instride, outstride, rotation);
+}
+
+M3D_TARGET("avx512f")
+static size_t soa_avx512(const float matrix[][m3d_vector_size],
+			 const float *tm,
+			 unsigned rows,
+			 float t,
+			 const float *inx,
+			 const float *iny,
+			 const float *inz,
+			 float *const *out,
+			 size_t i,
+			 size_t n)
+{
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512 x = _mm512_loadu_ps(inx + i);
+		__m512 y = _mm512_loadu_ps(iny + i);
+		__m512 z = _mm512_loadu_ps(inz + i);
+		__m512 r[m3d_vector_size];
+
+		for (unsigned j = 0; j < rows; j++)
+		{
+			r[j] = _mm512_mul_ps(x, _mm512_set1_ps(matrix[j][X_C]));
+			r[j] = _mm512_add_ps(r[j], _mm512_mul_ps(y, _mm512_set1_ps(matrix[j][Y_C])));
+			r[j] = _mm512_add_ps(r[j], _mm512_mul_ps(z, _mm512_set1_ps(matrix[j][Z_C])));
+			if (t != 0.0f)
+			{
+				r[j] = _mm512_add_ps(r[j], _mm512_set1_ps(tm[j]));
+			}
+		}
+		for (unsigned j = 0; j < rows; j++)
+		{
+			_mm512_storeu_ps(out[j] + i, r[j]);
+		}
+	}
+	return soa_avx2(matrix, tm, rows, t, inx, iny, inz, out, i, n);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static const batch_t batch_kernels[m3d_cpu::LEVEL_MAX] = {batch_scalar, batch_sse41, batch_avx2, batch_avx512};
+static const soa_t soa_kernels[m3d_cpu::LEVEL_MAX] = {soa_scalar, soa_sse41, soa_avx2, soa_avx512};
+#else
+static const batch_t batch_kernels[1] = {batch_scalar};
+static const soa_t soa_kernels[1] = {soa_scalar};
+#endif
+
+/*
+ * The kernels of the level in use, m3d_cpu::get_level() never exceeds the
+ * levels compiled in
+ */
+static inline unsigned kernel_level(void)
+{
+#if defined(M3D_CPU_X86)
+	return m3d_cpu::get_level();
+#else
+	return 0;
+#endif
+}
+
+void m3d_matrix::rotate_many(const m3d_vector *in, m3d_vector *out, size_t n, size_t instride, size_t outstride)
+{
+	batch_kernels[kernel_level()](mymatrix, reinterpret_cast<const char *>(in), reinterpret_cast<char *>(out), n, instride, outstride, true);
+}
+
+void m3d_matrix::transform_many(const m3d_vector *in, m3d_vector *out, size_t n, size_t instride, size_t outstride)
+{
+	batch_kernels[kernel_level()](mymatrix, reinterpret_cast<const char *>(in), reinterpret_cast<char *>(out), n, instride, outstride, false);
+}
+
+void m3d_matrix::transform_soa(const float *inx,
+			       const float *iny,
+			       const float *inz,
+			       float t,
+			       float *outx,
+			       float *outy,
+			       float *outz,
+			       float *outt,
+			       size_t n)
+{
+	float *out[m3d_vector_size] = {outx, outy, outz, outt};
+	unsigned rows = (outt) ? m3d_vector_size : m3d_vector_size - 1;
+	float tm[m3d_vector_size];
+	size_t i;
+
+	for (unsigned j = 0; j < m3d_vector_size; j++)
+	{
+		tm[j] = t * mymatrix[j][T_C];
+	}
+
+	i = soa_kernels[kernel_level()](mymatrix, tm, rows, t, inx, iny, inz, out, 0, n);
+	soa_scalar(mymatrix, tm, rows, t, inx, iny, inz, out, i, n);
+}
+
 void m3d_matrix::print()
 {
 #ifdef DEBUG
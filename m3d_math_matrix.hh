@@ -20,6 +20,8 @@
 #ifndef _M3D_MATH_MATRIX_HH_
 #define _M3D_MATH_MATRIX_HH_
 
+#include <cstddef>
+
 #include "m3d_math_vector.hh"
 
 /*
@@ -115,6 +117,44 @@ public:
          */
         void transform(m3d_vector &veca, m3d_vector &out);
 
+        /*
+         * batch versions of rotate() and transform(), applied to n vectors.
+         * Vectors are read from in and stored to out; instride and outstride
+         * are the distances in bytes between two consecutive vectors, so that
+         * vectors embedded in larger structures (i.e. m3d_vertex) can be
+         * processed without copies. in and out can overlap exactly.
+         * Results are the same as calling rotate() or transform() n times.
+         */
+        void rotate_many(const m3d_vector *in,
+                         m3d_vector *out,
+                         size_t n,
+                         size_t instride = sizeof(m3d_vector),
+                         size_t outstride = sizeof(m3d_vector));
+
+        void transform_many(const m3d_vector *in,
+                            m3d_vector *out,
+                            size_t n,
+                            size_t instride = sizeof(m3d_vector),
+                            size_t outstride = sizeof(m3d_vector));
+
+        /*
+         * batch transform() of n vectors stored as separate arrays of X, Y, Z
+         * components (structure of arrays). The T component is the same for
+         * all the vectors, 1.0f for points and 0.0f for vectors; with T equal
+         * to 0.0f the translation is skipped, as in rotate().
+         * The output T component is stored only if outt is not null.
+         * Input and output arrays can be the same.
+         */
+        void transform_soa(const float *inx,
+                           const float *iny,
+                           const float *inz,
+                           float t,
+                           float *outx,
+                           float *outy,
+                           float *outz,
+                           float *outt,
+                           size_t n);
+
         /*
          * stream to cout the matrix
          */
@@ -0,0 +1,196 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <errno.h>
+
+#include "m3d_mesh.hh"
+
+using namespace std;
+
+int m3d_mesh::create(const struct m3d_input_point *_vertices,
+		     const uint32_t vertnum,
+		     const struct m3d_input_trimesh *_mesh,
+		     const uint32_t meshnum)
+{
+	m3d_vector a, b;
+
+	if (!_vertices || !vertnum || !_mesh || !meshnum || !positions.empty())
+	{
+		return (EINVAL);
+	}
+
+	try
+	{
+		positions.resize(vertnum);
+		normals.resize(vertnum);
+		triangles.resize(meshnum);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return (ENOMEM);
+	}
+
+	for (auto &it : positions)
+	{
+		it = _vertices->vector;
+		_vertices++;
+	}
+
+	for (auto &it : triangles)
+	{
+		it.index[0] = _mesh->index[0];
+		it.index[1] = _mesh->index[1];
+		it.index[2] = _mesh->index[2];
+		if ((it.index[0] >= vertnum) || (it.index[1] >= vertnum) || (it.index[2] >= vertnum))
+		{
+			return (EINVAL);
+		}
+		_mesh++;
+	}
+
+	/*
+	 * Set vertices normals by summing triangles' normals to every
+	 * vertices.
+	 * Triangles' normals are orthogonal to the surface, Vertices' normals
+	 * are the normalized sum of surfaces' normals.
+	 * Surfaces' normals are normalized after building the vertices' normals,
+	 * so that the area of a surface weights the normals of the vertices
+	 * composing the surface.
+	 */
+	for (auto &it : triangles)
+	{
+		/*
+		 * compute surface's normal.
+		 * vertices will be used this way:
+		 *    0 -> 1   vector 1
+		 *    0 -> 2   vector 2
+		 *
+		 * normal is vector1 X vector2
+		 */
+		a = positions[it.index[1]];
+		a.subtract(positions[it.index[0]]);
+		b = positions[it.index[2]];
+		b.subtract(positions[it.index[0]]);
+		a.cross_product(b);
+
+		/*
+		 * Add surface normal to vertices' normals
+		 */
+		normals[it.index[0]].add(a);
+		normals[it.index[1]].add(a);
+		normals[it.index[2]].add(a);
+
+		a.normalize();
+		it.normal = a;
+	}
+
+	// Normalize
+	for (auto &it : normals)
+	{
+		it.normalize();
+	}
+
+	try
+	{
+		px.resize(vertnum);
+		py.resize(vertnum);
+		pz.resize(vertnum);
+		nx.resize(vertnum);
+		ny.resize(vertnum);
+		nz.resize(vertnum);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return (ENOMEM);
+	}
+
+	for (uint32_t i = 0; i < vertnum; i++)
+	{
+		px[i] = positions[i][X_C];
+		py[i] = positions[i][Y_C];
+		pz[i] = positions[i][Z_C];
+		nx[i] = normals[i][X_C];
+		ny[i] = normals[i][Y_C];
+		nz[i] = normals[i][Z_C];
+	}
+
+	// Compute the bounding box, and the bounding sphere around the box center
+	bbmin = positions[0];
+	bbmax = positions[0];
+	for (auto &it : positions)
+	{
+		for (unsigned i = X_C; i <= Z_C; i++)
+		{
+			bbmin[i] = (it[i] < bbmin[i]) ? it[i] : bbmin[i];
+			bbmax[i] = (it[i] > bbmax[i]) ? it[i] : bbmax[i];
+		}
+	}
+
+	m3d_point bbcenter((bbmin[X_C] + bbmax[X_C]) / 2.0f, (bbmin[Y_C] + bbmax[Y_C]) / 2.0f, (bbmin[Z_C] + bbmax[Z_C]) / 2.0f);
+
+	for (auto &it : positions)
+	{
+		m3d_vector d(it);
+
+		d.subtract(bbcenter);
+		float r = d.module();
+		bradius = (r > bradius) ? r : bradius;
+	}
+
+	// Compute the center
+	float part = 1.0f / (float)positions.size();
+
+	for (auto &it : positions)
+	{
+		center.add(it);
+	}
+
+	center.scale(part);
+	center.myvector[T_C] = 1.0f;
+
+	return (0);
+}
+
+shared_ptr<const m3d_mesh> m3d_mesh::make(const struct m3d_input_point *_vertices,
+					  const uint32_t vertnum,
+					  const struct m3d_input_trimesh *_mesh,
+					  const uint32_t meshnum)
+{
+	shared_ptr<m3d_mesh> mesh;
+
+	try
+	{
+		mesh = make_shared<m3d_mesh>();
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return (nullptr);
+	}
+
+	if (mesh->create(_vertices, vertnum, _mesh, meshnum))
+	{
+		return (nullptr);
+	}
+
+	return (mesh);
+}
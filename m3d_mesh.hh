@@ -0,0 +1,136 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_MESH_H
+#define M3D_MESH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "m3d_math.hh"
+
+/*
+ * This data structure is used to create a mesh of points,
+ * describing triangles, composing a surface (object).
+ * Index values refers to m3d_point data stored in an
+ * array.
+ *
+ * Example:
+ *
+ *  m3d_point triangle_array[] = {{1,2,3,1},    --> Point 0
+ *                                {4,5,6,1},    --> Point 1
+ *                                {7,6,9,1}};   --> Point 2
+ *
+ *  m3d_input_trimesh triangle_triangle = {{0,1,2}};
+ */
+struct m3d_input_trimesh
+{
+	uint32_t index[3];
+};
+
+class m3d_triangle
+{
+public:
+	m3d_triangle() : normal()
+	{
+		index[0] = index[1] = index[2] = 0;
+	}
+
+	m3d_triangle(const m3d_triangle &other) : normal(other.normal)
+	{
+		index[0] = other.index[0];
+		index[1] = other.index[1];
+		index[2] = other.index[2];
+	}
+
+	~m3d_triangle() {};
+
+	/*
+	 * Indexes inside a mesh of the 3 vertexes composing the triangle
+	 */
+	uint32_t index[3];
+	/*
+	 * The normal to the triangle surface in object coordinates
+	 */
+	m3d_vector normal;
+};
+
+/*
+ * Immutable geometry of an object: vertex positions and normals in object
+ * coordinates, and the triangles connecting the vertices.
+ * A mesh is built once and shared by reference counting among all the objects
+ * using it (instances); every object adds its own transformation, color and
+ * per-frame data.
+ */
+class m3d_mesh
+{
+public:
+	m3d_mesh() : positions(), normals(), triangles(), center(), bbmin(), bbmax(), bradius(0.0f) {};
+	~m3d_mesh() {};
+
+	/*
+	 * Set vertices, build the triangles and compute the normals to triangles
+	 * and vertices, the mesh center and the bounding volumes.
+	 * Return EINVAL if the input is empty or inconsistent, ENOMEM if out of memory.
+	 */
+	int create(const struct m3d_input_point *_vertices,
+		   const uint32_t vertnum,
+		   const struct m3d_input_trimesh *_mesh,
+		   const uint32_t meshnum);
+
+	/*
+	 * Allocate a mesh and create it, return nullptr on failure
+	 */
+	static std::shared_ptr<const m3d_mesh> make(const struct m3d_input_point *_vertices,
+						    const uint32_t vertnum,
+						    const struct m3d_input_trimesh *_mesh,
+						    const uint32_t meshnum);
+
+	size_t vertex_count(void) const { return positions.size(); }
+	size_t triangle_count(void) const { return triangles.size(); }
+
+	/*
+	 * Vertex positions and normalized vertex normals, in object coordinates
+	 */
+	std::vector<m3d_point> positions;
+	std::vector<m3d_vector> normals;
+	/*
+	 * Vertex positions and normals as arrays of components, used by the
+	 * structure of arrays vertex layout
+	 */
+	std::vector<float> px, py, pz;
+	std::vector<float> nx, ny, nz;
+	/*
+	 * Triangles and their normals
+	 */
+	std::vector<m3d_triangle> triangles;
+	/*
+	 * Average of the vertex positions
+	 */
+	m3d_point center;
+	/*
+	 * Bounding volumes in object coordinates: the axis aligned bounding box,
+	 * and the radius of the bounding sphere centered in the box
+	 */
+	m3d_point bbmin, bbmax;
+	float bradius;
+};
+
+#endif // M3D_MESH_H
@@ -18,6 +18,7 @@
  */
 
 #include <stddef.h>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <cmath>
@@ -25,18 +26,11 @@
 
 #include "m3d_object.hh"
 #include "m3d_illum.hh"
+#include "m3d_profiler.hh"
+#include "m3d_jobs.hh"
 
 using namespace std;
 
-/********************************/
-/****** class m3d_triangle ******/
-/********************************/
-
-void m3d_triangle::project(m3d_camera &camera)
-{
-	camera.projection(normal, prjnormal);
-}
-
 /******************************/
 /****** class m3d_object ******/
 /******************************/
@@ -46,59 +40,78 @@ int m3d_object::create(struct m3d_input_point *_vertices,
 		       struct m3d_input_trimesh *_mesh,
 		       const uint32_t meshnum)
 {
-	m3d_vector a, b;
+	shared_ptr<const m3d_mesh> newmesh = m3d_mesh::make(_vertices, vertnum, _mesh, meshnum);
 
-	if (_vertices && vertnum && (vertnum < M3D_MAX_VERTICES) && vertices.empty())
+	if (!newmesh)
 	{
-		try
-		{
-			vertices.resize(vertnum);
-		}
-		catch (const bad_alloc &e)
-		{
-			cerr << "Out of memory " << e.what() << endl;
-			return (ENOMEM);
-		}
-		for (auto &it : vertices)
-		{
-			it.position = _vertices->vector;
-			_vertices++;
-		}
+		return (EINVAL);
 	}
-	else
+
+	return create(newmesh);
+}
+
+int m3d_object::create(const shared_ptr<const m3d_mesh> &_mesh)
+{
+	if (!_mesh || mesh)
 	{
 		return (EINVAL);
 	}
 
-	if (_mesh && meshnum && (meshnum < M3D_MAX_TRIANGLES) && mesh.empty())
+	try
 	{
-		try
-		{
-			mesh.resize(meshnum);
-		}
-		catch (const bad_alloc &e)
+		vertices.resize(_mesh->vertex_count());
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return (ENOMEM);
+	}
+
+	mesh = _mesh;
+	center = mesh->center;
+	// DIRECTION
+
+	return (0);
+}
+
+int m3d_object::set_vertex_layout(unsigned newlayout)
+{
+	int retcode = 0;
+
+	if (((newlayout != VERTEX_AOS) && (newlayout != VERTEX_SOA)) || !mesh)
+	{
+		return (EINVAL);
+	}
+
+	try
+	{
+		if (newlayout == VERTEX_SOA)
 		{
-			cerr << "Out of memory " << e.what() << endl;
-			return (ENOMEM);
+			retcode = soavertices.create(mesh->vertex_count());
+			if (retcode == 0)
+			{
+				vector<m3d_vertex>().swap(vertices);
+			}
 		}
-
-		for (auto &it : mesh)
+		else
 		{
-			it.index[0] = _mesh->index[0];
-			it.index[1] = _mesh->index[1];
-			it.index[2] = _mesh->index[2];
-			_mesh++;
+			vertices.resize(mesh->vertex_count());
+			soavertices.release();
 		}
 	}
-	else
+	catch (const bad_alloc &e)
 	{
-		return (EINVAL);
+		cerr << "Out of memory " << e.what() << endl;
+		return (ENOMEM);
 	}
 
-	compute_center();
-	// DIRECTION
+	if (retcode == 0)
+	{
+		layout = newlayout;
+		uptodate = false;
+	}
 
-	return (0);
+	return (retcode);
 }
 
 // Z
@@ -150,7 +163,7 @@ void m3d_object::print()
 	}
 	cout << "  Triangle Mesh" << endl;
 	i = 0;
-	for (auto &it : mesh)
+	for (auto &it : mesh->triangles)
 	{
 		tmp << "(" << it.index[0] << "," << it.index[1] << "," << it.index[2] << ") ,";
 		tmp << "  Normal ---> ";
@@ -167,37 +180,29 @@ void m3d_object::print()
 #endif
 }
 
-void m3d_object::compute_center()
-{
-	float part = 1.0f / (float)vertices.size();
-
-	for (auto &it : vertices)
-	{
-		center.add(it.position);
-	}
-
-	center.scale(part);
-	center.myvector[T_C] = 1.0f;
-}
-
 void m3d_object::update_object()
 {
 	if (uptodate == false)
 	{
 		m3d_matrix_transform t(pitchangle, yawangle, rollangle, center);
 
-		for (auto &it : vertices)
-		{
-			// m3d_point truepos = center + it.position;
-			t.transform(it.position, it.tposition);
-			t.rotate(it.normal, it.tnormal);
-		}
+		objtransform = t;
+		vtxuptodate = false;
+
+		/* update bounding volumes */
+		m3d_point bbcenter((mesh->bbmin[X_C] + mesh->bbmax[X_C]) / 2.0f,
+				   (mesh->bbmin[Y_C] + mesh->bbmax[Y_C]) / 2.0f,
+				   (mesh->bbmin[Z_C] + mesh->bbmax[Z_C]) / 2.0f);
 
-		/* update triangle surfaces' normals */
-		for (auto &it : mesh)
+		t.transform(bbcenter, tbcenter);
+		for (unsigned i = X_C; i <= Z_C; i++)
 		{
-			t.rotate(it.normal, it.tnormal);
+			m3d_vector halfside;
+
+			halfside[i] = (mesh->bbmax[i] - mesh->bbmin[i]) / 2.0f;
+			t.rotate(halfside, tbhalfsides[i]);
 		}
+
 		/* update object's direction */
 
 		/* MISSING */
@@ -205,6 +210,25 @@ void m3d_object::update_object()
 	}
 }
 
+void m3d_object::transform_vertices(size_t first, size_t n)
+{
+	if (layout == VERTEX_SOA)
+	{
+		m3d_vertex_soa &v = soavertices;
+
+		objtransform.transform_soa(&mesh->px[first], &mesh->py[first], &mesh->pz[first], 1.0f,
+					   v.tposition.x + first, v.tposition.y + first, v.tposition.z + first, nullptr, n);
+		objtransform.transform_soa(&mesh->nx[first], &mesh->ny[first], &mesh->nz[first], 0.0f,
+					   v.tnormal.x + first, v.tnormal.y + first, v.tnormal.z + first, nullptr, n);
+	}
+	else
+	{
+		// m3d_point truepos = center + position;
+		objtransform.transform_many(&mesh->positions[first], &vertices[first].tposition, n, sizeof(m3d_point), sizeof(m3d_vertex));
+		objtransform.rotate_many(&mesh->normals[first], &vertices[first].tnormal, n, sizeof(m3d_vector), sizeof(m3d_vertex));
+	}
+}
+
 /*************************************/
 /****** class m3d_render_object ******/
 /*************************************/
@@ -214,83 +238,177 @@ int m3d_render_object::create(struct m3d_input_point *_vertices,
 			      struct m3d_input_trimesh *_mesh,
 			      const uint32_t meshnum,
 			      m3d_color &_color)
+{
+	shared_ptr<const m3d_mesh> newmesh = m3d_mesh::make(_vertices, vertnum, _mesh, meshnum);
+
+	if (!newmesh)
+	{
+		return (EINVAL);
+	}
+
+	return create(newmesh, _color);
+}
+
+int m3d_render_object::create(const shared_ptr<const m3d_mesh> &_mesh, m3d_color &_color)
 {
 	int retcode;
-	m3d_vector a, b;
 
-	retcode = m3d_object::create(_vertices, vertnum, _mesh, meshnum);
+	retcode = m3d_object::create(_mesh);
 
 	if (retcode)
 	{
 		return (retcode);
 	}
 
-	/*
-	 * Set vertices normals by summing triangles' normals to every
-	 * vertices.
-	 * Triangles' normals are orthogonal to the surface, Vertices' normals
-	 * are the normalized sum of surfaces' normals.
-	 * Surfaces' normals are normalized after building the vertices' normals,
-	 * so that the area of a surface weights the normals of the vertices
-	 * composing the surface.
-	 */
-	for (auto &it : mesh)
+	try
 	{
-		/*
-		 * compute surface's normal.
-		 * vertices will be used this way:
-		 *    0 -> 1   vector 1
-		 *    0 -> 2   vector 2
-		 *
-		 * normal is vector1 X vector2
-		 */
-		a = vertices.at(it.index[1]).position;
-		a.subtract(vertices.at(it.index[0]).position);
-		b = vertices.at(it.index[2]).position;
-		b.subtract(vertices.at(it.index[0]).position);
-		a.cross_product(b);
-
-		/*
-		 * Add surface normal to vertices' normals
-		 */
-		vertices.at(it.index[0]).normal.add(a);
-		vertices.at(it.index[1]).normal.add(a);
-		vertices.at(it.index[2]).normal.add(a);
-
-		a.normalize();
-		it.normal = a;
+		vistriangles.reserve(mesh->triangle_count());
+		vtxvisible.resize(mesh->vertex_count());
+		vtxcolors.resize(mesh->vertex_count());
 	}
-
-	// Normalize
-	for (auto &it : vertices)
+	catch (const bad_alloc &e)
 	{
-		it.normal.normalize();
-		it.normal.print();
+		cerr << "Out of memory " << e.what() << endl;
+		return (ENOMEM);
 	}
 
 	color = _color;
 	return (0);
 };
 
-void m3d_render_object::project(m3d_camera &camera)
+bool m3d_render_object::in_frustum(m3d_camera &camera)
+{
+	update_object();
+
+	return camera.sphere_in_frustum(tbcenter, mesh->bradius) && camera.box_in_frustum(tbcenter, tbhalfsides);
+}
+
+/*
+ * Vertices transformed and projected by a job. A multiple of 16, so that the
+ * batch kernels split every range in the same SIMD blocks whatever the number
+ * of threads: results do not depend on it.
+ */
+static const size_t project_grain = 1024;
+
+unsigned m3d_render_object::project(m3d_camera &camera, unsigned culling, m3d_jobs *jobs)
 {
 	m3d_point temp;
+	bool transform;
+
+	M3D_PROFILE_SCOPE(STAGE_PROJECT);
 
 	update_object();
 
-	for (auto &it : vertices)
+	vistriangles.clear();
+	fill(vtxvisible.begin(), vtxvisible.end(), false);
+
+	if (culling == CULL_OBJECT)
 	{
-		camera.projection_to_screen(it.tposition, it.prjposition, it.scrposition);
+		cull_object(camera);
+
+		/*
+		 * Transform and project the visible vertices, consecutive vertices
+		 * are processed as a single batch, split in project_grain blocks.
+		 * The other vertices are left stale, so the next frame needs to
+		 * transform them again.
+		 */
+		size_t n = mesh->vertex_count();
+		size_t i = 0;
+
+		vtxruns.clear();
+		while (i < n)
+		{
+			if (!vtxvisible[i])
+			{
+				i++;
+				continue;
+			}
+
+			size_t first = i;
+
+			while ((i < n) && vtxvisible[i] && (i - first < project_grain))
+			{
+				i++;
+			}
+			vtxruns.emplace_back(first, i - first);
+		}
+
+		if (jobs && (vtxruns.size() > 1))
+		{
+			jobs->parallel_for(0, vtxruns.size(), 1, [&](size_t first, size_t last, unsigned)
+					   {
+						   for (size_t r = first; r < last; r++)
+							   transform_and_project(camera, vtxruns[r].first, vtxruns[r].second, true);
+					   });
+		}
+		else
+		{
+			for (auto &it : vtxruns)
+			{
+				transform_and_project(camera, it.first, it.second, true);
+			}
+		}
+		vtxuptodate = false;
+	}
+	else
+	{
+		size_t n = mesh->vertex_count();
+
+		transform = !vtxuptodate;
+		if (jobs && (n > project_grain))
+		{
+			jobs->parallel_for(0, n, project_grain, [&](size_t first, size_t last, unsigned)
+					   { transform_and_project(camera, first, last - first, transform); });
+		}
+		else
+		{
+			transform_and_project(camera, 0, n, transform);
+		}
+		vtxuptodate = true;
+		cull_screen();
+	}
+
+	camera.projection(center, temp);
+	z_sorting = temp.myvector[Z_C];
+
+	return (unsigned)vistriangles.size();
+}
+
+void m3d_render_object::transform_and_project(m3d_camera &camera, size_t first, size_t n, bool transform)
+{
+	if (transform)
+	{
+		transform_vertices(first, n);
+	}
+	project_vertices(camera, first, n);
+}
+
+void m3d_render_object::project_vertices(m3d_camera &camera, size_t first, size_t n)
+{
+	if (layout == VERTEX_SOA)
+	{
+		/*
+		 * The vertex normals in camera coordinates (prjnormal) are not used
+		 * by the renderers, the SoA layout does not compute them.
+		 */
+		camera.projection_to_screen(soavertices, first, n);
+	}
+	else
+	{
+		camera.projection_to_screen(&vertices[first], n);
 		// FIXME you sure? Not homogeneous?
-		camera.to_camera(it.tnormal, it.prjnormal);
+		camera.to_camera(&vertices[first].tnormal, &vertices[first].prjnormal, n, sizeof(m3d_vertex), sizeof(m3d_vertex));
 	}
+}
 
-	unsigned i = 0;
+void m3d_render_object::cull_screen()
+{
+	uint32_t i = 0;
 	int xa, ya, xb, yb;
-	vtxvisible.reset();
-	for (auto &it : mesh)
+	m3d_display_point s0, s1, s2;
+
+	for (auto &it : mesh->triangles)
 	{
-		camera.projection(it.tnormal, it.prjnormal);
 		/*
 		 * Compute the integer vectors as in create() but using the projected
 		 * discrete coordinates.
@@ -299,22 +417,65 @@ void m3d_render_object::project(m3d_camera &camera)
 		 * The result use homogeneus coordinates, so positive Z means the surface
 		 * is facing away from us, i.e. it is invisible.
 		 */
-		xa = vertices.at(it.index[1]).scrposition.x - vertices.at(it.index[0]).scrposition.x;
-		ya = vertices.at(it.index[1]).scrposition.y - vertices.at(it.index[0]).scrposition.y;
-		xb = vertices.at(it.index[2]).scrposition.x - vertices.at(it.index[0]).scrposition.x;
-		yb = vertices.at(it.index[2]).scrposition.y - vertices.at(it.index[0]).scrposition.y;
-
-		trivisible[i] = (xa * yb - ya * xb > 0) ? false : true;
-		if (trivisible[i++])
+		s0 = get_scrposition(it.index[0]);
+		s1 = get_scrposition(it.index[1]);
+		s2 = get_scrposition(it.index[2]);
+		xa = s1.x - s0.x;
+		ya = s1.y - s0.y;
+		xb = s2.x - s0.x;
+		yb = s2.y - s0.y;
+
+		if (xa * yb - ya * xb <= 0)
 		{
+			vistriangles.push_back(i);
 			vtxvisible[it.index[0]] = true;
 			vtxvisible[it.index[1]] = true;
 			vtxvisible[it.index[2]] = true;
 		}
+		i++;
+	}
+}
+
+void m3d_render_object::cull_object(m3d_camera &camera)
+{
+	uint32_t i = 0;
+	m3d_point campos;
+	m3d_vector eye;
+
+	/*
+	 * objtransform is a rotation followed by a translation to center:
+	 * its inverse translates back by center, then applies the transposed
+	 * rotation.
+	 */
+	camera.get_position(campos);
+	campos.subtract(center);
+	for (unsigned j = X_C; j <= Z_C; j++)
+	{
+		eye.myvector[j] = campos.myvector[X_C] * objtransform.mymatrix[X_C][j] +
+				  campos.myvector[Y_C] * objtransform.mymatrix[Y_C][j] +
+				  campos.myvector[Z_C] * objtransform.mymatrix[Z_C][j];
 	}
 
-	camera.projection(center, temp);
-	z_sorting = temp.myvector[Z_C];
+	for (auto &it : mesh->triangles)
+	{
+		/*
+		 * The triangle is facing us when the camera lies in the half space
+		 * the normal points to; degenerate triangles are invisible.
+		 */
+		const m3d_point &p = mesh->positions[it.index[0]];
+		float d = (eye.myvector[X_C] - p.myvector[X_C]) * it.normal.myvector[X_C] +
+			  (eye.myvector[Y_C] - p.myvector[Y_C]) * it.normal.myvector[Y_C] +
+			  (eye.myvector[Z_C] - p.myvector[Z_C]) * it.normal.myvector[Z_C];
+
+		if (d > 0.0f)
+		{
+			vistriangles.push_back(i);
+			vtxvisible[it.index[0]] = true;
+			vtxvisible[it.index[1]] = true;
+			vtxvisible[it.index[2]] = true;
+		}
+		i++;
+	}
 }
 
 void m3d_render_object::print()
@@ -322,6 +483,7 @@ void m3d_render_object::print()
 #ifdef DEBUG
 	ostringstream tmp;
 	unsigned i;
+	auto vis = vistriangles.begin();
 
 	cout << "* Render Object" << endl;
 	i = 0;
@@ -331,13 +493,15 @@ void m3d_render_object::print()
 	}
 	cout << "  Triangle Mesh" << endl;
 	i = 0;
-	for (auto &it : mesh)
+	for (auto &it : mesh->triangles)
 	{
 		tmp << "(" << it.index[0] << "," << it.index[1] << "," << it.index[2] << ") ,";
-		if (trivisible[i++])
+		if ((vis != vistriangles.end()) && (*vis == i))
 		{
 			tmp << " V,";
+			vis++;
 		}
+		i++;
 		tmp << " Normal ---> ";
 		cout << tmp.str();
 		tmp.str("");
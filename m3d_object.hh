@@ -21,81 +21,42 @@
 #define M3D_OBJECT_H
 
 #include <vector>
-#include <bitset>
+#include <memory>
+#include <utility>
 
+#include "m3d_mesh.hh"
 #include "m3d_vertex.hh"
+#include "m3d_vertex_soa.hh"
 #include "m3d_color.hh"
+#include "m3d_render_color.hh"
 #include "m3d_camera.hh"
 
-#define M3D_MAX_VERTICES (10240)
-#define M3D_MAX_TRIANGLES (10240)
+class m3d_jobs;
 
-/*
- * This data structure is used to create a mesh of points,
- * describing triangles, composing a surface (object).
- * Index values refers to m3d_point data stored in an
- * array.
- *
- * Example:
- *
- *  m3d_point triangle_array[] = {{1,2,3,1},    --> Point 0
- *                                {4,5,6,1},    --> Point 1
- *                                {7,6,9,1}};   --> Point 2
- *
- *  m3d_input_trimesh triangle_triangle = {{0,1,2}};
- */
-struct m3d_input_trimesh
-{
-	uint32_t index[3];
-};
-
-class m3d_triangle
+class m3d_object
 {
 public:
-	m3d_triangle() : normal()
-	{
-		index[0] = index[1] = index[2] = 0;
-	}
-
-	m3d_triangle(const m3d_triangle &other) : normal(other.normal)
-	{
-		index[0] = other.index[0];
-		index[1] = other.index[1];
-		index[2] = other.index[2];
-	}
-
-	~m3d_triangle() {};
-
-	/*
-	 * Apply a rotation to the normal
-	 */
-	void project(m3d_camera &camera);
-
-	/*
-	 * Indexes inside a mesh of the 3 vertexes composing the triangle
-	 */
-	uint32_t index[3];
-	/*
-	 * The normal to the triangle surface in world coordinates
-	 */
-	m3d_vector normal;
 	/*
-	 * The normal to the triangle surface in world coordinates, transformed
+	 * Vertex storage layouts.
+	 * VERTEX_AOS keeps all the attributes of a vertex together in vertices.
+	 * VERTEX_SOA keeps the transformed and projected attributes as separate
+	 * arrays in soavertices, vertices is left empty.
 	 */
-	m3d_vector tnormal;
-	/*
-	 * The normal to the triangle surface in projected homogeneous coordinates
-	 */
-	m3d_vector prjnormal;
-};
+	enum
+	{
+		VERTEX_AOS,
+		VERTEX_SOA
+	};
 
-class m3d_object
-{
-public:
 	m3d_object() : vertices(),
 		       mesh(),
 		       direction(),
 		       center(),
+		       layout(VERTEX_AOS),
+		       vtxuptodate(false),
+		       pitchangle(0.0f),
+		       yawangle(0.0f),
+		       rollangle(0.0f),
 		       uptodate(false) {};
 
 	~m3d_object() {};
@@ -104,22 +65,38 @@ public:
 					      mesh(other.mesh),
 					      direction(other.direction),
 					      center(other.center),
+					      soavertices(other.soavertices),
+					      layout(other.layout),
+					      vtxuptodate(false),
 					      pitchangle(0.0f),
 					      yawangle(0.0f),
 					      rollangle(0.0f),
 					      uptodate(false) {};
 
 	/*
-	 * Set vertices, vertices normals, build the triangles mesh
-	 * and the normals to triangles.
-	 * Update the center, the direction, and finally set up the
-	 * transformation matrix.
+	 * Build a mesh private to this object out of the input vertices and
+	 * triangles, then create the object as an instance of the mesh.
 	 */
 	int create(struct m3d_input_point *_vertices,
 		   const uint32_t vertnum,
 		   struct m3d_input_trimesh *mesh,
 		   const uint32_t meshnum);
 
+	/*
+	 * Create the object as an instance of a shared mesh.
+	 * The center is set to the mesh center, the per-frame vertex data is allocated.
+	 */
+	int create(const std::shared_ptr<const m3d_mesh> &_mesh);
+
+	/*
+	 * Select the vertex storage layout, VERTEX_AOS or VERTEX_SOA.
+	 * Return EINVAL if the layout is unknown or the object has no vertices,
+	 * ENOMEM if out of memory.
+	 */
+	int set_vertex_layout(unsigned newlayout);
+
+	unsigned get_vertex_layout(void) const { return layout; }
+
 	/*
 	 * perform rolling of the object, rotating around z angle in degrees
 	 */
@@ -153,15 +130,14 @@ public:
 	void print(void);
 
 	/*
-	 * Vertices refer to the object center in [0,0,0] when built.
-	 * Vertices stores vectors to vertices and their normals
-	 * in both world and projected coordinates.
+	 * Vertices stores the positions and normals of the mesh vertices
+	 * in both world and projected coordinates, for this instance.
 	 */
 	std::vector<m3d_vertex> vertices;
 	/*
-	 * mesh stores triangles and their normals
+	 * The shared mesh: vertices in object coordinates, triangles and normals
 	 */
-	std::vector<m3d_triangle> mesh;
+	std::shared_ptr<const m3d_mesh> mesh;
 	/*
 	 * Object direction, used for orientation and texturing
 	 */
@@ -174,16 +150,42 @@ public:
 	 * center in world coordinates, transformed
 	 */
 	m3d_point tcenter;
+	/*
+	 * Bounding volumes in world coordinates, updated with the transformation.
+	 * The oriented bounding box is given by its center and three half sides;
+	 * the bounding sphere has the same center and the radius of the mesh one.
+	 */
+	m3d_point tbcenter;
+	m3d_vector tbhalfsides[3];
+	/*
+	 * Vertices as a structure of arrays, used with the VERTEX_SOA layout
+	 */
+	m3d_vertex_soa soavertices;
 
 protected:
+	/*
+	 * Update the transformation and the bounding volumes.
+	 * Vertices are not transformed, see transform_vertices().
+	 */
 	void update_object(void);
 
-private:
 	/*
-	 * Compute the object center
+	 * Transform positions and normals of the n vertices starting at first
+	 * to world coordinates.
+	 */
+	void transform_vertices(size_t first, size_t n);
+
+	unsigned layout;
+	/*
+	 * Object coordinates to world coordinates
+	 */
+	m3d_matrix objtransform;
+	/*
+	 * All the vertices are transformed with objtransform
 	 */
-	void compute_center(void);
+	bool vtxuptodate;
 
+private:
 	float pitchangle, yawangle, rollangle;
 	/*
 	 * The object need or need not an update for its transformation
@@ -200,11 +202,31 @@ public:
 		OBJ_CHANGED = 1 << 7
 	};
 
+	/*
+	 * Back face culling modes.
+	 * CULL_SCREEN transforms and projects all the vertices, then tests the
+	 * winding of every triangle in screen coordinates.
+	 * CULL_OBJECT moves the camera position to object coordinates and tests
+	 * every triangle normal against it, then transforms and projects only the
+	 * vertices of the visible triangles.
+	 */
+	enum
+	{
+		CULL_SCREEN,
+		CULL_OBJECT
+	};
+
 	m3d_render_object() : m3d_object(), z_sorting(0.0f), color(), flags(0) {};
 
 	~m3d_render_object() {};
 
-	m3d_render_object(const m3d_render_object &other) : m3d_object(other), z_sorting(0.0f), color(other.color), flags(0) {};
+	m3d_render_object(const m3d_render_object &other) : m3d_object(other),
+							    z_sorting(0.0f),
+							    vistriangles(other.vistriangles),
+							    vtxvisible(other.vtxvisible),
+							    vtxcolors(other.vtxcolors),
+							    color(other.color),
+							    flags(0) {};
 
 	/*
 	 * Call object create method, setup object color.
@@ -215,12 +237,51 @@ public:
 		   const uint32_t meshnum,
 		   m3d_color &_color);
 
+	int create(const std::shared_ptr<const m3d_mesh> &_mesh, m3d_color &_color);
+
 	/*
 	 * Perform projection to camera by applying a tranformation
-	 * to all vertices and normals.
+	 * to the vertices and normals, and find the visible triangles
+	 * with the culling mode.
 	 * The transformation is stored in transform matrix in object class.
+	 * If jobs is not null, vertices are transformed and projected in parallel
+	 * by its threads; triangles are culled by the calling thread.
+	 * Return the number of visible triangles.
+	 */
+	unsigned project(m3d_camera &camera, unsigned culling = CULL_SCREEN, m3d_jobs *jobs = nullptr);
+
+	/*
+	 * Update the transformation and test the bounding volumes against the view
+	 * frustum. Return false if the object is completely outside the frustum.
 	 */
-	void project(m3d_camera &camera);
+	bool in_frustum(m3d_camera &camera);
+
+	/*
+	 * Return vertex index, transformed and projected.
+	 * With the VERTEX_SOA layout the attributes are gathered into scratch,
+	 * and the address of scratch is returned.
+	 */
+	m3d_vertex *get_vertex(uint32_t index, m3d_vertex &scratch)
+	{
+		if (layout == VERTEX_SOA)
+		{
+			soavertices.gather(index, scratch);
+			return &scratch;
+		}
+		return &vertices[index];
+	}
+
+	/*
+	 * Return the screen coordinates of vertex index
+	 */
+	m3d_display_point get_scrposition(uint32_t index) const
+	{
+		if (layout == VERTEX_SOA)
+		{
+			return {soavertices.scrx[index], soavertices.scry[index]};
+		}
+		return vertices[index].scrposition;
+	}
 
 	/*
 	 * Dump debug data
@@ -233,13 +294,19 @@ public:
 	 */
 	float z_sorting;
 	/*
-	 * Visible triangles as a bitset
+	 * Indexes inside the mesh of the visible triangles, in mesh order.
+	 * Storage is reserved by create() for the whole mesh.
+	 */
+	std::vector<uint32_t> vistriangles;
+	/*
+	 * Visible vertices as a bitset, one bit per vertex
 	 */
-	std::bitset<M3D_MAX_TRIANGLES> trivisible;
+	std::vector<bool> vtxvisible;
 	/*
-	 * Visible vertices as a bitset
+	 * Ambient and diffuse lighting of the visible vertices, indexed as the
+	 * mesh vertices. Filled once per frame by the renderer.
 	 */
-	std::bitset<M3D_MAX_VERTICES> vtxvisible;
+	std::vector<struct m3d_render_color> vtxcolors;
 	/*
 	 * Object color
 	 */
@@ -248,6 +315,34 @@ public:
 	 * Visible or changed flags
 	 */
 	unsigned flags;
+
+private:
+	/*
+	 * Ranges of visible vertices to transform and project with CULL_OBJECT,
+	 * as first vertex and count
+	 */
+	std::vector<std::pair<size_t, size_t>> vtxruns;
+
+	/*
+	 * Project to camera the n vertices starting at first
+	 */
+	void project_vertices(m3d_camera &camera, size_t first, size_t n);
+
+	/*
+	 * Transform if requested, then project the n vertices starting at first
+	 */
+	void transform_and_project(m3d_camera &camera, size_t first, size_t n, bool transform);
+
+	/*
+	 * Find the visible triangles by their winding on screen
+	 */
+	void cull_screen(void);
+
+	/*
+	 * Find the visible triangles by their normals against the camera position
+	 * in object coordinates
+	 */
+	void cull_object(m3d_camera &camera);
 };
 
 #endif // M3D_OBJECT_H
@@ -0,0 +1,188 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "m3d_profiler.hh"
+
+using namespace std;
+
+static const char *stage_names[] = {"visible_list", "project", "sort", "lighting", "raster", "frame"};
+
+/*
+ * Innermost timer running on this thread, nested timers charge their lifetime
+ * to it when they expire.
+ */
+static thread_local m3d_profile_scope *active_scope = nullptr;
+
+/*
+ * Statistics of this thread, registered with the profiler for its lifetime
+ */
+class m3d_profiler_thread
+{
+public:
+	m3d_profiler_thread()
+	{
+		timers.clear();
+		m3d_profiler::inst().attach(&timers);
+	}
+
+	~m3d_profiler_thread()
+	{
+		m3d_profiler::inst().detach(&timers);
+	}
+
+	m3d_profiler::stats timers;
+};
+
+static thread_local m3d_profiler_thread thread_timers;
+
+static inline uint64_t elapsed_ns(chrono::steady_clock::time_point start)
+{
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+void m3d_profiler::stats::clear()
+{
+	for (unsigned i = 0; i < STAGE_MAX; i++)
+	{
+		ns[i] = calls[i] = 0;
+	}
+}
+
+m3d_profiler::m3d_profiler() : frames(0)
+{
+	current.clear();
+	last.clear();
+	total.clear();
+}
+
+m3d_profiler &m3d_profiler::inst()
+{
+	static m3d_profiler instance;
+
+	return instance;
+}
+
+void m3d_profiler::add(unsigned stage, uint64_t ns)
+{
+	thread_timers.timers.ns[stage] += ns;
+	thread_timers.timers.calls[stage]++;
+}
+
+void m3d_profiler::attach(stats *thread)
+{
+	lock_guard<mutex> guard(lock);
+
+	threads.push_back(thread);
+}
+
+void m3d_profiler::detach(stats *thread)
+{
+	lock_guard<mutex> guard(lock);
+
+	for (unsigned i = 0; i < STAGE_MAX; i++)
+	{
+		current.ns[i] += thread->ns[i];
+		current.calls[i] += thread->calls[i];
+	}
+	threads.erase(find(threads.begin(), threads.end(), thread));
+}
+
+/*
+ * Move the statistics of the threads into the current frame
+ */
+void m3d_profiler::collect()
+{
+	lock_guard<mutex> guard(lock);
+
+	for (auto it : threads)
+	{
+		for (unsigned i = 0; i < STAGE_MAX; i++)
+		{
+			current.ns[i] += it->ns[i];
+			current.calls[i] += it->calls[i];
+		}
+		it->clear();
+	}
+}
+
+void m3d_profiler::begin_frame()
+{
+	// Drop the timers expired between frames
+	collect();
+	current.clear();
+}
+
+void m3d_profiler::end_frame()
+{
+	collect();
+	last = current;
+
+	for (unsigned i = 0; i < STAGE_MAX; i++)
+	{
+		total.ns[i] += current.ns[i];
+		total.calls[i] += current.calls[i];
+	}
+	frames++;
+}
+
+void m3d_profiler::reset()
+{
+	collect();
+	current.clear();
+	last.clear();
+	total.clear();
+	frames = 0;
+}
+
+const char *m3d_profiler::stage_name(unsigned stage)
+{
+	return (stage < STAGE_MAX) ? stage_names[stage] : "unknown";
+}
+
+m3d_profile_scope::m3d_profile_scope(unsigned stage) : stage(stage), nested(0), parent(active_scope)
+{
+	active_scope = this;
+	start = chrono::steady_clock::now();
+}
+
+m3d_profile_scope::~m3d_profile_scope()
+{
+	uint64_t ns = elapsed_ns(start);
+
+	active_scope = parent;
+	if (parent)
+	{
+		parent->nested += ns;
+	}
+	m3d_profiler::inst().add(stage, ns - nested);
+}
+
+m3d_profile_frame::m3d_profile_frame()
+{
+	m3d_profiler::inst().begin_frame();
+	start = chrono::steady_clock::now();
+}
+
+m3d_profile_frame::~m3d_profile_frame()
+{
+	m3d_profiler::inst().add(m3d_profiler::STAGE_FRAME, elapsed_ns(start));
+	m3d_profiler::inst().end_frame();
+}
@@ -0,0 +1,166 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_PROFILER_HH_INCLUDED
+#define M3D_PROFILER_HH_INCLUDED
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/*
+ * Per-stage frame profiler.
+ *
+ * Pipeline stages are measured by scoped timers, declared with M3D_PROFILE_SCOPE.
+ * Timers can be nested: every stage accounts for its own time only, the time
+ * spent in nested stages is charged to them (i.e. lighting computed while
+ * rasterizing a Phong triangle is not part of the raster time).
+ * The frame is delimited by M3D_PROFILE_FRAME, declared in the renderers.
+ *
+ * Timers are compiled in only if M3D_PROFILE is defined, otherwise the macros
+ * expand to nothing and the statistics stay at zero.
+ * Every thread charges its timers to its own statistics, they are summed when
+ * the frame is closed: with several threads, stage times are CPU times and can
+ * add up to more than the frame time.
+ */
+
+class m3d_profiler
+{
+public:
+	enum
+	{
+		STAGE_VISIBLE_LIST,
+		STAGE_PROJECT,
+		STAGE_SORT,
+		STAGE_LIGHTING,
+		STAGE_RASTER,
+		// The whole frame, including the time not charged to any stage
+		STAGE_FRAME,
+		STAGE_MAX
+	};
+
+	struct stats
+	{
+		/*
+		 * Nanoseconds spent in every stage, and number of timed calls
+		 */
+		uint64_t ns[STAGE_MAX];
+		uint64_t calls[STAGE_MAX];
+
+		void clear(void);
+
+		/*
+		 * Time spent in a stage in milliseconds
+		 */
+		double ms(unsigned stage) const { return (double)ns[stage] / 1.0e6; }
+	};
+
+	m3d_profiler();
+
+	static m3d_profiler &inst(void);
+
+	/*
+	 * Open and close a frame; the statistics of the frame being closed are
+	 * added to the accumulated statistics.
+	 */
+	void begin_frame(void);
+	void end_frame(void);
+
+	/*
+	 * Charge ns nanoseconds to stage
+	 */
+	void add(unsigned stage, uint64_t ns);
+
+	/*
+	 * Statistics of the last completed frame
+	 */
+	const stats &get_frame_stats(void) const { return last; }
+
+	/*
+	 * Statistics accumulated over all frames since the last reset()
+	 */
+	const stats &get_total_stats(void) const { return total; }
+
+	unsigned long get_frames(void) const { return frames; }
+
+	void reset(void);
+
+	static const char *stage_name(unsigned stage);
+
+	/*
+	 * Register and unregister the statistics of a thread, the statistics of
+	 * an unregistered thread are added to the frame being measured.
+	 */
+	void attach(stats *thread);
+	void detach(stats *thread);
+
+private:
+	stats current, last, total;
+	unsigned long frames;
+	// The statistics of the threads charging timers, protected by lock
+	std::vector<stats *> threads;
+	std::mutex lock;
+
+	void collect(void);
+};
+
+/*
+ * Scoped timer, charges its lifetime minus the lifetime of the nested timers
+ * to the stage.
+ */
+class m3d_profile_scope
+{
+public:
+	explicit m3d_profile_scope(unsigned stage);
+	~m3d_profile_scope();
+
+private:
+	unsigned stage;
+	uint64_t nested;
+	m3d_profile_scope *parent;
+	std::chrono::steady_clock::time_point start;
+};
+
+/*
+ * Scoped frame, calls begin_frame() and end_frame() and charges its lifetime
+ * to STAGE_FRAME.
+ */
+class m3d_profile_frame
+{
+public:
+	m3d_profile_frame();
+	~m3d_profile_frame();
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+#define M3D_PROFILE_CONCAT2(a, b) a##b
+#define M3D_PROFILE_CONCAT(a, b) M3D_PROFILE_CONCAT2(a, b)
+
+#ifdef M3D_PROFILE
+#define M3D_PROFILE_SCOPE(stage) m3d_profile_scope M3D_PROFILE_CONCAT(m3d_profile_, __LINE__)(m3d_profiler::stage)
+#define M3D_PROFILE_FRAME() m3d_profile_frame M3D_PROFILE_CONCAT(m3d_profile_frame_, __LINE__)
+#else
+#define M3D_PROFILE_SCOPE(stage)
+#define M3D_PROFILE_FRAME()
+#endif
+
+#endif
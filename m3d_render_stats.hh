@@ -0,0 +1,100 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _M3D_RENDER_STATS_HH_
+#define _M3D_RENDER_STATS_HH_
+
+#include <ostream>
+
+/*
+ * Rasterizer statistics, filled in by the renderers for every frame.
+ */
+struct m3d_render_stats
+{
+        /*
+         * Objects projected to screen
+         */
+        unsigned long objects_projected;
+        /*
+         * Objects discarded because they are outside the view frustum
+         */
+        unsigned long objects_culled;
+        /*
+         * Triangles discarded because they are facing away from the camera
+         */
+        unsigned long triangles_culled;
+        /*
+         * Triangles handed over to the rasterizer
+         */
+        unsigned long triangles_rasterized;
+        /*
+         * Z buffer tests performed, and tests passed (pixels written). The
+         * painter's algorithm performs none, and counts the pixels written
+         * in zpasses only.
+         */
+        unsigned long ztests, zpasses;
+
+        m3d_render_stats() { clear(); }
+
+        void clear(void)
+        {
+                objects_projected = objects_culled = triangles_culled = triangles_rasterized = ztests = zpasses = 0;
+        }
+
+        void add(const m3d_render_stats &other)
+        {
+                objects_projected += other.objects_projected;
+                objects_culled += other.objects_culled;
+                triangles_culled += other.triangles_culled;
+                triangles_rasterized += other.triangles_rasterized;
+                ztests += other.ztests;
+                zpasses += other.zpasses;
+        }
+
+        /*
+         * Overdraw ratio, Z tests per pixel written. It does not apply with no
+         * Z tests, as with the painter's algorithm.
+         */
+        bool has_overdraw(void) const { return ztests && zpasses; }
+
+        double overdraw(void) const
+        {
+                return has_overdraw() ? (double)ztests / (double)zpasses : 0.0;
+        }
+
+        /*
+         * Stream the counters as a JSON object
+         */
+        void dump_json(std::ostream &out) const
+        {
+                out << "{\"objects_projected\":" << objects_projected
+                    << ",\"objects_culled\":" << objects_culled
+                    << ",\"triangles_culled\":" << triangles_culled
+                    << ",\"triangles_rasterized\":" << triangles_rasterized
+                    << ",\"ztests\":" << ztests
+                    << ",\"zpasses\":" << zpasses
+                    << ",\"overdraw\":";
+                if (has_overdraw())
+                        out << overdraw() << "}";
+                else
+                        out << "null}";
+        }
+};
+
+#endif
@@ -24,6 +24,8 @@
 
 #include "m3d_renderer.hh"
 #include "m3d_interp.hh"
+#include "m3d_profiler.hh"
+#include "m3d_span.hh"
 
 using namespace std;
 
@@ -38,10 +40,19 @@ m3d_renderer::~m3d_renderer()
 	delete zscanline;
 }
 
-m3d_renderer::m3d_renderer(m3d_display *disp) : display(disp), zbuffer((int16_t)disp->get_xmax(), (int16_t)disp->get_ymax())
+m3d_renderer::m3d_renderer(m3d_display *disp) : display(disp), zbuffer((int16_t)disp->get_xmax(), (int16_t)disp->get_ymax()), culling(m3d_render_object::CULL_SCREEN), rasterizer(RASTER_SCANLINE), shading(SHADING_FORWARD), prepass(false), visibility(false), order(ORDER_OBJECTS), sorted(false), painter(false), hiz(true), lazyclear(true), frame(1)
 {
 	scanline = new int16_t[display->get_ymax() * 2];
 	zscanline = new float[display->get_ymax() * 2];
+
+	tilesx = (display->get_xmax() + M3D_TILE_SIZE - 1) / M3D_TILE_SIZE;
+	tilesy = (display->get_ymax() + M3D_TILE_SIZE - 1) / M3D_TILE_SIZE;
+	bins.resize((size_t)(tilesx * tilesy));
+	// Nothing is known of the display content before the first frame
+	tiledirty.assign(bins.size(), 1);
+	tileframe.assign(bins.size(), 0);
+	nodepth.assign((size_t)display->get_xmax(), 1.0f);
+	jobs.set_threads(0);
 }
 
 /*
@@ -49,8 +60,11 @@ m3d_renderer::m3d_renderer(m3d_display *disp) : display(disp), zbuffer((int16_t)
  */
 void m3d_renderer::render(m3d_world & /*world*/)
 {
+	M3D_PROFILE_FRAME();
+
 	// Fill the surface black
 	display->clear_renderer();
+	display->set_owner(this);
 	// Update the surface
 	display->show_buffer();
 }
@@ -102,30 +116,772 @@ void m3d_renderer::sort_triangle(m3d_vertex *vtx[3], struct m3d_render_color *co
 
 void m3d_renderer::store_scanlines(unsigned runlen, int16_t val1, int16_t val2, unsigned start)
 {
-	m3d_interpolation_short run(runlen, val1, val2);
-	run.valuearray(scanline + start);
+	m3d_lerp_short run;
+
+	run.set(runlen, val1, val2);
+	run.fill(run.stepsvalue(), scanline + start);
 }
 
 void m3d_renderer::store_zscanlines(unsigned runlen, float val1, float val2, unsigned start)
 {
-	m3d_interpolation_float run(runlen, val1, val2);
-	run.valuearray(zscanline + start);
+	m3d_lerp_float run;
+
+	run.set(runlen, val1, val2);
+	run.fill(run.stepsvalue(), zscanline + start);
+}
+
+struct m3d_renderer::fill_depth
+{
+	const m3d_span &spans;
+
+	inline void edges(m3d_vertex *[], unsigned, unsigned, unsigned) {}
+
+	inline unsigned span(int16_t, int16_t, uint32_t *, float *depth, const m3d_lerp_float &z, unsigned first, unsigned n, unsigned, unsigned)
+	{
+		return spans.nearest(depth, n, z.at(first), z.deltavalue(), 0);
+	}
+};
+
+void m3d_renderer::triangle_fill_depth(m3d_vertex *vtx[3])
+{
+	fill_depth attrs = {m3d_span::inst()};
+
+	fill_triangle(vtx, attrs);
 }
 
 void m3d_renderer::compute_visible_list_and_sort(m3d_world &world)
 {
+	size_t i;
+
+	M3D_PROFILE_SCOPE(STAGE_VISIBLE_LIST);
+
 	vislist.clear();
+	frame_stats.clear();
+	zbuffer.reset_counters();
+
+	try
+	{
+		objects.assign(world.objects_list.begin(), world.objects_list.end());
+		objvisible.resize(objects.size());
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return;
+	}
 
-	for (auto itro : world.objects_list)
+	// Objects are projected in parallel, and every object splits its vertices among the threads
+	jobs.parallel_for(0, objects.size(), 1, [&](size_t first, size_t last, unsigned)
+			  {
+				  for (size_t j = first; j < last; j++)
+					  objvisible[j] = project_object(*objects[j], world);
+			  });
+
+	// The visible list and the statistics keep the order of the world
+	for (i = 0; i < objects.size(); i++)
 	{
-		itro->project(world.camera);
-		if (itro->trivisible.any())
-			vislist.push_back(itro);
+		if (objvisible[i] == M3D_OBJECT_CULLED)
+		{
+			frame_stats.objects_culled++;
+			continue;
+		}
+
+		frame_stats.objects_projected++;
+		frame_stats.triangles_culled += objects[i]->mesh->triangle_count() - objvisible[i];
+		if (objvisible[i])
+			vislist.push_back(objects[i]);
 	}
 
 	if (vislist.size())
 	{
 		world.sort(vislist);
-		zbuffer.reset();
+		if (lazyclear)
+			zbuffer.invalidate();
+		else
+			zbuffer.reset();
+	}
+}
+
+unsigned m3d_renderer::project_object(m3d_render_object &obj, m3d_world &world)
+{
+	// Reject objects outside the view frustum before any per-vertex work
+	if (!obj.in_frustum(world.camera))
+	{
+		return M3D_OBJECT_CULLED;
+	}
+
+	return obj.project(world.camera, culling, &jobs);
+}
+
+void m3d_renderer::light_vertices(m3d_render_object &obj, m3d_world &world)
+{
+	jobs.parallel_for(0, obj.mesh->vertex_count(), 256, [&](size_t first, size_t last, unsigned)
+			  { light_range(obj, world, first, last); });
+}
+
+void m3d_renderer::light_range(m3d_render_object &obj, m3d_world &world, size_t first, size_t last)
+{
+	m3d_vertex scratch;
+	m3d_vertex *vtx;
+
+	for (size_t i = first; i < last; i++)
+	{
+		if (obj.vtxvisible[i])
+		{
+			vtx = obj.get_vertex((uint32_t)i, scratch);
+			m3d_illum::inst().ambient_lighting(*vtx, obj, world, obj.vtxcolors[i]);
+			m3d_illum::inst().diffuse_lighting(*vtx, obj, world, obj.vtxcolors[i]);
+		}
+	}
+}
+
+void m3d_renderer::update_stats()
+{
+	frame_stats.ztests = zbuffer.get_tests();
+	frame_stats.zpasses = zbuffer.get_passes();
+	total_stats.add(frame_stats);
+}
+
+void m3d_renderer::reset_stats()
+{
+	frame_stats.clear();
+	total_stats.clear();
+}
+
+void m3d_renderer::dump_stats_json(std::ostream &out) const
+{
+	out << "{\"frame\":";
+	frame_stats.dump_json(out);
+	out << ",\"total\":";
+	total_stats.dump_json(out);
+	out << "}";
+}
+
+void m3d_renderer::raster_begin()
+{
+	// The Z buffer takes memory only while depths are tested, without it triangles are drawn back to front
+	painter = (order == ORDER_BACK_TO_FRONT);
+	if (painter)
+		zbuffer.release();
+	else
+		painter = !zbuffer.allocate();
+	prepass = prepass && !painter;
+
+	/*
+	 * Displays have linear framebuffers, the pitch is the distance between
+	 * two rows.
+	 */
+	screen.color = display->get_video_buffer(0, 0);
+	screen.cpitch = (int)(display->get_video_buffer(0, 1) - screen.color);
+	screen.depth = painter ? nodepth.data() : zbuffer.get_zbuffer();
+	screen.zpitch = painter ? 0 : zbuffer.get_pitch();
+	screen.x0 = screen.y0 = 0;
+	screen.x1 = display->get_xmax() - 1;
+	screen.y1 = display->get_ymax() - 1;
+	screen.hizfine = (hiz && !painter) ? zbuffer.get_hiz_fine() : nullptr;
+	screen.hizcoarse = (hiz && !painter) ? zbuffer.get_hiz_coarse() : nullptr;
+	screen.finepitch = zbuffer.get_hiz_fine_pitch();
+	screen.coarsepitch = zbuffer.get_hiz_coarse_pitch();
+	screen.hiz_begin();
+	screen.tests = screen.passes = 0;
+	screen.equal = false;
+	screen.painter = painter;
+
+	// Ids pack the object numbers and the triangle indexes
+	visibility = (shading == SHADING_VISIBILITY) && has_visibility() && !painter && (vislist.size() <= m3d_visbuffer::max_objects);
+	for (auto it = vislist.begin(); visibility && (it != vislist.end()); ++it)
+	{
+		visibility = (*it)->mesh->triangles.size() <= m3d_visbuffer::max_triangles;
+	}
+	// The visibility buffer takes memory only while selected
+	if (visibility)
+		visibility = visbuffer.allocate(display->get_xmax(), display->get_ymax());
+	else if (((shading != SHADING_VISIBILITY) || painter) && visbuffer.allocated())
+		visbuffer.release();
+	visobjects.clear();
+	sorted = (order == ORDER_FRONT_TO_BACK) || painter;
+
+	if (lazyclear)
+	{
+		if (++frame == 0)
+		{
+			// Tiles cleared 2^32 frames ago would look cleared in this frame
+			fill(tileframe.begin(), tileframe.end(), 0);
+			frame = 1;
+		}
+		// Another renderer drew on the display since the last frame of this one
+		if (display->get_owner() != this)
+			fill(tiledirty.begin(), tiledirty.end(), 1);
+	}
+	else
+	{
+		// Fill the surface black
+		display->clear_buffer();
+		// What is drawn now is not tracked
+		fill(tiledirty.begin(), tiledirty.end(), 1);
+	}
+	display->set_owner(this);
+
+	if ((rasterizer == RASTER_TILED) || prepass || sorted)
+	{
+		setups.clear();
+		for (auto &it : bins)
+		{
+			it.clear();
+		}
+	}
+}
+
+void m3d_renderer::raster_submit(const m3d_halfspace_setup &setup, m3d_world &world)
+{
+	if (visibility && !sorted)
+	{
+		prepare_area(setup.tri.minx, setup.tri.miny, setup.tri.maxx, setup.tri.maxy);
+		visbuffer.prepare(setup.tri.minx, setup.tri.miny, setup.tri.maxx, setup.tri.maxy);
+		raster_target(setup, screen, world, true);
+		return;
+	}
+
+	if ((rasterizer != RASTER_TILED) && !prepass && !sorted)
+	{
+		prepare_area(setup.tri.minx, setup.tri.miny, setup.tri.maxx, setup.tri.maxy);
+		raster_target(setup, screen, world);
+		return;
+	}
+
+	uint32_t index = (uint32_t)setups.size();
+
+	try
+	{
+		setups.push_back(setup);
+		if ((rasterizer != RASTER_TILED) || visibility)
+		{
+			// Kept for the depth pre-pass or the sort in raster_end()
+			prepare_area(setup.tri.minx, setup.tri.miny, setup.tri.maxx, setup.tri.maxy);
+			if (visibility)
+				visbuffer.prepare(setup.tri.minx, setup.tri.miny, setup.tri.maxx, setup.tri.maxy);
+			return;
+		}
+		// Sorted triangles are binned in raster_end()
+		if (!sorted)
+			bin_setup(index);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+	}
+}
+
+void m3d_renderer::bin_setup(uint32_t index)
+{
+	const m3d_halfspace_triangle &tri = setups[index].tri;
+
+	for (int ty = tri.miny / M3D_TILE_SIZE; ty <= tri.maxy / M3D_TILE_SIZE; ty++)
+	{
+		for (int tx = tri.minx / M3D_TILE_SIZE; tx <= tri.maxx / M3D_TILE_SIZE; tx++)
+		{
+			bins[(size_t)(ty * tilesx + tx)].push_back(index);
+		}
+	}
+}
+
+const uint32_t *m3d_renderer::sort_setups()
+{
+	M3D_PROFILE_SCOPE(STAGE_SORT);
+
+	if (!depthsort.resize(setups.size()))
+		return nullptr;
+
+	jobs.parallel_for(0, setups.size(), 256, [&](size_t first, size_t last, unsigned)
+			  {
+				  for (size_t i = first; i < last; i++)
+				  {
+					  const m3d_halfspace_setup &setup = setups[i];
+
+					  if (painter)
+						  depthsort.set(i, M3D_DEPTH_KEY_MAX - m3d_depth_sort::key(setup.tri.farthest(setup.planes[0])));
+					  else
+						  depthsort.set(i, m3d_depth_sort::key(setup.tri.nearest(setup.planes[0])));
+				  }
+			  });
+	return depthsort.sort();
+}
+
+void m3d_renderer::prepare_area(int xs, int ys, int xe, int ye)
+{
+	if (!lazyclear)
+		return;
+
+	for (int ty = ys / M3D_TILE_SIZE; ty <= ye / M3D_TILE_SIZE; ty++)
+	{
+		for (int tx = xs / M3D_TILE_SIZE; tx <= xe / M3D_TILE_SIZE; tx++)
+		{
+			unsigned index = (unsigned)(ty * tilesx + tx);
+
+			if (tileframe[index] != frame)
+			{
+				if (tiledirty[index])
+					clear_tile(index);
+				tiledirty[index] = 1;
+				tileframe[index] = frame;
+			}
+		}
+	}
+	zbuffer.validate(xs, ys, xe, ye);
+}
+
+void m3d_renderer::prepare_triangle(m3d_vertex *vtx[3])
+{
+	// Vertices are sorted by y
+	int xs = min(min(vtx[0]->scrposition.x, vtx[1]->scrposition.x), vtx[2]->scrposition.x);
+	int xe = max(max(vtx[0]->scrposition.x, vtx[1]->scrposition.x), vtx[2]->scrposition.x);
+	int ys = vtx[0]->scrposition.y, ye = vtx[2]->scrposition.y;
+
+	xs = max(xs, screen.x0);
+	ys = max(ys, screen.y0);
+	xe = min(xe, screen.x1);
+	ye = min(ye, screen.y1);
+	if ((xs <= xe) && (ys <= ye))
+		prepare_area(xs, ys, xe, ye);
+}
+
+void m3d_renderer::clear_tile(unsigned index)
+{
+	int x0 = (int)(index % (unsigned)tilesx) * M3D_TILE_SIZE;
+	int y0 = (int)(index / (unsigned)tilesx) * M3D_TILE_SIZE;
+	int x1 = min(x0 + M3D_TILE_SIZE - 1, screen.x1);
+	int y1 = min(y0 + M3D_TILE_SIZE - 1, screen.y1);
+	const m3d_span &spans = m3d_span::inst();
+
+	for (int y = y0; y <= y1; y++)
+	{
+		spans.fill(screen.color_at(x0, y), 0, (size_t)(x1 - x0 + 1));
+	}
+}
+
+/*
+ * Copy the hierarchical Z blocks of tile from the screen, or back to the
+ * screen if store is true
+ */
+static void copy_tile_hiz(m3d_halfspace_target &screen, m3d_halfspace_target &tile, bool store)
+{
+	int fx = (tile.x0 - screen.x0) / M3D_HIZ_FINE, fy = (tile.y0 - screen.y0) / M3D_HIZ_FINE;
+	int cx = (tile.x0 - screen.x0) / M3D_HIZ_COARSE, cy = (tile.y0 - screen.y0) / M3D_HIZ_COARSE;
+	int finelen = (tile.x1 - tile.x0) / M3D_HIZ_FINE + 1, finerows = (tile.y1 - tile.y0) / M3D_HIZ_FINE + 1;
+	int coarselen = (tile.x1 - tile.x0) / M3D_HIZ_COARSE + 1, coarserows = (tile.y1 - tile.y0) / M3D_HIZ_COARSE + 1;
+
+	for (int y = 0; y < finerows; y++)
+	{
+		float *s = screen.hizfine + (fy + y) * screen.finepitch + fx;
+		float *t = tile.hizfine + y * tile.finepitch;
+
+		if (store)
+			copy_n(t, finelen, s);
+		else
+			copy_n(s, finelen, t);
+	}
+	for (int y = 0; y < coarserows; y++)
+	{
+		float *s = screen.hizcoarse + (cy + y) * screen.coarsepitch + cx;
+		float *t = tile.hizcoarse + y * tile.coarsepitch;
+
+		if (store)
+			copy_n(t, coarselen, s);
+		else
+			copy_n(s, coarselen, t);
+	}
+}
+
+void m3d_renderer::raster_tile(unsigned index, unsigned thread, m3d_world &world)
+{
+	const vector<uint32_t> &bin = bins[index];
+	m3d_halfspace_target tile;
+	const m3d_span &spans = m3d_span::inst();
+	size_t rowlen;
+	bool freshcolor, freshdepth;
+	// Without Z buffer the tile has no depth to load nor to store
+	bool tilehiz = hiz && !painter;
+
+	if (bin.empty())
+	{
+		return;
+	}
+
+	tile.x0 = (int)(index % (unsigned)tilesx) * M3D_TILE_SIZE;
+	tile.y0 = (int)(index / (unsigned)tilesx) * M3D_TILE_SIZE;
+	tile.x1 = min(tile.x0 + M3D_TILE_SIZE - 1, screen.x1);
+	tile.y1 = min(tile.y0 + M3D_TILE_SIZE - 1, screen.y1);
+	tile.color = tilecolor[thread].data();
+	tile.depth = tiledepth[thread].data();
+	tile.cpitch = tile.zpitch = M3D_TILE_SIZE;
+	tile.hizfine = tilehiz ? tilehizfine[thread].data() : nullptr;
+	tile.hizcoarse = tilehiz ? tilehizcoarse[thread].data() : nullptr;
+	tile.finepitch = M3D_TILE_HIZ_FINE;
+	tile.coarsepitch = M3D_TILE_HIZ_COARSE;
+	tile.hiz_begin();
+	tile.tests = tile.passes = 0;
+	tile.equal = false;
+	tile.painter = painter;
+	rowlen = (size_t)(tile.x1 - tile.x0 + 1);
+
+	// Buffers to be cleared on demand start cleared in the tile, the screen is not read
+	freshcolor = lazyclear && (tileframe[index] != frame);
+	freshdepth = lazyclear && zbuffer.is_stale(tile.x0, tile.y0, tile.x1, tile.y1);
+	if (lazyclear && !freshdepth)
+	{
+		zbuffer.validate(tile.x0, tile.y0, tile.x1, tile.y1);
+	}
+
+	for (int y = tile.y0; y <= tile.y1; y++)
+	{
+		if (freshcolor)
+			spans.fill(tile.color_at(tile.x0, y), 0, (size_t)rowlen);
+		else
+			copy_n(screen.color_at(tile.x0, y), rowlen, tile.color_at(tile.x0, y));
+		if (painter)
+			continue;
+		if (freshdepth)
+			spans.fill_depth(tile.depth_at(tile.x0, y), 1.0f, (size_t)rowlen);
+		else
+			copy_n(screen.depth_at(tile.x0, y), rowlen, tile.depth_at(tile.x0, y));
+	}
+	if (tilehiz && freshdepth)
+	{
+		fill(tilehizfine[thread].begin(), tilehizfine[thread].end(), 1.0f);
+		fill(tilehizcoarse[thread].begin(), tilehizcoarse[thread].end(), 1.0f);
+	}
+	else if (tilehiz)
+	{
+		copy_tile_hiz(screen, tile, false);
+	}
+
+	if (prepass)
+	{
+		// Both passes while the tile is in the cache
+		raster_prepass(bin.data(), bin.size(), tile, world);
+	}
+	else
+	{
+		for (auto it : bin)
+		{
+			raster_target(setups[it], tile, world);
+		}
+	}
+
+	for (int y = tile.y0; y <= tile.y1; y++)
+	{
+		copy_n(tile.color_at(tile.x0, y), rowlen, screen.color_at(tile.x0, y));
+		if (!painter)
+			copy_n(tile.depth_at(tile.x0, y), rowlen, screen.depth_at(tile.x0, y));
+	}
+	if (tilehiz)
+	{
+		tile.hiz_flush();
+		copy_tile_hiz(screen, tile, true);
+	}
+	if (lazyclear)
+	{
+		tiledirty[index] = 1;
+		tileframe[index] = frame;
+		zbuffer.set_valid(tile.x0, tile.y0, tile.x1, tile.y1);
+	}
+
+	tiletests[thread] += tile.tests;
+	tilepasses[thread] += tile.passes;
+}
+
+void m3d_renderer::raster_end(m3d_world &world)
+{
+	// The setups in drawing order, null for the submission order
+	const uint32_t *drawn = sorted ? sort_setups() : nullptr;
+
+	if ((rasterizer == RASTER_TILED) && !visibility)
+	{
+		unsigned threads = jobs.get_threads();
+
+		if (sorted)
+		{
+			try
+			{
+				for (size_t i = 0; i < setups.size(); i++)
+					bin_setup(drawn ? drawn[i] : (uint32_t)i);
+			}
+			catch (const bad_alloc &e)
+			{
+				cerr << "Out of memory " << e.what() << endl;
+			}
+		}
+
+		if (tilecolor.size() != threads)
+		{
+			tilecolor.assign(threads, vector<uint32_t>(M3D_TILE_SIZE * M3D_TILE_SIZE));
+			tiledepth.assign(threads, vector<float>(M3D_TILE_SIZE * M3D_TILE_SIZE));
+			tilehizfine.assign(threads, vector<float>(M3D_TILE_HIZ_FINE * M3D_TILE_HIZ_FINE));
+			tilehizcoarse.assign(threads, vector<float>(M3D_TILE_HIZ_COARSE * M3D_TILE_HIZ_COARSE));
+		}
+		tiletests.assign(threads, 0);
+		tilepasses.assign(threads, 0);
+
+		jobs.parallel_for(0, bins.size(), 1, [&](size_t first, size_t last, unsigned thread)
+				  {
+					  for (size_t i = first; i < last; i++)
+						  raster_tile((unsigned)i, thread, world);
+				  });
+
+		for (unsigned i = 0; i < threads; i++)
+		{
+			screen.tests += tiletests[i];
+			screen.passes += tilepasses[i];
+		}
+	}
+	else
+	{
+		if (prepass)
+		{
+			raster_prepass(drawn, setups.size(), screen, world);
+		}
+		else if (sorted)
+		{
+			for (size_t i = 0; i < setups.size(); i++)
+				raster_target(setups[drawn ? drawn[i] : i], screen, world, visibility);
+		}
+		screen.hiz_flush();
+		if (visibility)
+			shade_visible(world);
+	}
+
+	if (lazyclear)
+	{
+		// Tiles drawn in a previous frame and not in this one still show it
+		jobs.parallel_for(0, tiledirty.size(), 16, [&](size_t first, size_t last, unsigned)
+				  {
+					  for (size_t i = first; i < last; i++)
+					  {
+						  if (tiledirty[i] && (tileframe[i] != frame))
+						  {
+							  clear_tile((unsigned)i);
+							  tiledirty[i] = 0;
+						  }
+					  }
+				  });
+	}
+
+	zbuffer.add_counters(screen.tests, screen.passes);
+}
+
+void m3d_renderer::raster_object(m3d_render_object &obj, m3d_world &world)
+{
+	size_t n = obj.vistriangles.size();
+	unsigned object = (unsigned)visobjects.size();
+
+	try
+	{
+		objsetups.resize(n);
+		objvalid.resize(n);
+		if (visibility)
+			visobjects.push_back(&obj);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		return;
+	}
+
+	jobs.parallel_for(0, n, 64, [&](size_t first, size_t last, unsigned)
+			  {
+				  for (size_t i = first; i < last; i++)
+				  {
+					  objvalid[i] = setup_triangle(obj, obj.mesh->triangles[obj.vistriangles[i]], objsetups[i]);
+					  objsetups[i].id = m3d_visbuffer::pack(object, obj.vistriangles[i]);
+				  }
+			  });
+
+	// Submission order is the order of the triangles in the mesh
+	for (size_t i = 0; i < n; i++)
+	{
+		if (objvalid[i])
+			raster_submit(objsetups[i], world);
+	}
+	frame_stats.triangles_rasterized += n;
+}
+
+void m3d_renderer::raster_target(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world, bool depthonly)
+{
+	unsigned long passes = target.passes;
+	int xs, ys, xe, ye;
+
+	if (target.hiz_reject(setup.tri, setup.planes[0]))
+		return;
+
+	if (depthonly)
+		raster_depth(setup, target);
+	else
+		raster_halfspace(setup, target, world);
+
+	// Pixels passing the equal test keep their depth
+	if (!target.equal && (target.passes != passes) && target.clip(setup.tri, xs, ys, xe, ye))
+		target.hiz_written(xs, ys, xe, ye, target.passes - passes);
+}
+
+void m3d_renderer::raster_depth(const m3d_halfspace_setup &setup, m3d_halfspace_target &target)
+{
+	const m3d_halfspace_triangle &tri = setup.tri;
+	const m3d_halfspace_plane &zp = setup.planes[0];
+	const m3d_span &spans = m3d_span::inst();
+	int xs, ys, xe, ye;
+
+	M3D_PROFILE_SCOPE(STAGE_RASTER);
+
+	if (!target.clip(tri, xs, ys, xe, ye))
+		return;
+
+	for (int y = ys; y <= ye; y++)
+	{
+		int rs = xs, re = xe;
+
+		if (!target.hiz_span(tri, zp, y, rs, re) || !tri.row_span(y, rs, re))
+			continue;
+
+		// Same depths as zp.at(), from the offset to the corner
+		unsigned n = (unsigned)(re - rs + 1);
+		float zrow = zp.row(y - tri.miny);
+		unsigned ox = (unsigned)(rs - tri.minx);
+
+		// The visibility buffer is rasterized into the screen target only
+		if (visibility)
+			target.passes += spans.visible(visbuffer.at(rs, y), target.depth_at(rs, y), n, zrow, zp.dx, ox, setup.id);
+		else
+			target.passes += spans.nearest(target.depth_at(rs, y), n, zrow, zp.dx, ox);
+		target.tests += n;
 	}
 }
+
+void m3d_renderer::raster_prepass(const uint32_t *indexes, size_t n, m3d_halfspace_target &target, m3d_world &world)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		raster_target(setups[indexes ? indexes[i] : i], target, world, true);
+	}
+
+	// The shading pass rejects more triangles with the final depths
+	target.hiz_flush();
+	target.equal = true;
+	for (size_t i = 0; i < n; i++)
+	{
+		raster_target(setups[indexes ? indexes[i] : i], target, world);
+	}
+	target.equal = false;
+}
+
+void m3d_renderer::shade_visible(m3d_world &world)
+{
+	unsigned threads = jobs.get_threads();
+
+	tiletests.assign(threads, 0);
+	tilepasses.assign(threads, 0);
+
+	jobs.parallel_for(0, visbuffer.block_count(), 1, [&](size_t first, size_t last, unsigned thread)
+			  {
+				  for (size_t i = first; i < last; i++)
+				  {
+					  if (visbuffer.block_written(i))
+						  shade_visible_block(i, thread, world);
+				  }
+			  });
+
+	for (unsigned i = 0; i < threads; i++)
+	{
+		screen.tests += tiletests[i];
+		screen.passes += tilepasses[i];
+	}
+	visbuffer.invalidate();
+}
+
+/*
+ * Triangles set up again in a block, indexed by the low bits of their ids:
+ * a block meets few triangles, and most of them on several rows
+ */
+#define M3D_VISBUFFER_CACHE (16)
+
+void m3d_renderer::shade_visible_block(size_t index, unsigned thread, m3d_world &world)
+{
+	m3d_halfspace_setup cache[M3D_VISBUFFER_CACHE];
+	uint32_t cacheid[M3D_VISBUFFER_CACHE];
+	bool cachevalid[M3D_VISBUFFER_CACHE];
+	m3d_halfspace_target run;
+	int xs, ys, xe, ye;
+
+	fill_n(cacheid, M3D_VISBUFFER_CACHE, M3D_VISBUFFER_NONE);
+
+	// Pixels are shaded by the triangle whose depth they hold
+	run.cpitch = screen.cpitch;
+	run.zpitch = screen.zpitch;
+	run.hizfine = run.hizcoarse = nullptr;
+	run.finepitch = run.coarsepitch = 0;
+	run.hiz_begin();
+	run.tests = run.passes = 0;
+	run.equal = true;
+	run.painter = false;
+
+	visbuffer.block_area(index, xs, ys, xe, ye);
+	for (int y = ys; y <= ye; y++)
+	{
+		const uint32_t *ids = visbuffer.at(0, y);
+
+		for (int x = xs; x <= xe;)
+		{
+			uint32_t id = ids[x];
+			int end = x;
+
+			if (id == M3D_VISBUFFER_NONE)
+			{
+				x++;
+				continue;
+			}
+			while ((end < xe) && (ids[end + 1] == id))
+			{
+				end++;
+			}
+
+			unsigned slot = id % M3D_VISBUFFER_CACHE;
+
+			if (cacheid[slot] != id)
+			{
+				m3d_render_object *obj = visobjects[m3d_visbuffer::object(id)];
+
+				cacheid[slot] = id;
+				cachevalid[slot] = setup_triangle(*obj, obj->mesh->triangles[m3d_visbuffer::triangle(id)], cache[slot]);
+			}
+			if (cachevalid[slot])
+			{
+				run.color = screen.color_at(x, y);
+				run.depth = screen.depth_at(x, y);
+				run.x0 = x;
+				run.x1 = end;
+				run.y0 = run.y1 = y;
+				raster_halfspace(cache[slot], run, world);
+			}
+			x = end + 1;
+		}
+	}
+
+	tiletests[thread] += run.tests;
+	tilepasses[thread] += run.passes;
+}
+
+/*
+ * Default renderer does not use the half-space rasterizer
+ */
+bool m3d_renderer::setup_triangle(m3d_render_object & /*obj*/, const m3d_triangle & /*triangle*/, m3d_halfspace_setup & /*setup*/)
+{
+	return false;
+}
+
+void m3d_renderer::raster_halfspace(const m3d_halfspace_setup & /*setup*/, m3d_halfspace_target & /*target*/, m3d_world & /*world*/)
+{
+}
+
+bool m3d_renderer::has_visibility(void) const
+{
+	return false;
+}
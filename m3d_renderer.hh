@@ -20,16 +20,111 @@
 #ifndef M3D_RENDERER_H
 #define M3D_RENDERER_H
 
+#include <algorithm>
+#include <vector>
+
 #include "m3d_display.hh"
 #include "m3d_world.hh"
 #include "m3d_zbuffer.hh"
+#include "m3d_visbuffer.hh"
+#include "m3d_depth_sort.hh"
 #include "m3d_illum.hh"
+#include "m3d_render_stats.hh"
+#include "m3d_halfspace.hh"
+#include "m3d_jobs.hh"
+#include "m3d_interp.hh"
+#include "m3d_profiler.hh"
+
+/*
+ * Side of the square screen tiles used by the tiled rasterizer
+ */
+#define M3D_TILE_SIZE (64)
+// Blocks of the hierarchical Z of a tile, a tile must be made of whole coarse blocks
+#define M3D_TILE_HIZ_FINE (M3D_TILE_SIZE / M3D_HIZ_FINE)
+#define M3D_TILE_HIZ_COARSE (M3D_TILE_SIZE / M3D_HIZ_COARSE)
+
+/*
+ * Marks the objects outside the view frustum while computing the visible list
+ */
+#define M3D_OBJECT_CULLED (~0u)
 
 class m3d_renderer
 {
 public:
+	/*
+	 * Triangle rasterizers.
+	 * RASTER_SCANLINE walks the triangle edges to build spans, then fills
+	 * the spans with interpolators.
+	 * RASTER_HALFSPACE scans the triangle bounding box, testing the edge
+	 * functions and stepping plane equations for Z and attributes.
+	 * RASTER_TILED sets up triangles as RASTER_HALFSPACE, and sorts them
+	 * into bins, one for every screen tile overlapped by the triangle.
+	 * When all the triangles are binned, the worker threads rasterize the
+	 * tiles in tile local color and depth buffers, then copy them to the
+	 * screen. Triangles in a bin keep the submission order, so the result is
+	 * the same of RASTER_HALFSPACE.
+	 */
+	enum
+	{
+		RASTER_SCANLINE,
+		RASTER_HALFSPACE,
+		RASTER_TILED
+	};
+
+	/*
+	 * Shading modes.
+	 * SHADING_FORWARD shades every pixel passing the depth test while
+	 * rasterizing, so pixels drawn over are shaded again.
+	 * SHADING_DEFERRED rasterizes what the shading needs into a G-buffer,
+	 * then shades every pixel of the screen once, in a separate pass split
+	 * among the threads. Only the Phong renderer, that lights every pixel,
+	 * supports it; the others shade forward.
+	 * SHADING_PREPASS rasterizes the depth of all the triangles first, with
+	 * no color nor attributes, then shades them with an equal depth test:
+	 * every pixel is shaded once, by the nearest triangle, without the
+	 * memory of a G-buffer. The Gouraud and Phong renderers support it; the
+	 * others shade forward.
+	 * SHADING_VISIBILITY rasterizes only the depth and the id of the nearest
+	 * triangle of every pixel into a visibility buffer, then shades every
+	 * pixel once, from the triangle set up again from its id, in a separate
+	 * pass split among the threads. The flat, shaded, Gouraud and Phong
+	 * renderers support it, and rasterize as RASTER_HALFSPACE whatever the
+	 * rasterizer selected.
+	 */
+	enum
+	{
+		SHADING_FORWARD,
+		SHADING_DEFERRED,
+		SHADING_PREPASS,
+		SHADING_VISIBILITY
+	};
+
+	/*
+	 * Drawing orders.
+	 * ORDER_OBJECTS draws the objects front to back by the depth of their
+	 * center, and the triangles of every object in mesh order.
+	 * ORDER_FRONT_TO_BACK radix sorts all the triangles of the frame by
+	 * their nearest depth, and draws them front to back: the Z buffer then
+	 * rejects most of the hidden pixels before they are shaded. The
+	 * triangles are rasterized as RASTER_HALFSPACE (or RASTER_TILED),
+	 * whatever the rasterizer selected. Not the wireframe renderer.
+	 * ORDER_BACK_TO_FRONT is the painter's algorithm: it sorts them by their
+	 * farthest depth and draws them back to front with no depth test, so
+	 * that the nearer triangles are drawn over the farther ones. The Z
+	 * buffer is released, and not a byte of it read nor written; there is
+	 * no depth pre-pass nor visibility buffer, those modes shade forward.
+	 * Triangles crossing each other, or overlapping in depth, can be drawn
+	 * in the wrong order: it suits scenes of few separate objects.
+	 */
+	enum
+	{
+		ORDER_OBJECTS,
+		ORDER_FRONT_TO_BACK,
+		ORDER_BACK_TO_FRONT
+	};
+
 	/** Default constructor */
-	m3d_renderer() : display(nullptr) {};
+	m3d_renderer() : display(nullptr), culling(m3d_render_object::CULL_SCREEN), rasterizer(RASTER_SCANLINE), shading(SHADING_FORWARD), prepass(false), visibility(false), order(ORDER_OBJECTS), sorted(false), painter(false), hiz(true), lazyclear(true), frame(1) {};
 	m3d_renderer(m3d_display *disp);
 
 	/** Default destructor */
@@ -37,6 +132,75 @@ public:
 
 	virtual void render(m3d_world &world);
 
+	/*
+	 * Statistics of the last rendered frame, and accumulated over all frames
+	 * since the last call to reset_stats()
+	 */
+	const m3d_render_stats &get_frame_stats(void) const { return frame_stats; }
+	const m3d_render_stats &get_total_stats(void) const { return total_stats; }
+	void reset_stats(void);
+
+	/*
+	 * Stream frame and accumulated statistics as a JSON object
+	 */
+	void dump_stats_json(std::ostream &out) const;
+
+	/*
+	 * Select the back face culling mode, m3d_render_object::CULL_SCREEN
+	 * or m3d_render_object::CULL_OBJECT
+	 */
+	void set_culling(unsigned mode) { culling = mode; }
+	unsigned get_culling(void) const { return culling; }
+
+	/*
+	 * Select the triangle rasterizer, RASTER_SCANLINE or RASTER_HALFSPACE.
+	 * The wireframe renderer draws lines and ignores it.
+	 */
+	void set_rasterizer(unsigned mode) { rasterizer = mode; }
+	unsigned get_rasterizer(void) const { return rasterizer; }
+
+	/*
+	 * Select the shading mode, SHADING_FORWARD (the default),
+	 * SHADING_DEFERRED, SHADING_PREPASS or SHADING_VISIBILITY. The image is
+	 * the same, but for SHADING_VISIBILITY with RASTER_SCANLINE.
+	 */
+	void set_shading(unsigned mode) { shading = mode; }
+	unsigned get_shading(void) const { return shading; }
+
+	/*
+	 * Select the drawing order, ORDER_OBJECTS (the default),
+	 * ORDER_FRONT_TO_BACK or ORDER_BACK_TO_FRONT. The image is the same, but
+	 * for the pixels where triangles have the same depth, for
+	 * RASTER_SCANLINE and for the triangles ORDER_BACK_TO_FRONT misorders.
+	 */
+	void set_order(unsigned mode) { order = mode; }
+	unsigned get_order(void) const { return order; }
+
+	/*
+	 * Set the number of threads running the frame, the rendering thread included:
+	 * objects, vertices, triangle setup and screen tiles are split among them.
+	 * 0 selects the number of hardware threads, the default.
+	 */
+	void set_threads(unsigned n) { jobs.set_threads(n); }
+	unsigned get_threads(void) const { return jobs.get_threads(); }
+
+	/*
+	 * Enable the hierarchical Z with the half-space rasterizers (the default):
+	 * triangles, and the blocks of rows, proven hidden by it are skipped
+	 * without testing their pixels. The image is the same.
+	 */
+	void set_hiz(bool enable) { hiz = enable; }
+	bool get_hiz(void) const { return hiz; }
+
+	/*
+	 * Clear the color and depth buffers on demand (the default), by screen
+	 * tiles: a tile is cleared when the first triangle of the frame draws
+	 * into it, or at the end of the frame if it was drawn in a previous frame
+	 * only. Tiles left black are not written at all. The image is the same.
+	 */
+	void set_lazy_clear(bool enable) { lazyclear = enable; }
+	bool get_lazy_clear(void) const { return lazyclear; }
+
 protected:
 	// The window we are rendering to
 	m3d_display *display;
@@ -48,6 +212,52 @@ protected:
 	m3d_zbuffer zbuffer;
 	// The list of visible objects
 	std::list<m3d_render_object *> vislist;
+	// The objects of the world, and their visible triangles (or M3D_OBJECT_CULLED), while projecting
+	std::vector<m3d_render_object *> objects;
+	std::vector<unsigned> objvisible;
+	// Statistics for the frame being rendered and accumulated
+	m3d_render_stats frame_stats, total_stats;
+	// Back face culling mode
+	unsigned culling;
+	// Triangle rasterizer
+	unsigned rasterizer;
+	// Shading mode, and depth pre-pass or visibility buffer of the frame being rendered
+	unsigned shading;
+	bool prepass;
+	bool visibility;
+	m3d_visbuffer visbuffer;
+	// The objects of the frame, numbered as in the ids of the visibility buffer
+	std::vector<m3d_render_object *> visobjects;
+	// Drawing order, whether the triangles of the frame being rendered are sorted, and drawn back to front with no Z buffer
+	unsigned order;
+	bool sorted;
+	bool painter;
+	m3d_depth_sort depthsort;
+	// The row the screen target depth points to without Z buffer
+	std::vector<float> nodepth;
+	// Hierarchical Z enabled
+	bool hiz;
+	// Clear on demand enabled, which tiles of the display may be not black, and the frame each tile was last cleared in
+	bool lazyclear;
+	std::vector<uint8_t> tiledirty;
+	std::vector<uint32_t> tileframe;
+	uint32_t frame;
+	// The whole screen as a target of the half-space rasterizer
+	m3d_halfspace_target screen;
+	// Triangles set up in this frame (with RASTER_TILED or a depth pre-pass), and the indexes of the triangles overlapping every tile
+	std::vector<m3d_halfspace_setup> setups;
+	std::vector<std::vector<uint32_t>> bins;
+	int tilesx, tilesy;
+	// Triangles of the object being set up, and which of them are to be drawn
+	std::vector<m3d_halfspace_setup> objsetups;
+	std::vector<uint8_t> objvalid;
+	// Threads running the frame, and their tile buffers
+	m3d_jobs jobs;
+	std::vector<std::vector<uint32_t>> tilecolor;
+	std::vector<std::vector<float>> tiledepth;
+	std::vector<std::vector<float>> tilehizfine, tilehizcoarse;
+	// Depth tests counted by every thread
+	std::vector<unsigned long> tiletests, tilepasses;
 
 	/*
 	 * Sorts an array of 3 points composing a triangle.
@@ -79,6 +289,34 @@ protected:
 	 */
 	void store_zscanlines(unsigned runlen, float val1, float val2, unsigned start = 0);
 
+	/*
+	 * Scanline fill of a triangle with vertices sorted by y. The attributes
+	 * interpolated, and what is done with them, are chosen at compile time
+	 * by the class of attrs:
+	 *
+	 * attrs.edges(vtx, runlen0, runlen1, runlen2) stores the attributes of
+	 * the edges from vertex 0 to 2, 0 to 1 and 1 to 2 into buffers of its
+	 * own, as store_scanlines() stores X;
+	 * attrs.span(x, y, color, depth, z, first, n, left, right) fills the
+	 * n pixels of a row starting at (x, y): z interpolates the depths of the
+	 * whole row over its z.stepsvalue() pixels, left and right index the edge
+	 * buffers at its ends, and the n pixels are the ones from pixel first,
+	 * clipped to the screen. color and depth point to pixel first. It
+	 * returns the pixels passing the depth test.
+	 * z, as the span interpolators of attrs, is declared once per triangle
+	 * and set() again for every row; they skip() the first pixels.
+	 *
+	 * They are called directly, so that the whole row loop is inlined.
+	 */
+	template <class attributes>
+	void fill_triangle(m3d_vertex *vtx[3], attributes &attrs);
+
+	/*
+	 * Scanline depth pre-pass of a triangle with vertices sorted by y: only
+	 * the nearest depth is stored, no color is written.
+	 */
+	void triangle_fill_depth(m3d_vertex *vtx[3]);
+
 	/*
 	 * Return a pointer to the video memory buffer corresponding to screen coordinates (x0, y0)
 	 */
@@ -86,11 +324,213 @@ protected:
 
 	/*
 	 * Perform several algorithms.
-	 * Clears the visible objects list, then perform projection of all objects found in 'world'.
+	 * Clears the visible objects list, then perform projection of all objects found in 'world'
+	 * whose bounding volumes are inside the view frustum.
 	 * If any face of an object is visible, then the object is stored in the visible objects list.
 	 * The visible objects list is then sorted back to front and the Z buffer is reset.
+	 * Frame statistics are cleared.
 	 */
 	void compute_visible_list_and_sort(m3d_world &world);
+
+	/*
+	 * Compute ambient and diffuse lighting of the visible vertices of obj
+	 * into obj.vtxcolors, so that vertices shared by several triangles are lit once.
+	 * Vertices are split among the threads.
+	 */
+	void light_vertices(m3d_render_object &obj, m3d_world &world);
+
+	/*
+	 * Half-space rasterization of a frame.
+	 * raster_begin() clears the buffers, or starts clearing them on demand,
+	 * prepares the screen target and empties the bins. It selects the
+	 * visibility buffer for the frame: renderers then rasterize every
+	 * object with raster_object().
+	 * raster_submit() rasterizes a triangle set up by the renderer, or bins it
+	 * with RASTER_TILED, or keeps it for the depth pre-pass or the frame sort.
+	 * raster_end() sorts the triangles kept, rasterizes the tiles with
+	 * RASTER_TILED, or runs the depth pre-pass and then the shading pass of
+	 * the triangles kept, or shades
+	 * the visibility buffer, clears the tiles
+	 * drawn in the previous frame only, and adds the depth tests to the Z
+	 * buffer counters.
+	 * The scanline rasterizer uses them too, for the buffers.
+	 */
+	void raster_begin(void);
+	void raster_submit(const m3d_halfspace_setup &setup, m3d_world &world);
+	void raster_end(m3d_world &world);
+
+	/*
+	 * Return true if the frame being rendered is rasterized by the
+	 * half-space rasterizer: it is selected, or the visibility buffer or the
+	 * frame sort need it. To be called after raster_begin().
+	 */
+	bool halfspace_frame(void) const { return (rasterizer != RASTER_SCANLINE) || visibility || sorted; }
+
+	/*
+	 * With clear on demand, clear the color and depth of the tiles overlapping
+	 * the rectangle from (xs, ys) to (xe, ye), or the screen bounding box of
+	 * a triangle, if they were not cleared yet in this frame. To be called
+	 * before drawing into them.
+	 */
+	void prepare_area(int xs, int ys, int xe, int ye);
+	void prepare_triangle(m3d_vertex *vtx[3]);
+
+	/*
+	 * Set up the visible triangles of obj in parallel with setup_triangle(),
+	 * then submit them in order to the half-space rasterizer.
+	 */
+	void raster_object(m3d_render_object &obj, m3d_world &world);
+
+	/*
+	 * Set up a triangle of obj for the half-space rasterizer, renderers using
+	 * it override this. Return false if there is nothing to draw.
+	 * Called concurrently by the threads: it must not modify the renderer.
+	 */
+	virtual bool setup_triangle(m3d_render_object &obj, const m3d_triangle &triangle, m3d_halfspace_setup &setup);
+
+	/*
+	 * Rasterize the part of a triangle falling inside target, renderers using
+	 * the half-space rasterizer override it.
+	 * Called concurrently by the threads with RASTER_TILED: it must not
+	 * modify the renderer.
+	 */
+	virtual void raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world);
+
+	/*
+	 * Return true if the renderer supports SHADING_VISIBILITY: its
+	 * setup_triangle() and raster_halfspace() shade any run of pixels of a
+	 * triangle.
+	 */
+	virtual bool has_visibility(void) const;
+
+	/*
+	 * Collect the Z buffer counters into the frame statistics, and add them to the
+	 * accumulated statistics. To be called once per frame, after rasterization.
+	 */
+	void update_stats(void);
+
+private:
+	// Attributes of the scanline depth pre-pass
+	struct fill_depth;
+
+	/*
+	 * Return the number of visible triangles of obj, or M3D_OBJECT_CULLED if
+	 * it is outside the view frustum
+	 */
+	unsigned project_object(m3d_render_object &obj, m3d_world &world);
+
+	/*
+	 * Rasterize a triangle into target, unless the hierarchical Z rejects it,
+	 * then update the hierarchical Z where pixels were written. With
+	 * depthonly, rasterize only its depth with raster_depth().
+	 */
+	void raster_target(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world, bool depthonly = false);
+
+	/*
+	 * Depth pre-pass of a triangle, or its raster pass into the visibility
+	 * buffer: the rows are solved for the pixels inside rather than tested
+	 * pixel by pixel, and their depths stored by the span kernels, with the
+	 * same values of the Z plane the shading pass computes
+	 */
+	void raster_depth(const m3d_halfspace_setup &setup, m3d_halfspace_target &target);
+
+	/*
+	 * Add setups[index] to the bins of the tiles it overlaps
+	 */
+	void bin_setup(uint32_t index);
+
+	/*
+	 * Radix sort the setups of the frame front to back, or back to front
+	 * without Z buffer, return their indexes in order, or null if there is
+	 * not enough memory
+	 */
+	const uint32_t *sort_setups(void);
+
+	/*
+	 * Depth pre-pass of n triangles into target, then their shading pass
+	 * with the equal depth test. They are setups[indexes[i]], or the first n
+	 * setups if indexes is null.
+	 */
+	void raster_prepass(const uint32_t *indexes, size_t n, m3d_halfspace_target &target, m3d_world &world);
+
+	/*
+	 * Shade the pixels of the visibility buffer, split by blocks among the
+	 * threads
+	 */
+	void shade_visible(m3d_world &world);
+
+	/*
+	 * Shade the pixels of visibility buffer block index: every run of pixels
+	 * of a row with the same id is rasterized with the equal depth test, as
+	 * a target of its own
+	 */
+	void shade_visible_block(size_t index, unsigned thread, m3d_world &world);
+
+	/*
+	 * Light the visible vertices from first to last, excluded
+	 */
+	void light_range(m3d_render_object &obj, m3d_world &world, size_t first, size_t last);
+
+	/*
+	 * Fill the color of tile index black
+	 */
+	void clear_tile(unsigned index);
+
+	/*
+	 * Rasterize the bin of tile index on one of the threads
+	 */
+	void raster_tile(unsigned index, unsigned thread, m3d_world &world);
 };
 
+template <class attributes>
+void m3d_renderer::fill_triangle(m3d_vertex *vtx[3], attributes &attrs)
+{
+	unsigned runlen0 = (unsigned)(vtx[2]->scrposition.y - vtx[0]->scrposition.y + 1);
+	unsigned runlen1 = (unsigned)(vtx[1]->scrposition.y - vtx[0]->scrposition.y + 1);
+	unsigned runlen2 = (unsigned)(vtx[2]->scrposition.y - vtx[1]->scrposition.y + 1);
+	int16_t y = (int16_t)vtx[0]->scrposition.y;
+	unsigned left = 0, right = 0;
+	m3d_lerp_float sl;
+
+	M3D_PROFILE_SCOPE(STAGE_RASTER);
+
+	store_scanlines(runlen0, (int16_t)vtx[0]->scrposition.x, (int16_t)vtx[2]->scrposition.x);
+	store_scanlines(runlen1, (int16_t)vtx[0]->scrposition.x, (int16_t)vtx[1]->scrposition.x, runlen0);
+	store_scanlines(runlen2, (int16_t)vtx[1]->scrposition.x, (int16_t)vtx[2]->scrposition.x, runlen0 + runlen1 - 1);
+	store_zscanlines(runlen0, vtx[0]->prjposition[Z_C], vtx[2]->prjposition[Z_C]);
+	store_zscanlines(runlen1, vtx[0]->prjposition[Z_C], vtx[1]->prjposition[Z_C], runlen0);
+	store_zscanlines(runlen2, vtx[1]->prjposition[Z_C], vtx[2]->prjposition[Z_C], runlen0 + runlen1 - 1);
+	attrs.edges(vtx, runlen0, runlen1, runlen2);
+
+	/*
+	 * check x values to understand who's the left side and who's the right side.
+	 * runlen1 - 1 is the position of the scanline passing through point 1, the middle
+	 * point of the triangle projected to screen.
+	 */
+	if (scanline[runlen1 - 1] <= scanline[runlen0 + runlen1 - 1])
+		right = runlen0;
+	else
+		left = runlen0;
+
+	// Rows and spans are clipped to the screen, as m3d_halfspace_target::clip() does
+	for (unsigned row = 0; row < runlen0; row++, left++, right++, y++)
+	{
+		int xs = std::max((int)scanline[left], 0), xe = std::min((int)scanline[right], display->get_xmax() - 1);
+
+		if (y < 0)
+			continue;
+		if (y >= display->get_ymax())
+			break;
+		// Rows where the edges cross, or off the screen, have no pixels
+		if (xe < xs)
+			continue;
+
+		sl.set(scanline[right] - scanline[left] + 1, zscanline[left], zscanline[right]);
+		unsigned n = (unsigned)(xe - xs + 1);
+		unsigned passes = attrs.span((int16_t)xs, y, display->get_video_buffer(xs, y), zbuffer.get_zbuffer((int16_t)xs, y), sl, (unsigned)(xs - scanline[left]), n, left, right);
+
+		zbuffer.add_counters(n, passes);
+	}
+}
+
 #endif // M3D_RENDERER_H
@@ -19,6 +19,9 @@
 
 #include "m3d_renderer_flat.hh"
 #include "m3d_interp.hh"
+#include "m3d_span.hh"
+#include "m3d_halfspace.hh"
+#include "m3d_profiler.hh"
 
 static inline m3d_color m3d_average_light(m3d_render_color n[])
 {
@@ -39,107 +42,176 @@ static inline m3d_color m3d_average_light(m3d_render_color n[])
 
 void m3d_renderer_flat::render(m3d_world &world)
 {
-	unsigned i, j;
+	unsigned j;
 	m3d_vertex *vtx[3];
+	m3d_vertex scratch[3];
 	m3d_render_color colors[3];
 	m3d_color color;
 
+	M3D_PROFILE_FRAME();
+
 	// Compute visible objects
 	compute_visible_list_and_sort(world);
 
-	// Fill the surface black
-	display->clear_buffer();
+	raster_begin();
 
 	for (auto itro : vislist)
 	{
-		i = 0;
-		for (auto &triangle : itro->mesh)
+		light_vertices(*itro, world);
+
+		if (halfspace_frame())
 		{
-			if (itro->trivisible[i++])
+			raster_object(*itro, world);
+			continue;
+		}
+
+		for (auto index : itro->vistriangles)
+		{
+			const m3d_triangle &triangle = itro->mesh->triangles[index];
+
+			for (j = 0; j < 3; j++)
 			{
-				for (j = 0; j < 3; j++)
-				{
-					vtx[j] = &itro->vertices.at(triangle.index[j]);
-					m3d_illum::inst().ambient_lighting(*vtx[j], *itro, world, colors[j]);
-					m3d_illum::inst().diffuse_lighting(*vtx[j], *itro, world, colors[j]);
-				}
+				vtx[j] = itro->get_vertex(triangle.index[j], scratch[j]);
+				colors[j] = itro->vtxcolors[triangle.index[j]];
+			}
 
-				sort_triangle(vtx);
+			sort_triangle(vtx);
+			prepare_triangle(vtx);
 
-				color = m3d_average_light(colors);
+			color = m3d_average_light(colors);
 
-				triangle_fill_flat(vtx, color);
-			}
+			triangle_fill_flat(vtx, color);
+			frame_stats.triangles_rasterized++;
 		}
 	}
 
+	raster_end(world);
+	update_stats();
+
 	// Present the rendered lines
 	display->show_buffer();
 }
 
+/*
+ * A constant color
+ */
+struct m3d_renderer_flat::fill_flat
+{
+	const m3d_span &spans;
+	uint32_t rgb;
+
+	inline void edges(m3d_vertex *[], unsigned, unsigned, unsigned) {}
+
+	inline unsigned span(int16_t, int16_t, uint32_t *color, float *depth, const m3d_lerp_float &z, unsigned first, unsigned n, unsigned, unsigned)
+	{
+		return spans.flat(color, depth, n, z.at(first), z.deltavalue(), rgb);
+	}
+};
+
 void m3d_renderer_flat::triangle_fill_flat(m3d_vertex *vtx[], m3d_color &color)
 {
-	uint32_t *output;
-	float *outz;
-	float p0 = vtx[0]->prjposition[Z_C];
-	float p1 = vtx[1]->prjposition[Z_C];
-	float p2 = vtx[2]->prjposition[Z_C];
-	int16_t p3 = (int16_t)vtx[0]->scrposition.x;
-	int16_t p4 = (int16_t)vtx[1]->scrposition.x;
-	int16_t p5 = (int16_t)vtx[2]->scrposition.x;
-	unsigned runlen0 = (unsigned)(vtx[2]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen1 = (unsigned)(vtx[1]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen2 = (unsigned)(vtx[2]->scrposition.y - vtx[1]->scrposition.y + 1);
-	int fillrunlen;
-	int16_t y = (int16_t)vtx[0]->scrposition.y;
-	int16_t *lscanline, *rscanline;
-	float *lzscanline, *rzscanline;
-
-	store_scanlines(runlen0, p3, p5);
-	store_scanlines(runlen1, p3, p4, runlen0);
-	store_scanlines(runlen2, p4, p5, runlen0 + runlen1 - 1);
-	store_zscanlines(runlen0, p0, p2);
-	store_zscanlines(runlen1, p0, p1, runlen0);
-	store_zscanlines(runlen2, p1, p2, runlen0 + runlen1 - 1);
-
-	lscanline = rscanline = scanline;
-	lzscanline = rzscanline = zscanline;
-	/*
-	 * check x values to understand who's the left side and who's the right side.
-	 * runlen1 - 1 is the position of the scanline passing through point 1, the middle
-	 * point of the triangle projected to screen.
-	 */
-	if (scanline[runlen1 - 1] <= scanline[runlen0 + runlen1 - 1])
+	fill_flat attrs = {m3d_span::inst(), color.getColor()};
+
+	fill_triangle(vtx, attrs);
+}
+
+bool m3d_renderer_flat::setup_triangle(m3d_render_object &obj, const m3d_triangle &triangle, m3d_halfspace_setup &setup)
+{
+	m3d_vertex *vtx[3];
+	m3d_vertex scratch[3];
+	m3d_render_color colors[3];
+	m3d_color color;
+
+	for (unsigned j = 0; j < 3; j++)
 	{
-		rscanline += runlen0;
-		rzscanline += runlen0;
+		vtx[j] = obj.get_vertex(triangle.index[j], scratch[j]);
+		colors[j] = obj.vtxcolors[triangle.index[j]];
 	}
-	else
+
+	sort_triangle(vtx);
+
+	color = m3d_average_light(colors);
+
+	return setup_halfspace(vtx, color, setup);
+}
+
+bool m3d_renderer_flat::setup_halfspace(m3d_vertex *vtx[], m3d_color &color, m3d_halfspace_setup &setup)
+{
+	if (!setup.tri.setup(vtx, display->get_xmax(), display->get_ymax()))
+		return false;
+
+	setup.tri.plane(vtx[0]->prjposition[Z_C], vtx[1]->prjposition[Z_C], vtx[2]->prjposition[Z_C], setup.planes[0]);
+	setup.color = color.getColor();
+	setup.obj = nullptr;
+	return true;
+}
+
+void m3d_renderer_flat::raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world & /*world*/)
+{
+	const m3d_halfspace_triangle &tri = setup.tri;
+	const m3d_halfspace_plane &zp = setup.planes[0];
+	uint32_t *output;
+	float *outz;
+	int xs, ys, xe, ye;
+	int64_t e[3];
+
+	M3D_PROFILE_SCOPE(STAGE_RASTER);
+
+	if (!target.clip(tri, xs, ys, xe, ye))
+		return;
+
+	if (target.painter)
 	{
-		lscanline += runlen0;
-		lzscanline += runlen0;
+		const m3d_span &spans = m3d_span::inst();
+
+		// No depth to interpolate nor to test: the rows inside are solved and stored whole
+		for (int y = ys; y <= ye; y++)
+		{
+			int rs = xs, re = xe;
+
+			if (!tri.row_span(y, rs, re))
+				continue;
+			spans.fill(target.color_at(rs, y), setup.color, (size_t)(re - rs + 1));
+			target.passes += (unsigned long)(re - rs + 1);
+		}
+		return;
 	}
 
-	while (runlen0--)
+	for (int y = ys; y <= ye; y++)
 	{
-		fillrunlen = *rscanline - *lscanline + 1;
-		m3d_interpolation_float sl(fillrunlen, *lzscanline, *rzscanline);
-		output = display->get_video_buffer(*lscanline, y);
-		outz = zbuffer.get_zbuffer(*lscanline, y);
-		while (sl.finished() == false)
+		int rs = xs, re = xe;
+
+		// Drop the blocks at the ends of the row the hierarchical Z proves hidden
+		if (!target.hiz_span(tri, zp, y, rs, re))
+			continue;
+
+		tri.edges_at(rs, y, e);
+		int64_t w0 = e[0], w1 = e[1], w2 = e[2];
+		float zrow = zp.row(y - tri.miny);
+		bool entered = false;
+
+		output = target.color_at(rs, y);
+		outz = target.depth_at(rs, y);
+		for (int x = rs; x <= re; x++)
 		{
-			if (zbuffer.test_update(outz, sl.value()))
+			if (m3d_halfspace_triangle::inside(w0, w1, w2))
+			{
+				entered = true;
+				if (target.test_update(outz, zp.at(zrow, x - tri.minx)))
+				{
+					*output = setup.color;
+				}
+			}
+			else if (entered)
 			{
-				*output = color.getColor();
+				// Triangles are convex, the span is over
+				break;
 			}
+			w0 += tri.dx[0];
+			w1 += tri.dx[1];
+			w2 += tri.dx[2];
 			++output;
 			++outz;
-			sl.step();
 		}
-		lscanline++;
-		rscanline++;
-		lzscanline++;
-		rzscanline++;
-		y++;
 	}
 }
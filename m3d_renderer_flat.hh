@@ -35,7 +35,16 @@ public:
 	virtual void render(m3d_world &world);
 
 private:
+	// Attributes of the scanline fill
+	struct fill_flat;
+
 	void triangle_fill_flat(m3d_vertex *vtx[], m3d_color &color);
+	bool setup_halfspace(m3d_vertex *vtx[], m3d_color &color, m3d_halfspace_setup &setup);
+
+protected:
+	virtual bool setup_triangle(m3d_render_object &obj, const m3d_triangle &triangle, m3d_halfspace_setup &setup);
+	virtual void raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world);
+	virtual bool has_visibility(void) const { return true; }
 };
 
 #endif
@@ -19,6 +19,9 @@
 
 #include "m3d_renderer_gouraud.hh"
 #include "m3d_interp.hh"
+#include "m3d_span.hh"
+#include "m3d_halfspace.hh"
+#include "m3d_profiler.hh"
 
 /*
  * GOURAUD SHADING RENDERER
@@ -26,88 +29,131 @@
 
 void m3d_renderer_shaded_gouraud::store_cscanlines(unsigned runlen, m3d_color &val1, m3d_color &val2, unsigned start)
 {
-	m3d_interpolation_color run(runlen, val1, val2);
-	run.valuearray(cscanline + start);
+	m3d_lerp_color run;
+
+	run.set(runlen, val1, val2);
+	run.fill(run.stepsvalue(), cscanline + start);
 }
 
-void m3d_renderer_shaded_gouraud::triangle_fill_shaded(m3d_render_object &obj, m3d_vertex *vtx[], m3d_world &world)
+/*
+ * Colors lit on the vertices
+ */
+struct m3d_renderer_shaded_gouraud::fill_gouraud
+{
+	m3d_renderer_shaded_gouraud &r;
+	const m3d_span &spans;
+	m3d_lerp_color lint;
+
+	inline void edges(m3d_vertex *[], unsigned runlen0, unsigned runlen1, unsigned runlen2)
+	{
+		m3d_color c0 = r.colors[0].Kamb + r.colors[0].Kdiff;
+		m3d_color c1 = r.colors[1].Kamb + r.colors[1].Kdiff;
+		m3d_color c2 = r.colors[2].Kamb + r.colors[2].Kdiff;
+
+		r.store_cscanlines(runlen0, c0, c2);
+		r.store_cscanlines(runlen1, c0, c1, runlen0);
+		r.store_cscanlines(runlen2, c1, c2, runlen0 + runlen1 - 1);
+	}
+
+	inline unsigned span(int16_t, int16_t, uint32_t *color, float *depth, const m3d_lerp_float &z, unsigned first, unsigned n, unsigned left, unsigned right)
+	{
+		m3d_color ca(r.cscanline[left]), cb(r.cscanline[right]);
+
+		lint.set(z.stepsvalue(), ca, cb);
+		lint.skip(first);
+		return (r.prepass ? spans.gouraud_equal : spans.gouraud)(color, depth, n, z.at(first), z.deltavalue(), lint.span());
+	}
+};
+
+void m3d_renderer_shaded_gouraud::fill_object(m3d_render_object &obj, m3d_world & /*world*/)
+{
+	fill_gouraud attrs = {*this, m3d_span::inst(), {}};
+
+	fill_triangles(obj, attrs);
+}
+
+bool m3d_renderer_shaded_gouraud::setup_halfspace(m3d_render_object & /*obj*/, m3d_vertex *vtx[], struct m3d_render_color colors[], m3d_halfspace_setup &setup)
 {
-	uint32_t *output;
-	float *outz;
-	float p0 = vtx[0]->prjposition[Z_C];
-	float p1 = vtx[1]->prjposition[Z_C];
-	float p2 = vtx[2]->prjposition[Z_C];
-	int16_t p3 = (int16_t)vtx[0]->scrposition.x;
-	int16_t p4 = (int16_t)vtx[1]->scrposition.x;
-	int16_t p5 = (int16_t)vtx[2]->scrposition.x;
-	unsigned runlen0 = (unsigned)(vtx[2]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen1 = (unsigned)(vtx[1]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen2 = (unsigned)(vtx[2]->scrposition.y - vtx[1]->scrposition.y + 1);
 	m3d_color c0 = colors[0].Kamb + colors[0].Kdiff;
 	m3d_color c1 = colors[1].Kamb + colors[1].Kdiff;
 	m3d_color c2 = colors[2].Kamb + colors[2].Kdiff;
-	unsigned int fillrunlen;
-	int16_t y = (int16_t)vtx[0]->scrposition.y;
-	int16_t *lscanline, *rscanline;
-	float *lzscanline, *rzscanline;
-	uint32_t *lcscanline, *rcscanline;
-
-	store_scanlines(runlen0, p3, p5);
-	store_scanlines(runlen1, p3, p4, runlen0);
-	store_scanlines(runlen2, p4, p5, runlen0 + runlen1 - 1);
-	store_zscanlines(runlen0, p0, p2);
-	store_zscanlines(runlen1, p0, p1, runlen0);
-	store_zscanlines(runlen2, p1, p2, runlen0 + runlen1 - 1);
-	store_cscanlines(runlen0, c0, c2);
-	store_cscanlines(runlen1, c0, c1, runlen0);
-	store_cscanlines(runlen2, c1, c2, runlen0 + runlen1 - 1);
-
-	lscanline = rscanline = scanline;
-	lzscanline = rzscanline = zscanline;
-	lcscanline = rcscanline = cscanline;
-	/*
-	 * check x values to understand who's the left side and who's the right side.
-	 * runlen1 - 1 is the position of the scanline passing through point 1, the middle
-	 * point of the triangle projected to screen.
-	 */
-	if (scanline[runlen1 - 1] <= scanline[runlen0 + runlen1 - 1])
-	{
-		rscanline += runlen0;
-		rzscanline += runlen0;
-		rcscanline += runlen0;
-	}
-	else
+
+	if (!setup.tri.setup(vtx, display->get_xmax(), display->get_ymax()))
+		return false;
+
+	setup.tri.plane(vtx[0]->prjposition[Z_C], vtx[1]->prjposition[Z_C], vtx[2]->prjposition[Z_C], setup.planes[0]);
+	for (unsigned i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
 	{
-		lscanline += runlen0;
-		lzscanline += runlen0;
-		lcscanline += runlen0;
+		setup.tri.plane((float)c0.getChannel(i), (float)c1.getChannel(i), (float)c2.getChannel(i), setup.planes[1 + i]);
 	}
+	// Alpha is not interpolated
+	setup.color = c0.getColor();
+	setup.obj = nullptr;
+	return true;
+}
+
+void m3d_renderer_shaded_gouraud::raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world & /*world*/)
+{
+	const m3d_halfspace_triangle &tri = setup.tri;
+	const m3d_halfspace_plane &zp = setup.planes[0];
+	const m3d_halfspace_plane *cp = &setup.planes[1];
+	union m3d_color::m3d_color_channels pixel;
+	uint32_t *output;
+	float *outz;
+	int xs, ys, xe, ye;
+	int64_t e[3];
+	unsigned i;
 
-	while (runlen0--)
+	M3D_PROFILE_SCOPE(STAGE_RASTER);
+
+	pixel.color = setup.color;
+	if (!target.clip(tri, xs, ys, xe, ye))
+		return;
+
+	for (int y = ys; y <= ye; y++)
 	{
-		fillrunlen = *rscanline - *lscanline + 1;
-		m3d_interpolation_float sl(fillrunlen, *lzscanline, *rzscanline);
-		m3d_color ca(*lcscanline), cb(*rcscanline);
-		m3d_interpolation_color lint(fillrunlen, ca, cb);
-		output = display->get_video_buffer(*lscanline, y);
-		outz = zbuffer.get_zbuffer(*lscanline, y);
-		while (sl.finished() == false)
+		int rs = xs, re = xe;
+
+		// Drop the blocks at the ends of the row the hierarchical Z proves hidden
+		if (!target.hiz_span(tri, zp, y, rs, re))
+			continue;
+
+		tri.edges_at(rs, y, e);
+		int64_t w0 = e[0], w1 = e[1], w2 = e[2];
+		float zrow = zp.row(y - tri.miny);
+		float crow[3] = {cp[0].row(y - tri.miny), cp[1].row(y - tri.miny), cp[2].row(y - tri.miny)};
+		bool entered = false;
+
+		output = target.color_at(rs, y);
+		outz = target.depth_at(rs, y);
+		for (int x = rs; x <= re; x++)
 		{
-			if (zbuffer.test_update(outz, sl.value()))
+			if (m3d_halfspace_triangle::inside(w0, w1, w2))
+			{
+				int ox = x - tri.minx;
+
+				entered = true;
+				if (target.test_update(outz, zp.at(zrow, ox)))
+				{
+					for (i = m3d_color::B_CHANNEL; i < m3d_color::A_CHANNEL; i++)
+					{
+						float v = cp[i].at(crow[i], ox) + 0.5f;
+
+						pixel.channels[i] = (uint8_t)((v < 0.0f) ? 0.0f : ((v > 255.0f) ? 255.0f : v));
+					}
+					*output = pixel.color;
+				}
+			}
+			else if (entered)
 			{
-				*output = lint.value();
+				// Triangles are convex, the span is over
+				break;
 			}
+			w0 += tri.dx[0];
+			w1 += tri.dx[1];
+			w2 += tri.dx[2];
 			++output;
 			++outz;
-			sl.step();
-			lint.step();
 		}
-		lscanline++;
-		rscanline++;
-		lzscanline++;
-		rzscanline++;
-		lcscanline++;
-		rcscanline++;
-		y++;
 	}
 }
@@ -38,7 +38,14 @@ protected:
 	uint32_t *cscanline;
 
 	void store_cscanlines(unsigned runlen, m3d_color &val1, m3d_color &val2, unsigned start = 0);
-	virtual void triangle_fill_shaded(m3d_render_object &obj, m3d_vertex *vtx[], m3d_world &world);
+	virtual void fill_object(m3d_render_object &obj, m3d_world &world);
+	virtual bool setup_halfspace(m3d_render_object &obj, m3d_vertex *vtx[], struct m3d_render_color colors[], m3d_halfspace_setup &setup);
+	virtual void raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world);
+	virtual bool has_prepass(void) const { return true; }
+
+private:
+	// Attributes of the scanline fill
+	struct fill_gouraud;
 };
 
 #endif
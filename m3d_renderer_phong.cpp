@@ -19,114 +19,253 @@
 
 #include "m3d_renderer_phong.hh"
 #include "m3d_interp.hh"
+#include "m3d_span.hh"
+#include "m3d_halfspace.hh"
+#include "m3d_profiler.hh"
 
 /*
  * PHONG SHADING RENDERER
  */
 
+void m3d_renderer_shaded_phong::render(m3d_world &world)
+{
+	// The G-buffer takes memory only while deferred shading is selected
+	deferred = (shading == SHADING_DEFERRED) && gbuffer.allocate(display->get_xmax(), display->get_ymax());
+	if (!deferred && gbuffer.allocated())
+		gbuffer.release();
+
+	m3d_renderer_shaded::render(world);
+}
+
 void m3d_renderer_shaded_phong::store_vscanlines(unsigned runlen, m3d_vertex &val1, m3d_vertex &val2, unsigned start)
 {
-	m3d_interpolation_vector run(runlen, val1.tnormal, val2.tnormal);
-	run.valuearray(vscanline + start);
+	m3d_lerp_vector run;
+
+	run.set(runlen, val1.tnormal, val2.tnormal);
+	run.fill(run.stepsvalue(), vscanline + start);
 }
 
 void m3d_renderer_shaded_phong::store_wscanlines(unsigned runlen, m3d_vertex &val1, m3d_vertex &val2, unsigned start)
 {
-	m3d_interpolation_vector run(runlen, val1.tposition, val2.tposition);
-	run.valuearray(wscanline + start);
+	m3d_lerp_vector run;
+
+	run.set(runlen, val1.tposition, val2.tposition);
+	run.fill(run.stepsvalue(), wscanline + start);
 }
 
-void m3d_renderer_shaded_phong::triangle_fill_shaded(m3d_render_object &obj, m3d_vertex *vtx[], m3d_world &world)
+/*
+ * Normals and positions in world coordinates, lit on every pixel
+ */
+struct m3d_renderer_shaded_phong::fill_phong
 {
-	uint32_t *output;
-	float *outz;
-	float p0 = vtx[0]->prjposition[Z_C];
-	float p1 = vtx[1]->prjposition[Z_C];
-	float p2 = vtx[2]->prjposition[Z_C];
-	int16_t p3 = (int16_t)vtx[0]->scrposition.x;
-	int16_t p4 = (int16_t)vtx[1]->scrposition.x;
-	int16_t p5 = (int16_t)vtx[2]->scrposition.x;
-	unsigned runlen0 = (unsigned)(vtx[2]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen1 = (unsigned)(vtx[1]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen2 = (unsigned)(vtx[2]->scrposition.y - vtx[1]->scrposition.y + 1);
-	unsigned int fillrunlen;
-	int16_t y = (int16_t)vtx[0]->scrposition.y;
-	int16_t *lscanline, *rscanline;
-	float *lzscanline, *rzscanline;
-	m3d_vector *lvscanline, *rvscanline;
-	m3d_point *lwscanline, *rwscanline;
-
-	store_scanlines(runlen0, p3, p5);
-	store_scanlines(runlen1, p3, p4, runlen0);
-	store_scanlines(runlen2, p4, p5, runlen0 + runlen1 - 1);
-	store_zscanlines(runlen0, p0, p2);
-	store_zscanlines(runlen1, p0, p1, runlen0);
-	store_zscanlines(runlen2, p1, p2, runlen0 + runlen1 - 1);
-	store_vscanlines(runlen0, *vtx[0], *vtx[2]);
-	store_vscanlines(runlen1, *vtx[0], *vtx[1], runlen0);
-	store_vscanlines(runlen2, *vtx[1], *vtx[2], runlen0 + runlen1 - 1);
-	store_wscanlines(runlen0, *vtx[0], *vtx[2]);
-	store_wscanlines(runlen1, *vtx[0], *vtx[1], runlen0);
-	store_wscanlines(runlen2, *vtx[1], *vtx[2], runlen0 + runlen1 - 1);
-
-	lscanline = rscanline = scanline;
-	lzscanline = rzscanline = zscanline;
-	lvscanline = rvscanline = vscanline;
-	lwscanline = rwscanline = wscanline;
-	/*
-	 * check x values to understand who's the left side and who's the right side.
-	 * runlen1 - 1 is the position of the scanline passing through point 1, the middle
-	 * point of the triangle projected to screen.
-	 */
-	if (scanline[runlen1 - 1] <= scanline[runlen0 + runlen1 - 1])
+	m3d_renderer_shaded_phong &r;
+	const m3d_span &spans;
+	m3d_render_object &obj;
+	m3d_world &world;
+	m3d_lerp_vector norm, pts;
+
+	inline void edges(m3d_vertex *vtx[], unsigned runlen0, unsigned runlen1, unsigned runlen2)
 	{
-		rscanline += runlen0;
-		rzscanline += runlen0;
-		rvscanline += runlen0;
-		rwscanline += runlen0;
+		r.store_vscanlines(runlen0, *vtx[0], *vtx[2]);
+		r.store_vscanlines(runlen1, *vtx[0], *vtx[1], runlen0);
+		r.store_vscanlines(runlen2, *vtx[1], *vtx[2], runlen0 + runlen1 - 1);
+		r.store_wscanlines(runlen0, *vtx[0], *vtx[2]);
+		r.store_wscanlines(runlen1, *vtx[0], *vtx[1], runlen0);
+		r.store_wscanlines(runlen2, *vtx[1], *vtx[2], runlen0 + runlen1 - 1);
 	}
-	else
+
+	inline unsigned span(int16_t x, int16_t y, uint32_t *color, float *depth, const m3d_lerp_float &z, unsigned first, unsigned n, unsigned left, unsigned right)
 	{
-		lscanline += runlen0;
-		lzscanline += runlen0;
-		lvscanline += runlen0;
-		lwscanline += runlen0;
+		unsigned passes;
+
+		norm.set(z.stepsvalue(), r.vscanline[left], r.vscanline[right]);
+		pts.set(z.stepsvalue(), r.wscanline[left], r.wscanline[right]);
+		norm.skip(first);
+		pts.skip(first);
+
+		// Depth first, then the pixels passing the test are lit
+		passes = (r.prepass ? spans.depth_equal : spans.depth)(depth, n, z.at(first), z.deltavalue(), r.pscanline.data());
+		for (unsigned i = 0; i < n; i++)
+		{
+			if (r.pscanline[i] && r.deferred)
+			{
+				m3d_vector normal, position;
+
+				// Lit once by shade_pass()
+				norm.at(i, normal);
+				pts.at(i, position);
+				r.gbuffer.store(x + (int)i, y, normal.myvector, position.myvector, obj.color.getColor());
+			}
+			else if (r.pscanline[i])
+			{
+				m3d_vertex tmp;
+				pts.at(i, tmp.tposition);
+				norm.at(i, tmp.tnormal);
+				m3d_illum::inst().ambient_lighting(tmp, obj, world, r.colors[0]);
+				m3d_illum::inst().diffuse_lighting(tmp, obj, world, r.colors[0]);
+				m3d_illum::inst().specular_lighting(tmp, obj, world, r.colors[0]);
+				m3d_color total = r.colors[0].Kamb + r.colors[0].Kdiff + r.colors[0].Kspec;
+				color[i] = total.getColor();
+			}
+		}
+		return passes;
+	}
+};
+
+void m3d_renderer_shaded_phong::fill_object(m3d_render_object &obj, m3d_world &world)
+{
+	fill_phong attrs = {*this, m3d_span::inst(), obj, world, {}, {}};
+
+	fill_triangles(obj, attrs);
+}
+
+bool m3d_renderer_shaded_phong::setup_halfspace(m3d_render_object &obj, m3d_vertex *vtx[], struct m3d_render_color /*colors*/[], m3d_halfspace_setup &setup)
+{
+	if (!setup.tri.setup(vtx, display->get_xmax(), display->get_ymax()))
+		return false;
+
+	setup.tri.plane(vtx[0]->prjposition[Z_C], vtx[1]->prjposition[Z_C], vtx[2]->prjposition[Z_C], setup.planes[0]);
+	for (unsigned i = X_C; i <= Z_C; i++)
+	{
+		setup.tri.plane(vtx[0]->tnormal[i], vtx[1]->tnormal[i], vtx[2]->tnormal[i], setup.planes[1 + i]);
+		setup.tri.plane(vtx[0]->tposition[i], vtx[1]->tposition[i], vtx[2]->tposition[i], setup.planes[4 + i]);
 	}
+	setup.color = 0;
+	setup.obj = &obj;
+	return true;
+}
+
+void m3d_renderer_shaded_phong::raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world)
+{
+	const m3d_halfspace_triangle &tri = setup.tri;
+	const m3d_halfspace_plane &zp = setup.planes[0];
+	const m3d_halfspace_plane *np = &setup.planes[1];
+	const m3d_halfspace_plane *pp = &setup.planes[4];
+	// Lighting results are local, workers may run this concurrently
+	struct m3d_render_color light;
+	m3d_vertex tmp;
+	uint32_t *output;
+	float *outz;
+	int xs, ys, xe, ye;
+	int64_t e[3];
+	unsigned i;
+
+	M3D_PROFILE_SCOPE(STAGE_RASTER);
+
+	if (!target.clip(tri, xs, ys, xe, ye))
+		return;
 
-	while (runlen0--)
+	for (int y = ys; y <= ye; y++)
 	{
-		fillrunlen = *rscanline - *lscanline + 1;
-		m3d_interpolation_float sl(fillrunlen, *lzscanline, *rzscanline);
-		m3d_interpolation_vector norm(fillrunlen, *lvscanline, *rvscanline);
-		m3d_interpolation_vector pts(fillrunlen, *lwscanline, *rwscanline);
-		output = display->get_video_buffer(*lscanline, y);
-		outz = zbuffer.get_zbuffer(*lscanline, y);
-		while (sl.finished() == false)
+		int rs = xs, re = xe;
+
+		// Drop the blocks at the ends of the row the hierarchical Z proves hidden
+		if (!target.hiz_span(tri, zp, y, rs, re))
+			continue;
+
+		tri.edges_at(rs, y, e);
+		int64_t w0 = e[0], w1 = e[1], w2 = e[2];
+		float zrow = zp.row(y - tri.miny);
+		float nrow[3], prow[3];
+		bool entered = false;
+
+		for (i = X_C; i <= Z_C; i++)
 		{
-			if (zbuffer.test_update(outz, sl.value()))
+			nrow[i] = np[i].row(y - tri.miny);
+			prow[i] = pp[i].row(y - tri.miny);
+		}
+
+		output = target.color_at(rs, y);
+		outz = target.depth_at(rs, y);
+		for (int x = rs; x <= re; x++)
+		{
+			if (m3d_halfspace_triangle::inside(w0, w1, w2))
 			{
-				m3d_vertex tmp;
-				tmp.tposition = (m3d_point &)pts.value();
-				tmp.tnormal = norm.value();
-				m3d_illum::inst().ambient_lighting(tmp, obj, world, colors[0]);
-				m3d_illum::inst().diffuse_lighting(tmp, obj, world, colors[0]);
-				m3d_illum::inst().specular_lighting(tmp, obj, world, colors[0]);
-				m3d_color total = colors[0].Kamb + colors[0].Kdiff + colors[0].Kspec;
-				*output = total.getColor();
+				int ox = x - tri.minx;
+
+				entered = true;
+				if (target.test_update(outz, zp.at(zrow, ox)))
+				{
+					for (i = X_C; i <= Z_C; i++)
+					{
+						tmp.tnormal.myvector[i] = np[i].at(nrow[i], ox);
+						tmp.tposition.myvector[i] = pp[i].at(prow[i], ox);
+					}
+					if (deferred)
+					{
+						// Lit once by shade_pass()
+						gbuffer.store(x, y, tmp.tnormal.myvector, tmp.tposition.myvector, setup.obj->color.getColor());
+					}
+					else
+					{
+						m3d_illum::inst().ambient_lighting(tmp, *setup.obj, world, light);
+						m3d_illum::inst().diffuse_lighting(tmp, *setup.obj, world, light);
+						m3d_illum::inst().specular_lighting(tmp, *setup.obj, world, light);
+						m3d_color total = light.Kamb + light.Kdiff + light.Kspec;
+						*output = total.getColor();
+					}
+				}
 			}
+			else if (entered)
+			{
+				// Triangles are convex, the span is over
+				break;
+			}
+			w0 += tri.dx[0];
+			w1 += tri.dx[1];
+			w2 += tri.dx[2];
 			++output;
 			++outz;
-			sl.step();
-			norm.step();
 		}
-		lscanline++;
-		rscanline++;
-		lzscanline++;
-		rzscanline++;
-		lvscanline++;
-		rvscanline++;
-		lwscanline++;
-		rwscanline++;
-		y++;
 	}
-}
\ No newline at end of file
+}
+
+void m3d_renderer_shaded_phong::shade_pass(m3d_world &world)
+{
+	if (!deferred)
+		return;
+
+	jobs.parallel_for(0, gbuffer.block_count(), 1, [&](size_t first, size_t last, unsigned)
+			  {
+				  for (size_t i = first; i < last; i++)
+				  {
+					  if (gbuffer.block_written(i))
+						  shade_block(i, world);
+				  }
+			  });
+	gbuffer.invalidate();
+}
+
+void m3d_renderer_shaded_phong::shade_block(size_t index, m3d_world &world)
+{
+	// Lighting results are local, workers run this concurrently
+	struct m3d_render_color light;
+	m3d_vertex tmp;
+	uint32_t *output;
+	int xs, ys, xe, ye;
+
+	gbuffer.block_area(index, xs, ys, xe, ye);
+	for (int y = ys; y <= ye; y++)
+	{
+		output = screen.color_at(xs, y);
+		for (int x = xs; x <= xe; x++, output++)
+		{
+			const m3d_gbuffer_texel *texel = gbuffer.at(x, y);
+
+			if (!texel)
+				continue;
+
+			for (unsigned i = X_C; i <= Z_C; i++)
+			{
+				tmp.tnormal.myvector[i] = texel->normal[i];
+				tmp.tposition.myvector[i] = texel->position[i];
+			}
+			m3d_color color(texel->color);
+			m3d_illum::inst().ambient_lighting(tmp, color, world, light);
+			m3d_illum::inst().diffuse_lighting(tmp, color, world, light);
+			m3d_illum::inst().specular_lighting(tmp, color, world, light);
+			m3d_color total = light.Kamb + light.Kdiff + light.Kspec;
+			*output = total.getColor();
+		}
+	}
+}
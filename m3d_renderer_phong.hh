@@ -20,32 +20,60 @@
 #ifndef M3D_RENDERER_PHONG_H
 #define M3D_RENDERER_PHONG_H
 
+#include <vector>
+
 #include "m3d_renderer_shaded.hh"
+#include "m3d_gbuffer.hh"
 
 // Phong shading renderer
 class m3d_renderer_shaded_phong : public m3d_renderer_shaded
 {
 public:
 	/** Default constructor */
-	m3d_renderer_shaded_phong() : m3d_renderer_shaded() {};
-	m3d_renderer_shaded_phong(m3d_display *disp) : m3d_renderer_shaded(disp)
+	m3d_renderer_shaded_phong() : m3d_renderer_shaded(), vscanline(nullptr), wscanline(nullptr), deferred(false) {};
+	m3d_renderer_shaded_phong(m3d_display *disp) : m3d_renderer_shaded(disp), deferred(false)
 	{
 		vscanline = new m3d_vector[(unsigned)display->get_ymax() * 2];
 		wscanline = new m3d_point[(unsigned)display->get_ymax() * 2];
+		pscanline.assign((size_t)display->get_xmax(), 0);
 	};
 
 	/** Default destructor */
-	virtual ~m3d_renderer_shaded_phong() {};
+	virtual ~m3d_renderer_shaded_phong()
+	{
+		delete[] vscanline;
+		delete[] wscanline;
+	};
+
+	virtual void render(m3d_world &world);
 
 protected:
 	// The scanline normals buffer
 	m3d_vector *vscanline;
 	// The scanline world-coordinates buffer
 	m3d_point *wscanline;
+	// The pixels of a span passing the depth test, spans are clipped to the screen width
+	std::vector<uint8_t> pscanline;
+	// Deferred shading of the frame being rendered, and its G-buffer
+	bool deferred;
+	m3d_gbuffer gbuffer;
 
 	void store_vscanlines(unsigned runlen, m3d_vertex &val1, m3d_vertex &val2, unsigned start = 0);
 	void store_wscanlines(unsigned runlen, m3d_vertex &val1, m3d_vertex &val2, unsigned start = 0);
-	virtual void triangle_fill_shaded(m3d_render_object &obj, m3d_vertex *vtx[], m3d_world &world);
+	virtual void fill_object(m3d_render_object &obj, m3d_world &world);
+	virtual bool setup_halfspace(m3d_render_object &obj, m3d_vertex *vtx[], struct m3d_render_color colors[], m3d_halfspace_setup &setup);
+	virtual void raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world);
+	virtual void shade_pass(m3d_world &world);
+	virtual bool has_prepass(void) const { return true; }
+
+private:
+	// Attributes of the scanline fill
+	struct fill_phong;
+
+	/*
+	 * Light the pixels of G-buffer block index stored in this frame
+	 */
+	void shade_block(size_t index, m3d_world &world);
 };
 
 #endif
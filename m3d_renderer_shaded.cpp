@@ -19,6 +19,9 @@
 
 #include "m3d_renderer_shaded.hh"
 #include "m3d_interp.hh"
+#include "m3d_span.hh"
+#include "m3d_halfspace.hh"
+#include "m3d_profiler.hh"
 
 /*
  * SHADED RENDERER, WITH 1/z INTERPOLATION
@@ -26,120 +29,225 @@
 
 void m3d_renderer_shaded::render(m3d_world &world)
 {
-	unsigned i, j;
+	unsigned j;
 	m3d_vertex *vtx[3];
+	m3d_vertex scratch[3];
+
+	M3D_PROFILE_FRAME();
+
+	prepass = (shading == SHADING_PREPASS) && has_prepass();
 
 	compute_visible_list_and_sort(world);
 
-	// Fill the surface black
-	display->clear_buffer();
+	raster_begin();
 
-	for (auto itro : vislist)
+	if (prepass && !halfspace_frame())
 	{
-		i = 0;
-		for (auto &triangle : itro->mesh)
+		for (auto itro : vislist)
 		{
-			if (itro->trivisible[i++])
+			for (auto index : itro->vistriangles)
 			{
+				const m3d_triangle &triangle = itro->mesh->triangles[index];
+
 				for (j = 0; j < 3; j++)
 				{
-					vtx[j] = &itro->vertices.at(triangle.index[j]);
-					m3d_illum::inst().ambient_lighting(*vtx[j], *itro, world, colors[j]);
-					m3d_illum::inst().diffuse_lighting(*vtx[j], *itro, world, colors[j]);
+					vtx[j] = itro->get_vertex(triangle.index[j], scratch[j]);
 				}
 
-				sort_triangle(vtx, colors);
-
-				triangle_fill_shaded(*itro, vtx, world);
+				sort_triangle(vtx);
+				prepare_triangle(vtx);
+				triangle_fill_depth(vtx);
 			}
 		}
 	}
 
+	for (auto itro : vislist)
+	{
+		light_vertices(*itro, world);
+
+		if (halfspace_frame())
+			raster_object(*itro, world);
+		else
+			fill_object(*itro, world);
+	}
+
+	raster_end(world);
+	shade_pass(world);
+	update_stats();
+
 	// Present the rendered lines
 	display->show_buffer();
 }
 
+void m3d_renderer_shaded::shade_pass(m3d_world & /*world*/)
+{
+}
+
+bool m3d_renderer_shaded::has_prepass(void) const
+{
+	return false;
+}
+
 void m3d_renderer_shaded::store_iscanlines(unsigned runlen, float z1, float z2, float val1, float val2, unsigned start)
 {
-	m3d_interpolation_float_perspective run(runlen, z1, z2, val1, val2);
-	run.valuearray(iscanline + start);
+	m3d_lerp_perspective run;
+
+	run.set(runlen, z1, z2, val1, val2);
+	run.fill(run.stepsvalue(), iscanline + start);
 }
 
-void m3d_renderer_shaded::triangle_fill_shaded(m3d_render_object &obj, m3d_vertex *vtx[], m3d_world &world)
+/*
+ * Intensities with perspective correction, brightening the diffuse color
+ */
+struct m3d_renderer_shaded::fill_shaded
 {
-	uint32_t *output;
-	float *outz;
-	float p0 = vtx[0]->prjposition[Z_C];
-	float p1 = vtx[1]->prjposition[Z_C];
-	float p2 = vtx[2]->prjposition[Z_C];
-	int16_t p3 = (int16_t)vtx[0]->scrposition.x;
-	int16_t p4 = (int16_t)vtx[1]->scrposition.x;
-	int16_t p5 = (int16_t)vtx[2]->scrposition.x;
+	m3d_renderer_shaded &r;
+	const m3d_span &spans;
+	m3d_lerp_perspective sl;
+
+	inline void edges(m3d_vertex *vtx[], unsigned runlen0, unsigned runlen1, unsigned runlen2)
+	{
+		float p0 = vtx[0]->prjposition[Z_C];
+		float p1 = vtx[1]->prjposition[Z_C];
+		float p2 = vtx[2]->prjposition[Z_C];
+		float i0 = r.colors[0].ambint + r.colors[0].diffint;
+		float i1 = r.colors[1].ambint + r.colors[1].diffint;
+		float i2 = r.colors[2].ambint + r.colors[2].diffint;
+
+		r.store_iscanlines(runlen0, p0, p2, i0, i2);
+		r.store_iscanlines(runlen1, p0, p1, i0, i1, runlen0);
+		r.store_iscanlines(runlen2, p1, p2, i0, i2, runlen0 + runlen1 - 1);
+	}
+
+	inline unsigned span(int16_t, int16_t, uint32_t *color, float *depth, const m3d_lerp_float &z, unsigned first, unsigned n, unsigned left, unsigned right)
+	{
+		uint32_t rgb = r.colors[0].Kdiff.getColor();
+		unsigned passes = 0, count;
+
+		sl.set(z.stepsvalue(), r.zscanline[left], r.zscanline[right], r.iscanline[left], r.iscanline[right], r.perspective_run);
+		sl.skip(first);
+		if (r.perspective_run == 1)
+			return spans.shaded(color, depth, n, sl.span(), rgb);
+
+		// A run of pixels at a time, dividing only at its ends
+		for (unsigned i = 0; i < n; i += count)
+		{
+			m3d_span_perspective p = sl.run(i, count);
+
+			count = std::min(count, n - i);
+			passes += spans.shaded(color + i, depth + i, count, p, rgb);
+		}
+		return passes;
+	}
+};
+
+void m3d_renderer_shaded::fill_object(m3d_render_object &obj, m3d_world & /*world*/)
+{
+	fill_shaded attrs = {*this, m3d_span::inst(), {}};
+
+	fill_triangles(obj, attrs);
+}
+
+/*
+ * Vertices and colors are local: threads may set up triangles concurrently
+ */
+bool m3d_renderer_shaded::setup_triangle(m3d_render_object &obj, const m3d_triangle &triangle, m3d_halfspace_setup &setup)
+{
+	m3d_vertex *vtx[3];
+	m3d_vertex scratch[3];
+	struct m3d_render_color vtxcolors[3];
+
+	for (unsigned j = 0; j < 3; j++)
+	{
+		vtx[j] = obj.get_vertex(triangle.index[j], scratch[j]);
+		vtxcolors[j] = obj.vtxcolors[triangle.index[j]];
+	}
+
+	sort_triangle(vtx, vtxcolors);
+
+	return setup_halfspace(obj, vtx, vtxcolors, setup);
+}
+
+bool m3d_renderer_shaded::setup_halfspace(m3d_render_object & /*obj*/, m3d_vertex *vtx[], struct m3d_render_color colors[], m3d_halfspace_setup &setup)
+{
+	float z0 = vtx[0]->prjposition[Z_C];
+	float z1 = vtx[1]->prjposition[Z_C];
+	float z2 = vtx[2]->prjposition[Z_C];
 	float i0 = colors[0].ambint + colors[0].diffint;
 	float i1 = colors[1].ambint + colors[1].diffint;
 	float i2 = colors[2].ambint + colors[2].diffint;
-	unsigned runlen0 = (unsigned)(vtx[2]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen1 = (unsigned)(vtx[1]->scrposition.y - vtx[0]->scrposition.y + 1);
-	unsigned runlen2 = (unsigned)(vtx[2]->scrposition.y - vtx[1]->scrposition.y + 1);
-	int fillrunlen;
-	int16_t y = (int16_t)vtx[0]->scrposition.y;
-	int16_t *lscanline, *rscanline;
-	float *lzscanline, *rzscanline;
-	float *liscanline, *riscanline;
-
-	store_scanlines(runlen0, p3, p5);
-	store_scanlines(runlen1, p3, p4, runlen0);
-	store_scanlines(runlen2, p4, p5, runlen0 + runlen1 - 1);
-	store_zscanlines(runlen0, p0, p2);
-	store_zscanlines(runlen1, p0, p1, runlen0);
-	store_zscanlines(runlen2, p1, p2, runlen0 + runlen1 - 1);
-	store_iscanlines(runlen0, p0, p2, i0, i2);
-	store_iscanlines(runlen1, p0, p1, i0, i1, runlen0);
-	store_iscanlines(runlen2, p1, p2, i0, i2, runlen0 + runlen1 - 1);
-
-	lscanline = rscanline = scanline;
-	lzscanline = rzscanline = zscanline;
-	liscanline = riscanline = iscanline;
+
+	if (!setup.tri.setup(vtx, display->get_xmax(), display->get_ymax()))
+		return false;
+
 	/*
-	 * check x values to understand who's the left side and who's the right side.
-	 * runlen1 - 1 is the position of the scanline passing through point 1, the middle
-	 * point of the triangle projected to screen.
+	 * Z is linear on screen, the intensity is perspective correct: 1/z and i/z
+	 * are linear on screen, the intensity is their ratio.
 	 */
-	if (scanline[runlen1 - 1] <= scanline[runlen0 + runlen1 - 1])
-	{
-		rscanline += runlen0;
-		rzscanline += runlen0;
-		riscanline += runlen0;
-	}
-	else
-	{
-		lscanline += runlen0;
-		lzscanline += runlen0;
-		liscanline += runlen0;
-	}
+	setup.tri.plane(z0, z1, z2, setup.planes[0]);
+	setup.tri.plane(1.0f / z0, 1.0f / z1, 1.0f / z2, setup.planes[1]);
+	setup.tri.plane(i0 / z0, i1 / z1, i2 / z2, setup.planes[2]);
+	setup.color = colors[0].Kdiff.getColor();
+	setup.obj = nullptr;
+	return true;
+}
+
+void m3d_renderer_shaded::raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world & /*world*/)
+{
+	const m3d_halfspace_triangle &tri = setup.tri;
+	const m3d_halfspace_plane &zp = setup.planes[0];
+	const m3d_halfspace_plane &zinvp = setup.planes[1];
+	const m3d_halfspace_plane &ip = setup.planes[2];
+	m3d_color color(setup.color);
+	uint32_t *output;
+	float *outz;
+	int xs, ys, xe, ye;
+	int64_t e[3];
+
+	M3D_PROFILE_SCOPE(STAGE_RASTER);
 
-	while (runlen0--)
+	if (!target.clip(tri, xs, ys, xe, ye))
+		return;
+
+	for (int y = ys; y <= ye; y++)
 	{
-		fillrunlen = *rscanline - *lscanline + 1;
-		m3d_interpolation_float_perspective sl(fillrunlen, *lzscanline, *rzscanline, *liscanline, *riscanline);
-		output = display->get_video_buffer(*lscanline, y);
-		outz = zbuffer.get_zbuffer(*lscanline, y);
-		while (sl.finished() == false)
+		int rs = xs, re = xe;
+
+		// Drop the blocks at the ends of the row the hierarchical Z proves hidden
+		if (!target.hiz_span(tri, zp, y, rs, re))
+			continue;
+
+		tri.edges_at(rs, y, e);
+		int64_t w0 = e[0], w1 = e[1], w2 = e[2];
+		float zrow = zp.row(y - tri.miny);
+		float zinvrow = zinvp.row(y - tri.miny);
+		float irow = ip.row(y - tri.miny);
+		bool entered = false;
+
+		output = target.color_at(rs, y);
+		outz = target.depth_at(rs, y);
+		for (int x = rs; x <= re; x++)
 		{
-			if (zbuffer.test_update(outz, sl.value()))
+			if (m3d_halfspace_triangle::inside(w0, w1, w2))
+			{
+				int ox = x - tri.minx;
+
+				entered = true;
+				if (target.test_update(outz, zp.at(zrow, ox)))
+				{
+					*output = color.brighten2(ip.at(irow, ox) / zinvp.at(zinvrow, ox));
+				}
+			}
+			else if (entered)
 			{
-				*output = colors[0].Kdiff.brighten2(sl.value());
+				// Triangles are convex, the span is over
+				break;
 			}
+			w0 += tri.dx[0];
+			w1 += tri.dx[1];
+			w2 += tri.dx[2];
 			++output;
 			++outz;
-			sl.step();
 		}
-		lscanline++;
-		rscanline++;
-		lzscanline++;
-		rzscanline++;
-		liscanline++;
-		riscanline++;
-		y++;
 	}
 }
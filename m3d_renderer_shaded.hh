@@ -27,21 +27,92 @@ class m3d_renderer_shaded : public m3d_renderer
 {
 public:
 	/** Default constructor */
-	m3d_renderer_shaded() : m3d_renderer() {};
-	explicit m3d_renderer_shaded(m3d_display *disp) : m3d_renderer(disp) { iscanline = new float[(unsigned)display->get_ymax() * 2]; };
+	m3d_renderer_shaded() : m3d_renderer(), perspective_run(1) {};
+	explicit m3d_renderer_shaded(m3d_display *disp) : m3d_renderer(disp), perspective_run(1) { iscanline = new float[(unsigned)display->get_ymax() * 2]; };
 
 	/** Default destructor */
 	virtual ~m3d_renderer_shaded() { delete iscanline; };
 
 	virtual void render(m3d_world &world);
 
+	/*
+	 * Divide for the perspective correct intensities of the scanline spans
+	 * only once every n pixels, interpolating them linearly in between.
+	 * 1, the default, divides for every pixel; 8 or 16 are the usual choices,
+	 * the error growing with n and with the depth range of the spans.
+	 */
+	void set_perspective_run(unsigned n) { perspective_run = (n > 0) ? n : 1; }
+	unsigned get_perspective_run(void) const { return perspective_run; }
+
 protected:
 	// The scanline light intensity buffer
 	float *iscanline;
 	struct m3d_render_color colors[3];
+	// Pixels of the scanline spans per perspective division
+	unsigned perspective_run;
+
+	/*
+	 * Shade the pixels left to a separate pass, once the triangles are
+	 * rasterized and before the frame is shown. Renderers shading while
+	 * rasterizing do nothing.
+	 */
+	virtual void shade_pass(m3d_world &world);
+
+	/*
+	 * Return true if the renderer shades with the equal depth test after a
+	 * depth pre-pass when SHADING_PREPASS is selected. This renderer tests
+	 * intensities rather than depths, so it does not.
+	 */
+	virtual bool has_prepass(void) const;
 
 	void store_iscanlines(unsigned runlen, float z1, float z2, float val1, float val2, unsigned start = 0);
-	virtual void triangle_fill_shaded(m3d_render_object &obj, m3d_vertex *vtx[], m3d_world &world);
+
+	/*
+	 * Scanline fill of the visible triangles of obj. Renderers implement it
+	 * with fill_triangles() and their own attributes, so that there is a
+	 * single virtual call per object.
+	 */
+	virtual void fill_object(m3d_render_object &obj, m3d_world &world);
+
+	/*
+	 * Fill the visible triangles of obj with fill_triangle(), after loading
+	 * the lit colors of their vertices into colors
+	 */
+	template <class attributes>
+	void fill_triangles(m3d_render_object &obj, attributes &attrs);
+
+	virtual bool setup_triangle(m3d_render_object &obj, const m3d_triangle &triangle, m3d_halfspace_setup &setup);
+	virtual bool setup_halfspace(m3d_render_object &obj, m3d_vertex *vtx[], struct m3d_render_color colors[], m3d_halfspace_setup &setup);
+	virtual void raster_halfspace(const m3d_halfspace_setup &setup, m3d_halfspace_target &target, m3d_world &world);
+	virtual bool has_visibility(void) const { return true; }
+
+private:
+	// Attributes of the scanline fill
+	struct fill_shaded;
 };
 
+template <class attributes>
+void m3d_renderer_shaded::fill_triangles(m3d_render_object &obj, attributes &attrs)
+{
+	m3d_vertex *vtx[3];
+	m3d_vertex scratch[3];
+
+	for (auto index : obj.vistriangles)
+	{
+		const m3d_triangle &triangle = obj.mesh->triangles[index];
+
+		for (unsigned j = 0; j < 3; j++)
+		{
+			vtx[j] = obj.get_vertex(triangle.index[j], scratch[j]);
+			colors[j] = obj.vtxcolors[triangle.index[j]];
+		}
+
+		sort_triangle(vtx, colors);
+		prepare_triangle(vtx);
+
+		fill_triangle(vtx, attrs);
+		frame_stats.triangles_rasterized++;
+	}
+}
+
 #endif
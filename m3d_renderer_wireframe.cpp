@@ -18,6 +18,7 @@
  */
 
 #include "m3d_renderer_wireframe.hh"
+#include "m3d_profiler.hh"
 
 /*
  * WIREFRAME RENDERING
@@ -27,14 +28,16 @@ void m3d_renderer_wireframe::render(m3d_world &world)
 {
 	m3d_point temp;
 	m3d_color ctemp;
-	m3d_display_point toscreen[M3D_MAX_TRIANGLES * 3];
-	unsigned i, j, k;
+	unsigned j, k;
+
+	M3D_PROFILE_FRAME();
 
 	// Compute visible objects
 	compute_visible_list_and_sort(world);
 
 	// Fill the surface black
 	display->clear_renderer();
+	display->set_owner(this);
 	for (auto itro : vislist)
 	{
 		ctemp = itro->color;
@@ -42,22 +45,30 @@ void m3d_renderer_wireframe::render(m3d_world &world)
 				   ctemp.getChannel(m3d_color::G_CHANNEL),
 				   ctemp.getChannel(m3d_color::B_CHANNEL));
 
-		i = k = 0;
-		for (auto &triangle : itro->mesh)
+		// 4 points per triangle, the first point closes the outline
+		if (toscreen.size() < itro->vistriangles.size() * 4)
+		{
+			toscreen.resize(itro->vistriangles.size() * 4);
+		}
+
+		k = 0;
+		for (auto index : itro->vistriangles)
 		{
-			if (itro->trivisible[i++])
+			const m3d_triangle &triangle = itro->mesh->triangles[index];
+
+			for (j = 0; j < 3; j++)
 			{
-				for (j = 0; j < 3; j++)
-				{
-					toscreen[k++] = itro->vertices[triangle.index[j]].scrposition;
-				}
-				toscreen[k] = toscreen[k - 3];
-				k++;
+				toscreen[k++] = itro->get_scrposition(triangle.index[j]);
 			}
+			toscreen[k] = toscreen[k - 3];
+			k++;
+			frame_stats.triangles_rasterized++;
 		}
-		display->draw_lines(toscreen, k);
+		display->draw_lines(toscreen.data(), k);
 	}
 
+	update_stats();
+
 	// Present the rendered lines
 	display->show_renderer();
 }
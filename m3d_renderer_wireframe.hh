@@ -20,6 +20,8 @@
 #ifndef M3D_RENDERER_WIREFRAME_H
 #define M3D_RENDERER_WIREFRAME_H
 
+#include <vector>
+
 #include "m3d_renderer.hh"
 
 class m3d_renderer_wireframe : public m3d_renderer
@@ -33,6 +35,10 @@ public:
 	virtual ~m3d_renderer_wireframe() {};
 
 	virtual void render(m3d_world &world);
+
+private:
+	// Screen points of the outlines of the visible triangles of an object
+	std::vector<m3d_display_point> toscreen;
 };
 
 #endif
@@ -0,0 +1,1035 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bit>
+
+#include "m3d_span.hh"
+#include "m3d_color.hh"
+
+#if defined(M3D_CPU_X86)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+/*
+ * Scalar kernels, on the pixels from first to n excluded: the vector kernels
+ * use them for the pixels left over by the last full vector
+ */
+
+static inline float span_z(float z, float dz, unsigned i)
+{
+	return z + dz * (float)i;
+}
+
+static inline uint32_t span_color(const m3d_span_color &c, unsigned i)
+{
+	return c.alpha |
+	       (((c.acc[m3d_color::R_CHANNEL] + c.delta[m3d_color::R_CHANNEL] * i) >> 24) << m3d_color::R_SHIFT) |
+	       (((c.acc[m3d_color::G_CHANNEL] + c.delta[m3d_color::G_CHANNEL] * i) >> 24) << m3d_color::G_SHIFT) |
+	       (((c.acc[m3d_color::B_CHANNEL] + c.delta[m3d_color::B_CHANNEL] * i) >> 24) << m3d_color::B_SHIFT);
+}
+
+/*
+ * The depth test, with equal the one of the shading pass after a depth pre-pass
+ */
+template <bool equal>
+static inline bool span_test(float z, float old)
+{
+	return equal ? (z == old) : (z <= old);
+}
+
+static inline int16_t span_fixed(int32_t start, int32_t delta, unsigned i)
+{
+	// Wraps around as the stepped sums of m3d_interpolation_short
+	return (int16_t)((int32_t)((uint32_t)start + (uint32_t)delta * i + 0x8000u) >> 16);
+}
+
+static inline float span_intensity(const m3d_span_perspective &p, unsigned i)
+{
+	return (i == 0) ? p.first : (p.num + p.dnum * (float)i) / (p.den + p.dden * (float)i);
+}
+
+static unsigned flat_range(uint32_t *color, float *depth, unsigned first, unsigned n, float z, float dz, uint32_t rgb)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = first; i < n; i++)
+	{
+		float zi = span_z(z, dz, i);
+
+		if (zi <= depth[i])
+		{
+			depth[i] = zi;
+			color[i] = rgb;
+			passes++;
+		}
+	}
+	return passes;
+}
+
+template <bool equal>
+static unsigned gouraud_range(uint32_t *color, float *depth, unsigned first, unsigned n, float z, float dz, const m3d_span_color &c)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = first; i < n; i++)
+	{
+		float zi = span_z(z, dz, i);
+
+		if (span_test<equal>(zi, depth[i]))
+		{
+			depth[i] = zi;
+			color[i] = span_color(c, i);
+			passes++;
+		}
+	}
+	return passes;
+}
+
+static unsigned shaded_range(uint32_t *color, float *depth, unsigned first, unsigned n, const m3d_span_perspective &p, uint32_t rgb)
+{
+	m3d_color base(rgb);
+	unsigned passes = 0;
+
+	for (unsigned i = first; i < n; i++)
+	{
+		float vi = span_intensity(p, i);
+
+		if (vi <= depth[i])
+		{
+			depth[i] = vi;
+			color[i] = base.brighten2(vi);
+			passes++;
+		}
+	}
+	return passes;
+}
+
+template <bool equal>
+static unsigned depth_range(float *depth, unsigned first, unsigned n, float z, float dz, uint8_t *pass)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = first; i < n; i++)
+	{
+		float zi = span_z(z, dz, i);
+
+		pass[i] = span_test<equal>(zi, depth[i]) ? 1 : 0;
+		if (pass[i])
+		{
+			depth[i] = zi;
+			passes++;
+		}
+	}
+	return passes;
+}
+
+template <bool visible>
+static unsigned nearest_range(float *depth, uint32_t *ids, unsigned first, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = first; i < n; i++)
+	{
+		float zi = span_z(z, dz, offset + i);
+
+		if (zi <= depth[i])
+		{
+			depth[i] = zi;
+			if (visible)
+				ids[i] = id;
+			passes++;
+		}
+	}
+	return passes;
+}
+
+static void ramp_range(float *out, unsigned first, unsigned n, float start, float delta)
+{
+	for (unsigned i = first; i < n; i++)
+	{
+		out[i] = span_z(start, delta, i);
+	}
+}
+
+static void ramp_fixed_range(int16_t *out, unsigned first, unsigned n, int32_t start, int32_t delta)
+{
+	for (unsigned i = first; i < n; i++)
+	{
+		out[i] = span_fixed(start, delta, i);
+	}
+}
+
+static void fill_scalar(uint32_t *color, uint32_t value, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		color[i] = value;
+	}
+}
+
+static void fill_depth_scalar(float *depth, float value, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		depth[i] = value;
+	}
+}
+
+static unsigned flat_scalar(uint32_t *color, float *depth, unsigned n, float z, float dz, uint32_t rgb)
+{
+	return flat_range(color, depth, 0, n, z, dz, rgb);
+}
+
+template <bool equal>
+static unsigned gouraud_scalar(uint32_t *color, float *depth, unsigned n, float z, float dz, const m3d_span_color &c)
+{
+	return gouraud_range<equal>(color, depth, 0, n, z, dz, c);
+}
+
+static unsigned shaded_scalar(uint32_t *color, float *depth, unsigned n, const m3d_span_perspective &p, uint32_t rgb)
+{
+	return shaded_range(color, depth, 0, n, p, rgb);
+}
+
+template <bool equal>
+static unsigned depth_scalar(float *depth, unsigned n, float z, float dz, uint8_t *pass)
+{
+	return depth_range<equal>(depth, 0, n, z, dz, pass);
+}
+
+static unsigned nearest_scalar(float *depth, unsigned n, float z, float dz, unsigned offset)
+{
+	return nearest_range<false>(depth, nullptr, 0, n, z, dz, offset, 0);
+}
+
+static unsigned visible_scalar(uint32_t *ids, float *depth, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	return nearest_range<true>(depth, ids, 0, n, z, dz, offset, id);
+}
+
+static void ramp_scalar(float *out, unsigned n, float start, float delta)
+{
+	ramp_range(out, 0, n, start, delta);
+}
+
+static void ramp_fixed_scalar(int16_t *out, unsigned n, int32_t start, int32_t delta)
+{
+	ramp_fixed_range(out, 0, n, start, delta);
+}
+
+#if defined(M3D_CPU_X86)
+
+/*
+ * SSE4.1 kernels, 4 pixels at once. There are no masked stores: the pixels
+ * failing the depth test are stored back with their old values.
+ */
+
+M3D_TARGET("sse4.1")
+static inline __m128 sse41_index(unsigned i)
+{
+	return _mm_add_ps(_mm_set1_ps((float)i), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+}
+
+M3D_TARGET("sse4.1")
+static inline __m128i sse41_color(const m3d_span_color &c, unsigned i)
+{
+	__m128i index = _mm_add_epi32(_mm_set1_epi32((int)i), _mm_setr_epi32(0, 1, 2, 3));
+	__m128i out = _mm_set1_epi32((int)c.alpha);
+
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		__m128i acc = _mm_add_epi32(_mm_set1_epi32((int)c.acc[ch]), _mm_mullo_epi32(_mm_set1_epi32((int)c.delta[ch]), index));
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_srli_epi32(acc, 24), (int)ch * 8));
+	}
+	return out;
+}
+
+/*
+ * m3d_color::brighten2() of the channels rgb (as floats) by 4 intensities
+ */
+M3D_TARGET("sse4.1")
+static inline __m128i sse41_brighten(const __m128 rgb[3], __m128i alpha, __m128 intensity)
+{
+	// Negative intensities, -0.0 included, are 0
+	__m128 negative = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(intensity), 31));
+	__m128i out = alpha;
+
+	intensity = _mm_andnot_ps(negative, intensity);
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		__m128i v = _mm_cvttps_epi32(_mm_mul_ps(rgb[ch], intensity));
+
+		v = _mm_min_epi32(_mm_max_epi32(v, _mm_setzero_si128()), _mm_set1_epi32(UCHAR_MAX));
+		out = _mm_or_si128(out, _mm_slli_epi32(v, (int)ch * 8));
+	}
+	return out;
+}
+
+template <bool equal>
+M3D_TARGET("sse4.1")
+static inline __m128 sse41_test(__m128 z, __m128 oldz)
+{
+	return equal ? _mm_cmpeq_ps(z, oldz) : _mm_cmple_ps(z, oldz);
+}
+
+M3D_TARGET("sse4.1")
+static inline void sse41_store(uint32_t *color, float *depth, __m128 pass, __m128 z, __m128 oldz, __m128i c)
+{
+	__m128 oldc = _mm_loadu_ps((const float *)color);
+
+	_mm_storeu_ps(depth, _mm_blendv_ps(oldz, z, pass));
+	_mm_storeu_ps((float *)color, _mm_blendv_ps(oldc, _mm_castsi128_ps(c), pass));
+}
+
+M3D_TARGET("sse4.1")
+static unsigned flat_sse41(uint32_t *color, float *depth, unsigned n, float z, float dz, uint32_t rgb)
+{
+	__m128i c = _mm_set1_epi32((int)rgb);
+	unsigned passes = 0, i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 zi = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(_mm_set1_ps(dz), sse41_index(i)));
+		__m128 oldz = _mm_loadu_ps(depth + i);
+		__m128 pass = _mm_cmple_ps(zi, oldz);
+		int bits = _mm_movemask_ps(pass);
+
+		if (bits)
+		{
+			sse41_store(color + i, depth + i, pass, zi, oldz, c);
+			passes += (unsigned)popcount((unsigned)bits);
+		}
+	}
+	return passes + flat_range(color, depth, i, n, z, dz, rgb);
+}
+
+template <bool equal>
+M3D_TARGET("sse4.1")
+static unsigned gouraud_sse41(uint32_t *color, float *depth, unsigned n, float z, float dz, const m3d_span_color &c)
+{
+	unsigned passes = 0, i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 zi = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(_mm_set1_ps(dz), sse41_index(i)));
+		__m128 oldz = _mm_loadu_ps(depth + i);
+		__m128 pass = sse41_test<equal>(zi, oldz);
+		int bits = _mm_movemask_ps(pass);
+
+		if (bits)
+		{
+			sse41_store(color + i, depth + i, pass, zi, oldz, sse41_color(c, i));
+			passes += (unsigned)popcount((unsigned)bits);
+		}
+	}
+	return passes + gouraud_range<equal>(color, depth, i, n, z, dz, c);
+}
+
+M3D_TARGET("sse4.1")
+static unsigned shaded_sse41(uint32_t *color, float *depth, unsigned n, const m3d_span_perspective &p, uint32_t rgb)
+{
+	__m128 channels[3];
+	__m128i alpha = _mm_set1_epi32((int)(rgb & ((uint32_t)UCHAR_MAX << m3d_color::A_SHIFT)));
+	unsigned passes, i = 1;
+
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		channels[ch] = _mm_set1_ps((float)((rgb >> (ch * 8)) & UCHAR_MAX));
+	}
+
+	// Pixel 0 is not perspective corrected
+	passes = shaded_range(color, depth, 0, (n < 1) ? n : 1, p, rgb);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 index = sse41_index(i);
+		__m128 vi = _mm_div_ps(_mm_add_ps(_mm_set1_ps(p.num), _mm_mul_ps(_mm_set1_ps(p.dnum), index)),
+				       _mm_add_ps(_mm_set1_ps(p.den), _mm_mul_ps(_mm_set1_ps(p.dden), index)));
+		__m128 oldz = _mm_loadu_ps(depth + i);
+		__m128 pass = _mm_cmple_ps(vi, oldz);
+		int bits = _mm_movemask_ps(pass);
+
+		if (bits)
+		{
+			sse41_store(color + i, depth + i, pass, vi, oldz, sse41_brighten(channels, alpha, vi));
+			passes += (unsigned)popcount((unsigned)bits);
+		}
+	}
+	return passes + shaded_range(color, depth, i, n, p, rgb);
+}
+
+template <bool equal>
+M3D_TARGET("sse4.1")
+static unsigned depth_sse41(float *depth, unsigned n, float z, float dz, uint8_t *pass)
+{
+	unsigned passes = 0, i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 zi = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(_mm_set1_ps(dz), sse41_index(i)));
+		__m128 oldz = _mm_loadu_ps(depth + i);
+		__m128 test = sse41_test<equal>(zi, oldz);
+		unsigned bits = (unsigned)_mm_movemask_ps(test);
+
+		_mm_storeu_ps(depth + i, _mm_blendv_ps(oldz, zi, test));
+		for (unsigned k = 0; k < 4; k++)
+		{
+			pass[i + k] = (bits >> k) & 1;
+		}
+		passes += (unsigned)popcount(bits);
+	}
+	return passes + depth_range<equal>(depth, i, n, z, dz, pass);
+}
+
+template <bool visible>
+M3D_TARGET("sse4.1")
+static unsigned nearest_id_sse41(float *depth, uint32_t *ids, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	__m128 vz = _mm_set1_ps(z), vdz = _mm_set1_ps(dz);
+	__m128 vid = _mm_castsi128_ps(_mm_set1_epi32((int)id));
+	unsigned passes = 0, i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 zi = _mm_add_ps(vz, _mm_mul_ps(vdz, sse41_index(offset + i)));
+		__m128 oldz = _mm_loadu_ps(depth + i);
+		__m128 test = _mm_cmple_ps(zi, oldz);
+		int bits = _mm_movemask_ps(test);
+
+		_mm_storeu_ps(depth + i, _mm_blendv_ps(oldz, zi, test));
+		if (visible && bits)
+			_mm_storeu_ps((float *)(ids + i), _mm_blendv_ps(_mm_loadu_ps((const float *)(ids + i)), vid, test));
+		passes += (unsigned)popcount((unsigned)bits);
+	}
+	return passes + nearest_range<visible>(depth, ids, i, n, z, dz, offset, id);
+}
+
+M3D_TARGET("sse4.1")
+static unsigned nearest_sse41(float *depth, unsigned n, float z, float dz, unsigned offset)
+{
+	return nearest_id_sse41<false>(depth, nullptr, n, z, dz, offset, 0);
+}
+
+M3D_TARGET("sse4.1")
+static unsigned visible_sse41(uint32_t *ids, float *depth, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	return nearest_id_sse41<true>(depth, ids, n, z, dz, offset, id);
+}
+
+M3D_TARGET("sse4.1")
+static void ramp_sse41(float *out, unsigned n, float start, float delta)
+{
+	__m128 vstart = _mm_set1_ps(start), vdelta = _mm_set1_ps(delta);
+	unsigned i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_ps(out + i, _mm_add_ps(vstart, _mm_mul_ps(vdelta, sse41_index(i))));
+	}
+	ramp_range(out, i, n, start, delta);
+}
+
+M3D_TARGET("sse4.1")
+static void ramp_fixed_sse41(int16_t *out, unsigned n, int32_t start, int32_t delta)
+{
+	__m128i vstart = _mm_set1_epi32(start + 0x8000), vdelta = _mm_set1_epi32(delta);
+	unsigned i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i index = _mm_add_epi32(_mm_set1_epi32((int)i), _mm_setr_epi32(0, 1, 2, 3));
+		__m128i v = _mm_srai_epi32(_mm_add_epi32(vstart, _mm_mullo_epi32(vdelta, index)), 16);
+
+		_mm_storel_epi64((__m128i *)(out + i), _mm_packs_epi32(v, v));
+	}
+	ramp_fixed_range(out, i, n, start, delta);
+}
+
+M3D_TARGET("sse4.1")
+static void fill_sse41(uint32_t *color, uint32_t value, size_t n)
+{
+	__m128i v = _mm_set1_epi32((int)value);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_si128((__m128i *)(color + i), v);
+	}
+	fill_scalar(color + i, value, n - i);
+}
+
+M3D_TARGET("sse4.1")
+static void fill_depth_sse41(float *depth, float value, size_t n)
+{
+	__m128 v = _mm_set1_ps(value);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_ps(depth + i, v);
+	}
+	fill_depth_scalar(depth + i, value, n - i);
+}
+
+/*
+ * AVX2 kernels, 8 pixels at once. The last pixels are loaded and stored with
+ * a mask too.
+ */
+
+M3D_TARGET("avx2")
+static inline __m256 avx2_index(unsigned i)
+{
+	return _mm256_add_ps(_mm256_set1_ps((float)i), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+}
+
+// All ones in the lanes of the pixels before n
+M3D_TARGET("avx2")
+static inline __m256i avx2_lanes(unsigned i, unsigned n)
+{
+	return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(n - i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+M3D_TARGET("avx2")
+static inline __m256i avx2_color(const m3d_span_color &c, unsigned i)
+{
+	__m256i index = _mm256_add_epi32(_mm256_set1_epi32((int)i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i out = _mm256_set1_epi32((int)c.alpha);
+
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		__m256i acc = _mm256_add_epi32(_mm256_set1_epi32((int)c.acc[ch]), _mm256_mullo_epi32(_mm256_set1_epi32((int)c.delta[ch]), index));
+		out = _mm256_or_si256(out, _mm256_slli_epi32(_mm256_srli_epi32(acc, 24), (int)ch * 8));
+	}
+	return out;
+}
+
+M3D_TARGET("avx2")
+static inline __m256i avx2_brighten(const __m256 rgb[3], __m256i alpha, __m256 intensity)
+{
+	__m256 negative = _mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(intensity), 31));
+	__m256i out = alpha;
+
+	intensity = _mm256_andnot_ps(negative, intensity);
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		__m256i v = _mm256_cvttps_epi32(_mm256_mul_ps(rgb[ch], intensity));
+
+		v = _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), _mm256_set1_epi32(UCHAR_MAX));
+		out = _mm256_or_si256(out, _mm256_slli_epi32(v, (int)ch * 8));
+	}
+	return out;
+}
+
+/*
+ * Depth test of the pixels in lanes, return the mask of the pixels passing it
+ * after storing their depths
+ */
+template <bool equal = false>
+M3D_TARGET("avx2")
+static inline __m256i avx2_test(float *depth, __m256 z, __m256i lanes)
+{
+	__m256 oldz = _mm256_maskload_ps(depth, lanes);
+	__m256i pass = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, oldz, equal ? _CMP_EQ_OQ : _CMP_LE_OQ)), lanes);
+
+	_mm256_maskstore_ps(depth, pass, z);
+	return pass;
+}
+
+M3D_TARGET("avx2")
+static unsigned flat_avx2(uint32_t *color, float *depth, unsigned n, float z, float dz, uint32_t rgb)
+{
+	__m256i c = _mm256_set1_epi32((int)rgb);
+	unsigned passes = 0;
+
+	for (unsigned i = 0; i < n; i += 8)
+	{
+		__m256 zi = _mm256_add_ps(_mm256_set1_ps(z), _mm256_mul_ps(_mm256_set1_ps(dz), avx2_index(i)));
+		__m256i pass = avx2_test(depth + i, zi, avx2_lanes(i, n));
+
+		_mm256_maskstore_epi32((int *)(color + i), pass, c);
+		passes += (unsigned)popcount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(pass)));
+	}
+	return passes;
+}
+
+template <bool equal>
+M3D_TARGET("avx2")
+static unsigned gouraud_avx2(uint32_t *color, float *depth, unsigned n, float z, float dz, const m3d_span_color &c)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = 0; i < n; i += 8)
+	{
+		__m256 zi = _mm256_add_ps(_mm256_set1_ps(z), _mm256_mul_ps(_mm256_set1_ps(dz), avx2_index(i)));
+		__m256i pass = avx2_test<equal>(depth + i, zi, avx2_lanes(i, n));
+		unsigned bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(pass));
+
+		if (bits)
+		{
+			_mm256_maskstore_epi32((int *)(color + i), pass, avx2_color(c, i));
+			passes += (unsigned)popcount(bits);
+		}
+	}
+	return passes;
+}
+
+M3D_TARGET("avx2")
+static unsigned shaded_avx2(uint32_t *color, float *depth, unsigned n, const m3d_span_perspective &p, uint32_t rgb)
+{
+	__m256 channels[3];
+	__m256i alpha = _mm256_set1_epi32((int)(rgb & ((uint32_t)UCHAR_MAX << m3d_color::A_SHIFT)));
+	unsigned passes;
+
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		channels[ch] = _mm256_set1_ps((float)((rgb >> (ch * 8)) & UCHAR_MAX));
+	}
+
+	passes = shaded_range(color, depth, 0, (n < 1) ? n : 1, p, rgb);
+	for (unsigned i = 1; i < n; i += 8)
+	{
+		__m256 index = avx2_index(i);
+		__m256 vi = _mm256_div_ps(_mm256_add_ps(_mm256_set1_ps(p.num), _mm256_mul_ps(_mm256_set1_ps(p.dnum), index)),
+					  _mm256_add_ps(_mm256_set1_ps(p.den), _mm256_mul_ps(_mm256_set1_ps(p.dden), index)));
+		__m256i pass = avx2_test(depth + i, vi, avx2_lanes(i, n));
+		unsigned bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(pass));
+
+		if (bits)
+		{
+			_mm256_maskstore_epi32((int *)(color + i), pass, avx2_brighten(channels, alpha, vi));
+			passes += (unsigned)popcount(bits);
+		}
+	}
+	return passes;
+}
+
+template <bool equal>
+M3D_TARGET("avx2")
+static unsigned depth_avx2(float *depth, unsigned n, float z, float dz, uint8_t *pass)
+{
+	unsigned passes = 0, i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 zi = _mm256_add_ps(_mm256_set1_ps(z), _mm256_mul_ps(_mm256_set1_ps(dz), avx2_index(i)));
+		unsigned bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(avx2_test<equal>(depth + i, zi, _mm256_set1_epi32(-1))));
+
+		for (unsigned k = 0; k < 8; k++)
+		{
+			pass[i + k] = (bits >> k) & 1;
+		}
+		passes += (unsigned)popcount(bits);
+	}
+	return passes + depth_range<equal>(depth, i, n, z, dz, pass);
+}
+
+template <bool visible>
+M3D_TARGET("avx2")
+static unsigned nearest_id_avx2(float *depth, uint32_t *ids, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	__m256 vz = _mm256_set1_ps(z), vdz = _mm256_set1_ps(dz);
+	__m256i vid = _mm256_set1_epi32((int)id);
+	unsigned passes = 0, i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 zi = _mm256_add_ps(vz, _mm256_mul_ps(vdz, avx2_index(offset + i)));
+		__m256 oldz = _mm256_loadu_ps(depth + i);
+		__m256 test = _mm256_cmp_ps(zi, oldz, _CMP_LE_OQ);
+		unsigned bits = (unsigned)_mm256_movemask_ps(test);
+
+		_mm256_storeu_ps(depth + i, _mm256_blendv_ps(oldz, zi, test));
+		if (visible && bits)
+			_mm256_maskstore_epi32((int *)(ids + i), _mm256_castps_si256(test), vid);
+		passes += (unsigned)popcount(bits);
+	}
+	if (i < n)
+	{
+		__m256 zi = _mm256_add_ps(vz, _mm256_mul_ps(vdz, avx2_index(offset + i)));
+		__m256i pass = avx2_test(depth + i, zi, avx2_lanes(i, n));
+
+		if (visible)
+			_mm256_maskstore_epi32((int *)(ids + i), pass, vid);
+		passes += (unsigned)popcount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(pass)));
+	}
+	return passes;
+}
+
+M3D_TARGET("avx2")
+static unsigned nearest_avx2(float *depth, unsigned n, float z, float dz, unsigned offset)
+{
+	return nearest_id_avx2<false>(depth, nullptr, n, z, dz, offset, 0);
+}
+
+M3D_TARGET("avx2")
+static unsigned visible_avx2(uint32_t *ids, float *depth, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	return nearest_id_avx2<true>(depth, ids, n, z, dz, offset, id);
+}
+
+M3D_TARGET("avx2")
+static void ramp_avx2(float *out, unsigned n, float start, float delta)
+{
+	__m256 vstart = _mm256_set1_ps(start), vdelta = _mm256_set1_ps(delta);
+	unsigned i = 0;
+
+	for (; i < n; i += 8)
+	{
+		__m256 v = _mm256_add_ps(vstart, _mm256_mul_ps(vdelta, avx2_index(i)));
+
+		if (i + 8 <= n)
+			_mm256_storeu_ps(out + i, v);
+		else
+			_mm256_maskstore_ps(out + i, avx2_lanes(i, n), v);
+	}
+}
+
+M3D_TARGET("avx2")
+static void ramp_fixed_avx2(int16_t *out, unsigned n, int32_t start, int32_t delta)
+{
+	__m256i vstart = _mm256_set1_epi32(start + 0x8000), vdelta = _mm256_set1_epi32(delta);
+	unsigned i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i index = _mm256_add_epi32(_mm256_set1_epi32((int)i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i v = _mm256_srai_epi32(_mm256_add_epi32(vstart, _mm256_mullo_epi32(vdelta, index)), 16);
+
+		// The packs work on 128 bit lanes, gather the low halves of both
+		v = _mm256_permute4x64_epi64(_mm256_packs_epi32(v, v), 0x08);
+		_mm_storeu_si128((__m128i *)(out + i), _mm256_castsi256_si128(v));
+	}
+	ramp_fixed_range(out, i, n, start, delta);
+}
+
+M3D_TARGET("avx2")
+static void fill_avx2(uint32_t *color, uint32_t value, size_t n)
+{
+	__m256i v = _mm256_set1_epi32((int)value);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		_mm256_storeu_si256((__m256i *)(color + i), v);
+	}
+	if (i < n)
+	{
+		_mm256_maskstore_epi32((int *)(color + i), avx2_lanes(0, (unsigned)(n - i)), v);
+	}
+}
+
+M3D_TARGET("avx2")
+static void fill_depth_avx2(float *depth, float value, size_t n)
+{
+	__m256 v = _mm256_set1_ps(value);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		_mm256_storeu_ps(depth + i, v);
+	}
+	if (i < n)
+	{
+		_mm256_maskstore_ps(depth + i, avx2_lanes(0, (unsigned)(n - i)), v);
+	}
+}
+
+/*
+ * AVX-512 kernels, 16 pixels at once, with mask registers
+ */
+
+// GCC 12 headers leave the undefined sources of the AVX-512 intrinsics uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+M3D_TARGET("avx512f")
+static inline __m512 avx512_index(unsigned i)
+{
+	return _mm512_add_ps(_mm512_set1_ps((float)i), _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+								       8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f));
+}
+
+M3D_TARGET("avx512f")
+static inline __mmask16 avx512_lanes(unsigned i, unsigned n)
+{
+	return (n - i >= 16) ? (__mmask16)0xffff : (__mmask16)((1u << (n - i)) - 1);
+}
+
+M3D_TARGET("avx512f")
+static inline __m512i avx512_color(const m3d_span_color &c, unsigned i)
+{
+	__m512i index = _mm512_add_epi32(_mm512_set1_epi32((int)i), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	__m512i out = _mm512_set1_epi32((int)c.alpha);
+
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		__m512i acc = _mm512_add_epi32(_mm512_set1_epi32((int)c.acc[ch]), _mm512_mullo_epi32(_mm512_set1_epi32((int)c.delta[ch]), index));
+		out = _mm512_or_si512(out, _mm512_slli_epi32(_mm512_srli_epi32(acc, 24), ch * 8));
+	}
+	return out;
+}
+
+M3D_TARGET("avx512f")
+static inline __m512i avx512_brighten(const __m512 rgb[3], __m512i alpha, __m512 intensity)
+{
+	__mmask16 negative = _mm512_cmplt_epi32_mask(_mm512_castps_si512(intensity), _mm512_setzero_si512());
+	__m512i out = alpha;
+
+	intensity = _mm512_mask_mov_ps(intensity, negative, _mm512_setzero_ps());
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		__m512i v = _mm512_cvttps_epi32(_mm512_mul_ps(rgb[ch], intensity));
+
+		v = _mm512_min_epi32(_mm512_max_epi32(v, _mm512_setzero_si512()), _mm512_set1_epi32(UCHAR_MAX));
+		out = _mm512_or_si512(out, _mm512_slli_epi32(v, ch * 8));
+	}
+	return out;
+}
+
+template <bool equal = false>
+M3D_TARGET("avx512f")
+static inline __mmask16 avx512_test(float *depth, __m512 z, __mmask16 lanes)
+{
+	__m512 oldz = _mm512_maskz_loadu_ps(lanes, depth);
+	__mmask16 pass = _mm512_mask_cmp_ps_mask(lanes, z, oldz, equal ? _CMP_EQ_OQ : _CMP_LE_OQ);
+
+	_mm512_mask_storeu_ps(depth, pass, z);
+	return pass;
+}
+
+M3D_TARGET("avx512f")
+static unsigned flat_avx512(uint32_t *color, float *depth, unsigned n, float z, float dz, uint32_t rgb)
+{
+	__m512i c = _mm512_set1_epi32((int)rgb);
+	unsigned passes = 0;
+
+	for (unsigned i = 0; i < n; i += 16)
+	{
+		__m512 zi = _mm512_add_ps(_mm512_set1_ps(z), _mm512_mul_ps(_mm512_set1_ps(dz), avx512_index(i)));
+		__mmask16 pass = avx512_test(depth + i, zi, avx512_lanes(i, n));
+
+		_mm512_mask_storeu_epi32(color + i, pass, c);
+		passes += (unsigned)popcount((unsigned)pass);
+	}
+	return passes;
+}
+
+template <bool equal>
+M3D_TARGET("avx512f")
+static unsigned gouraud_avx512(uint32_t *color, float *depth, unsigned n, float z, float dz, const m3d_span_color &c)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = 0; i < n; i += 16)
+	{
+		__m512 zi = _mm512_add_ps(_mm512_set1_ps(z), _mm512_mul_ps(_mm512_set1_ps(dz), avx512_index(i)));
+		__mmask16 pass = avx512_test<equal>(depth + i, zi, avx512_lanes(i, n));
+
+		if (pass)
+		{
+			_mm512_mask_storeu_epi32(color + i, pass, avx512_color(c, i));
+			passes += (unsigned)popcount((unsigned)pass);
+		}
+	}
+	return passes;
+}
+
+M3D_TARGET("avx512f")
+static unsigned shaded_avx512(uint32_t *color, float *depth, unsigned n, const m3d_span_perspective &p, uint32_t rgb)
+{
+	__m512 channels[3];
+	__m512i alpha = _mm512_set1_epi32((int)(rgb & ((uint32_t)UCHAR_MAX << m3d_color::A_SHIFT)));
+	unsigned passes;
+
+	for (unsigned ch = m3d_color::B_CHANNEL; ch < m3d_color::A_CHANNEL; ch++)
+	{
+		channels[ch] = _mm512_set1_ps((float)((rgb >> (ch * 8)) & UCHAR_MAX));
+	}
+
+	passes = shaded_range(color, depth, 0, (n < 1) ? n : 1, p, rgb);
+	for (unsigned i = 1; i < n; i += 16)
+	{
+		__m512 index = avx512_index(i);
+		__m512 vi = _mm512_div_ps(_mm512_add_ps(_mm512_set1_ps(p.num), _mm512_mul_ps(_mm512_set1_ps(p.dnum), index)),
+					  _mm512_add_ps(_mm512_set1_ps(p.den), _mm512_mul_ps(_mm512_set1_ps(p.dden), index)));
+		__mmask16 pass = avx512_test(depth + i, vi, avx512_lanes(i, n));
+
+		if (pass)
+		{
+			_mm512_mask_storeu_epi32(color + i, pass, avx512_brighten(channels, alpha, vi));
+			passes += (unsigned)popcount((unsigned)pass);
+		}
+	}
+	return passes;
+}
+
+template <bool equal>
+M3D_TARGET("avx512f")
+static unsigned depth_avx512(float *depth, unsigned n, float z, float dz, uint8_t *pass)
+{
+	unsigned passes = 0;
+
+	for (unsigned i = 0; i < n; i += 16)
+	{
+		__m512 zi = _mm512_add_ps(_mm512_set1_ps(z), _mm512_mul_ps(_mm512_set1_ps(dz), avx512_index(i)));
+		__mmask16 lanes = avx512_lanes(i, n);
+		unsigned bits = (unsigned)avx512_test<equal>(depth + i, zi, lanes);
+
+		for (unsigned k = 0; (k < 16) && (i + k < n); k++)
+		{
+			pass[i + k] = (bits >> k) & 1;
+		}
+		passes += (unsigned)popcount(bits);
+	}
+	return passes;
+}
+
+template <bool visible>
+M3D_TARGET("avx512f")
+static unsigned nearest_id_avx512(float *depth, uint32_t *ids, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	__m512 vz = _mm512_set1_ps(z), vdz = _mm512_set1_ps(dz);
+	__m512i vid = _mm512_set1_epi32((int)id);
+	unsigned passes = 0, i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512 zi = _mm512_add_ps(vz, _mm512_mul_ps(vdz, avx512_index(offset + i)));
+		__mmask16 test = _mm512_cmp_ps_mask(zi, _mm512_loadu_ps(depth + i), _CMP_LE_OQ);
+
+		_mm512_mask_storeu_ps(depth + i, test, zi);
+		if (visible)
+			_mm512_mask_storeu_epi32(ids + i, test, vid);
+		passes += (unsigned)popcount((unsigned)test);
+	}
+	if (i < n)
+	{
+		__m512 zi = _mm512_add_ps(vz, _mm512_mul_ps(vdz, avx512_index(offset + i)));
+		__mmask16 pass = avx512_test(depth + i, zi, avx512_lanes(i, n));
+
+		if (visible)
+			_mm512_mask_storeu_epi32(ids + i, pass, vid);
+		passes += (unsigned)popcount((unsigned)pass);
+	}
+	return passes;
+}
+
+M3D_TARGET("avx512f")
+static unsigned nearest_avx512(float *depth, unsigned n, float z, float dz, unsigned offset)
+{
+	return nearest_id_avx512<false>(depth, nullptr, n, z, dz, offset, 0);
+}
+
+M3D_TARGET("avx512f")
+static unsigned visible_avx512(uint32_t *ids, float *depth, unsigned n, float z, float dz, unsigned offset, uint32_t id)
+{
+	return nearest_id_avx512<true>(depth, ids, n, z, dz, offset, id);
+}
+
+M3D_TARGET("avx512f")
+static void ramp_avx512(float *out, unsigned n, float start, float delta)
+{
+	__m512 vstart = _mm512_set1_ps(start), vdelta = _mm512_set1_ps(delta);
+
+	for (unsigned i = 0; i < n; i += 16)
+	{
+		_mm512_mask_storeu_ps(out + i, avx512_lanes(i, n), _mm512_add_ps(vstart, _mm512_mul_ps(vdelta, avx512_index(i))));
+	}
+}
+
+M3D_TARGET("avx512f")
+static void ramp_fixed_avx512(int16_t *out, unsigned n, int32_t start, int32_t delta)
+{
+	__m512i vstart = _mm512_set1_epi32(start + 0x8000), vdelta = _mm512_set1_epi32(delta);
+	__m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+	for (unsigned i = 0; i < n; i += 16)
+	{
+		__m512i index = _mm512_add_epi32(_mm512_set1_epi32((int)i), lanes);
+		__m512i v = _mm512_srai_epi32(_mm512_add_epi32(vstart, _mm512_mullo_epi32(vdelta, index)), 16);
+
+		// Truncated to 16 bits as the scalar casts
+		_mm512_mask_cvtepi32_storeu_epi16(out + i, avx512_lanes(i, n), v);
+	}
+}
+
+M3D_TARGET("avx512f")
+static void fill_avx512(uint32_t *color, uint32_t value, size_t n)
+{
+	__m512i v = _mm512_set1_epi32((int)value);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		_mm512_storeu_si512(color + i, v);
+	}
+	if (i < n)
+	{
+		_mm512_mask_storeu_epi32(color + i, avx512_lanes(0, (unsigned)(n - i)), v);
+	}
+}
+
+M3D_TARGET("avx512f")
+static void fill_depth_avx512(float *depth, float value, size_t n)
+{
+	__m512 v = _mm512_set1_ps(value);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		_mm512_storeu_ps(depth + i, v);
+	}
+	if (i < n)
+	{
+		_mm512_mask_storeu_ps(depth + i, avx512_lanes(0, (unsigned)(n - i)), v);
+	}
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static const m3d_span kernels[m3d_cpu::LEVEL_MAX] = {
+    {flat_scalar, gouraud_scalar<false>, gouraud_scalar<true>, shaded_scalar, depth_scalar<false>, depth_scalar<true>, nearest_scalar, visible_scalar, ramp_scalar, ramp_fixed_scalar, fill_scalar, fill_depth_scalar, m3d_cpu::LEVEL_SCALAR},
+    {flat_sse41, gouraud_sse41<false>, gouraud_sse41<true>, shaded_sse41, depth_sse41<false>, depth_sse41<true>, nearest_sse41, visible_sse41, ramp_sse41, ramp_fixed_sse41, fill_sse41, fill_depth_sse41, m3d_cpu::LEVEL_SSE41},
+    {flat_avx2, gouraud_avx2<false>, gouraud_avx2<true>, shaded_avx2, depth_avx2<false>, depth_avx2<true>, nearest_avx2, visible_avx2, ramp_avx2, ramp_fixed_avx2, fill_avx2, fill_depth_avx2, m3d_cpu::LEVEL_AVX2},
+    {flat_avx512, gouraud_avx512<false>, gouraud_avx512<true>, shaded_avx512, depth_avx512<false>, depth_avx512<true>, nearest_avx512, visible_avx512, ramp_avx512, ramp_fixed_avx512, fill_avx512, fill_depth_avx512, m3d_cpu::LEVEL_AVX512}};
+
+#else
+
+// Only the scalar kernels are used
+static const m3d_span kernels[1] = {
+    {flat_scalar, gouraud_scalar<false>, gouraud_scalar<true>, shaded_scalar, depth_scalar<false>, depth_scalar<true>, nearest_scalar, visible_scalar, ramp_scalar, ramp_fixed_scalar, fill_scalar, fill_depth_scalar, m3d_cpu::LEVEL_SCALAR}};
+
+#endif
+
+const m3d_span &m3d_span::get(unsigned level)
+{
+	static const unsigned supported = m3d_cpu::detect();
+
+	return kernels[(level < supported) ? level : supported];
+}
+
+const m3d_span &m3d_span::inst()
+{
+	return get(m3d_cpu::get_level());
+}
@@ -0,0 +1,125 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_SPAN_HH_INCLUDED
+#define M3D_SPAN_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include "m3d_cpu.hh"
+
+/*
+ * Colors of a Gouraud span, as m3d_interpolation_color: the channels in 8.24
+ * fixed point, and their increments per pixel. Pixel i has channel c
+ *
+ * (acc[c] + delta[c] * i) >> 24
+ *
+ * and the alpha of the left end.
+ */
+struct m3d_span_color
+{
+	uint32_t acc[3];
+	uint32_t delta[3];
+	uint32_t alpha;
+};
+
+/*
+ * Intensities of a span with perspective correction, as
+ * m3d_interpolation_float_perspective: pixel 0 has first, pixel i > 0 has
+ *
+ * (num + dnum * i) / (den + dden * i)
+ */
+struct m3d_span_perspective
+{
+	float first;
+	float num, dnum;
+	float den, dden;
+};
+
+/*
+ * Span kernels of the scanline rasterizer.
+ *
+ * A span is a run of n pixels of a row, color and depth point to its first
+ * pixel. The depth of pixel i is z + dz * i, computed from i rather than
+ * stepped, so that every kernel gets the same values whatever the number of
+ * pixels it processes at once. A pixel passing the depth test (not farther
+ * than the Z buffer) updates the Z buffer and the color; kernels return the
+ * number of pixels passing it.
+ *
+ * flat() writes the constant color rgb, gouraud() the interpolated colors,
+ * shaded() rgb brightened by the intensities as m3d_color::brighten2(), and
+ * tests them instead of z, as the scanline shaded renderer does. depth() only
+ * updates the Z buffer, and sets pass[i] to 1 for the pixels passing the
+ * test, 0 for the others.
+ * gouraud_equal() and depth_equal() are their variants for the shading pass
+ * after a depth pre-pass: a pixel passes only if its depth equals the Z
+ * buffer, so that only the nearest triangle shades it.
+ * nearest() is the depth pre-pass: it only keeps the nearest depth, and
+ * pixel i has depth z + dz * (offset + i), so that a span starting offset
+ * pixels into a row gets the same depths of the whole row. visible() also
+ * writes id into ids for the pixels passing the test, for the visibility buffer.
+ * ramp() stores the n values start + delta * i, ramp_fixed() the values of
+ * start + delta * i in 16.16 fixed point rounded to integers, as
+ * m3d_interpolation_short: they are the batch fills of the interpolators.
+ * fill() and fill_depth() set n colors or depths to value, to clear buffers.
+ *
+ * There is a table of kernels for every m3d_cpu level: SSE4.1 kernels process
+ * 4 pixels at once, AVX2 8 and AVX-512 16, with the depth test as a mask of
+ * the pixels to store. They give the same results of the scalar ones.
+ */
+class m3d_span
+{
+public:
+	typedef unsigned (*flat_t)(uint32_t *color, float *depth, unsigned n, float z, float dz, uint32_t rgb);
+	typedef unsigned (*gouraud_t)(uint32_t *color, float *depth, unsigned n, float z, float dz, const m3d_span_color &c);
+	typedef unsigned (*shaded_t)(uint32_t *color, float *depth, unsigned n, const m3d_span_perspective &p, uint32_t rgb);
+	typedef unsigned (*depth_t)(float *depth, unsigned n, float z, float dz, uint8_t *pass);
+	typedef unsigned (*nearest_t)(float *depth, unsigned n, float z, float dz, unsigned offset);
+	typedef unsigned (*visible_t)(uint32_t *ids, float *depth, unsigned n, float z, float dz, unsigned offset, uint32_t id);
+	typedef void (*ramp_t)(float *out, unsigned n, float start, float delta);
+	typedef void (*ramp_fixed_t)(int16_t *out, unsigned n, int32_t start, int32_t delta);
+	typedef void (*fill_t)(uint32_t *color, uint32_t value, size_t n);
+	typedef void (*fill_depth_t)(float *depth, float value, size_t n);
+
+	flat_t flat;
+	gouraud_t gouraud, gouraud_equal;
+	shaded_t shaded;
+	depth_t depth, depth_equal;
+	nearest_t nearest;
+	visible_t visible;
+	ramp_t ramp;
+	ramp_fixed_t ramp_fixed;
+	fill_t fill;
+	fill_depth_t fill_depth;
+	// The m3d_cpu level of the kernels
+	unsigned level;
+
+	/*
+	 * The kernels of the level in use, m3d_cpu::get_level()
+	 */
+	static const m3d_span &inst(void);
+
+	/*
+	 * The kernels of level, or of the widest level supported if level is not
+	 */
+	static const m3d_span &get(unsigned level);
+};
+
+#endif
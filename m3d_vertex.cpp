@@ -25,7 +25,7 @@ using namespace std;
 #include "m3d_vertex.hh"
 
 m3d_vertex::m3d_vertex(const m3d_vertex &other)
-    : position(other.position), normal(other.normal), tposition(other.tposition), tnormal(other.tnormal), prjposition(other.prjposition), prjnormal(other.prjnormal), scrposition(other.scrposition)
+    : tposition(other.tposition), tnormal(other.tnormal), prjposition(other.prjposition), prjnormal(other.prjnormal), scrposition(other.scrposition)
 {
 }
 
@@ -33,11 +33,7 @@ void m3d_vertex::print()
 {
 #ifdef DEBUG
 	cout << "* Vertex" << endl
-	     << "  Position ";
-	position.print();
-	cout << "  Normal   ";
-	normal.print();
-	cout << "  Position, transformed";
+	     << "  Position, transformed";
 	tposition.print();
 	cout << "  Normal, transformed   ";
 	tnormal.print();
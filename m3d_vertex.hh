@@ -22,26 +22,18 @@
 
 #include "m3d_math.hh"
 
+/*
+ * Transformed and projected attributes of a vertex, computed every frame.
+ * Positions and normals in object coordinates are stored in the mesh (m3d_mesh).
+ */
 class m3d_vertex
 {
 public:
-	m3d_vertex() : position(), normal() {};
+	m3d_vertex() : tposition(), tnormal() {};
 	~m3d_vertex() {};
-	m3d_vertex(const float coords[]) : position(coords) {};
 	m3d_vertex(const m3d_vertex &other);
 	void print(void);
 
-	/*
-	 * Vertex position in object coordinates.
-	 * Values are computed referring to the object's center.
-	 * World coordinates can be computed by adding the object's center.
-	 */
-	m3d_point position;
-	/*
-	 * Vertex normal in world coordinates.
-	 * Normalized vector (not positional).
-	 */
-	m3d_vector normal;
 	/*
 	 * Vertex position in world coordinates, transformed.
 	 */
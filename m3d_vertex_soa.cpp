@@ -0,0 +1,156 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <new>
+#include <cstring>
+#include <errno.h>
+
+#include "m3d_vertex_soa.hh"
+
+using namespace std;
+
+/*
+ * 3 attributes with 3 components, plus prjw, scrx, scry
+ */
+static const size_t soa_arrays = 3 * 3 + 3;
+static const size_t values_per_line = M3D_CACHE_LINE / sizeof(float);
+
+m3d_vertex_soa::m3d_vertex_soa() : prjw(nullptr), scrx(nullptr), scry(nullptr), count(0), stride(0), block(nullptr)
+{
+	tposition = tnormal = prjposition = {nullptr, nullptr, nullptr};
+}
+
+m3d_vertex_soa::m3d_vertex_soa(const m3d_vertex_soa &other) : m3d_vertex_soa()
+{
+	(*this) = other;
+}
+
+m3d_vertex_soa::~m3d_vertex_soa()
+{
+	release();
+}
+
+m3d_vertex_soa &m3d_vertex_soa::operator=(const m3d_vertex_soa &other)
+{
+	if (this == &other)
+	{
+		return (*this);
+	}
+
+	release();
+	if (other.block)
+	{
+		try
+		{
+			block = ::operator new(soa_arrays * other.stride * sizeof(float), align_val_t(M3D_CACHE_LINE));
+		}
+		catch (const bad_alloc &e)
+		{
+			cerr << "Out of memory " << e.what() << endl;
+			return (*this);
+		}
+		count = other.count;
+		stride = other.stride;
+		memcpy(block, other.block, soa_arrays * stride * sizeof(float));
+		map();
+	}
+
+	return (*this);
+}
+
+int m3d_vertex_soa::create(size_t n)
+{
+	release();
+
+	count = n;
+	stride = (count + values_per_line - 1) & ~(values_per_line - 1);
+	try
+	{
+		block = ::operator new(soa_arrays * stride * sizeof(float), align_val_t(M3D_CACHE_LINE));
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		count = stride = 0;
+		return (ENOMEM);
+	}
+	// Padding values are processed by the SIMD kernels, keep them clean
+	memset(block, 0, soa_arrays * stride * sizeof(float));
+	map();
+
+	return (0);
+}
+
+void m3d_vertex_soa::release()
+{
+	if (block)
+	{
+		::operator delete(block, align_val_t(M3D_CACHE_LINE));
+	}
+	block = nullptr;
+	count = stride = 0;
+	map();
+}
+
+void m3d_vertex_soa::gather(size_t idx, m3d_vertex &vtx) const
+{
+	vtx.tposition[X_C] = tposition.x[idx];
+	vtx.tposition[Y_C] = tposition.y[idx];
+	vtx.tposition[Z_C] = tposition.z[idx];
+	vtx.tposition[T_C] = 1.0f;
+	vtx.tnormal[X_C] = tnormal.x[idx];
+	vtx.tnormal[Y_C] = tnormal.y[idx];
+	vtx.tnormal[Z_C] = tnormal.z[idx];
+	vtx.tnormal[T_C] = 0.0f;
+	vtx.prjposition[X_C] = prjposition.x[idx];
+	vtx.prjposition[Y_C] = prjposition.y[idx];
+	vtx.prjposition[Z_C] = prjposition.z[idx];
+	vtx.prjposition[T_C] = prjw[idx];
+	vtx.scrposition.x = scrx[idx];
+	vtx.scrposition.y = scry[idx];
+}
+
+void m3d_vertex_soa::map()
+{
+	float *base = (float *)block;
+	m3d_soa_vector *attributes[] = {&tposition, &tnormal, &prjposition};
+
+	if (!block)
+	{
+		for (auto it : attributes)
+		{
+			it->x = it->y = it->z = nullptr;
+		}
+		prjw = nullptr;
+		scrx = scry = nullptr;
+		return;
+	}
+
+	for (auto it : attributes)
+	{
+		it->x = base;
+		it->y = base + stride;
+		it->z = base + 2 * stride;
+		base += 3 * stride;
+	}
+	prjw = base;
+	scrx = (int *)(base + stride);
+	scry = (int *)(base + 2 * stride);
+}
@@ -0,0 +1,102 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_VERTEX_SOA_H
+#define M3D_VERTEX_SOA_H
+
+#include <cstddef>
+
+#include "m3d_vertex.hh"
+
+/*
+ * X, Y, Z components of a vertex attribute, one array per component.
+ */
+struct m3d_soa_vector
+{
+	float *x;
+	float *y;
+	float *z;
+};
+
+/*
+ * Vertex storage as a structure of arrays.
+ * Every attribute is split into separate arrays of components, so that a
+ * pipeline stage streams from memory only the attributes it uses, and the
+ * batch kernels process several vertices per instruction.
+ * All arrays live in a single block; every array is aligned to M3D_CACHE_LINE
+ * and padded to a whole number of cache lines.
+ * T components are implicit: 1.0f for positions, 0.0f for normals.
+ * Positions and normals in object coordinates are stored in the mesh.
+ */
+class m3d_vertex_soa
+{
+public:
+	m3d_vertex_soa();
+	m3d_vertex_soa(const m3d_vertex_soa &other);
+	~m3d_vertex_soa();
+
+	m3d_vertex_soa &operator=(const m3d_vertex_soa &other);
+
+	/*
+	 * Allocate the arrays for n vertices, values are cleared.
+	 * Return ENOMEM if out of memory.
+	 */
+	int create(size_t n);
+
+	/*
+	 * Free the arrays
+	 */
+	void release(void);
+
+	size_t size(void) const { return count; }
+
+	/*
+	 * Copy the transformed, projected and screen attributes of vertex idx into vtx,
+	 * these are the attributes used by lighting and rasterization.
+	 */
+	void gather(size_t idx, m3d_vertex &vtx) const;
+
+	/*
+	 * Vertex position and normal in world coordinates, transformed
+	 */
+	m3d_soa_vector tposition;
+	m3d_soa_vector tnormal;
+	/*
+	 * Vertex position in projected homogeneous coordinates, the T component is prjw
+	 */
+	m3d_soa_vector prjposition;
+	float *prjw;
+	/*
+	 * Screen coordinates for prjposition
+	 */
+	int *scrx;
+	int *scry;
+
+private:
+	/*
+	 * Point the arrays inside block
+	 */
+	void map(void);
+
+	// Number of vertices, and array length in elements including padding
+	size_t count, stride;
+	void *block;
+};
+
+#endif // M3D_VERTEX_SOA_H
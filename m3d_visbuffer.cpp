@@ -0,0 +1,99 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#include "m3d_visbuffer.hh"
+#include "m3d_span.hh"
+
+using namespace std;
+
+bool m3d_visbuffer::allocate(int newxres, int newyres)
+{
+	if (allocated() && (newxres == xres) && (newyres == yres))
+		return true;
+
+	xres = newxres;
+	yres = newyres;
+	pitch = (xres + M3D_VISBUFFER_BLOCK - 1) / M3D_VISBUFFER_BLOCK;
+	try
+	{
+		ids.resize((size_t)xres * (size_t)yres);
+		// Epoch 0 is never current
+		blocks.assign((size_t)pitch * (size_t)((yres + M3D_VISBUFFER_BLOCK - 1) / M3D_VISBUFFER_BLOCK), 0);
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		release();
+		return false;
+	}
+	epoch = 1;
+	return true;
+}
+
+void m3d_visbuffer::release()
+{
+	vector<uint32_t>().swap(ids);
+	vector<uint32_t>().swap(blocks);
+	xres = yres = pitch = 0;
+}
+
+void m3d_visbuffer::invalidate()
+{
+	if (++epoch == 0)
+	{
+		// Blocks prepared 2^32 epochs ago would look current
+		fill(blocks.begin(), blocks.end(), 0);
+		epoch = 1;
+	}
+}
+
+void m3d_visbuffer::prepare(int xs, int ys, int xe, int ye)
+{
+	const m3d_span &spans = m3d_span::inst();
+
+	for (int by = ys / M3D_VISBUFFER_BLOCK; by <= ye / M3D_VISBUFFER_BLOCK; by++)
+	{
+		for (int bx = xs / M3D_VISBUFFER_BLOCK; bx <= xe / M3D_VISBUFFER_BLOCK; bx++)
+		{
+			size_t index = (size_t)(by * pitch + bx);
+			int x0, y0, x1, y1;
+
+			if (blocks[index] == epoch)
+				continue;
+
+			block_area(index, x0, y0, x1, y1);
+			for (int y = y0; y <= y1; y++)
+			{
+				spans.fill(at(x0, y), M3D_VISBUFFER_NONE, (size_t)(x1 - x0 + 1));
+			}
+			blocks[index] = epoch;
+		}
+	}
+}
+
+void m3d_visbuffer::block_area(size_t index, int &xs, int &ys, int &xe, int &ye) const
+{
+	xs = (int)(index % (size_t)pitch) * M3D_VISBUFFER_BLOCK;
+	ys = (int)(index / (size_t)pitch) * M3D_VISBUFFER_BLOCK;
+	xe = min(xs + M3D_VISBUFFER_BLOCK, xres) - 1;
+	ye = min(ys + M3D_VISBUFFER_BLOCK, yres) - 1;
+}
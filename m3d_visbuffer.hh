@@ -0,0 +1,116 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef M3D_VISBUFFER_HH_INCLUDED
+#define M3D_VISBUFFER_HH_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Side in pixels of the square blocks of the visibility buffer
+ */
+#define M3D_VISBUFFER_BLOCK (32)
+
+/*
+ * Bits of an id holding the triangle index in the mesh, the others hold the
+ * object. The id with all bits set marks the pixels no triangle covers.
+ */
+#define M3D_VISBUFFER_TRIANGLE_BITS (20)
+#define M3D_VISBUFFER_NONE (~0u)
+
+/*
+ * Visibility buffer: the rasterizer stores the id of the nearest triangle of
+ * every pixel, packed from the number of its object in the frame and its
+ * index in the mesh, and the depth into the Z buffer. Every pixel is then
+ * shaded once, from the triangle rebuilt from its id. 4 bytes per pixel
+ * instead of the attributes of a G-buffer.
+ *
+ * It is never cleared as a whole: prepare() fills with M3D_VISBUFFER_NONE
+ * the blocks of M3D_VISBUFFER_BLOCK * M3D_VISBUFFER_BLOCK pixels about to be
+ * written for the first time in the current epoch, and invalidate() starts a
+ * new epoch. A block not written in the current epoch has no pixel to shade.
+ */
+class m3d_visbuffer
+{
+public:
+	m3d_visbuffer() : xres(0), yres(0), pitch(0), epoch(1) {}
+
+	/*
+	 * Largest number of objects, and of triangles in a mesh, ids can pack
+	 */
+	static const unsigned max_objects = (M3D_VISBUFFER_NONE >> M3D_VISBUFFER_TRIANGLE_BITS);
+	static const unsigned max_triangles = (1u << M3D_VISBUFFER_TRIANGLE_BITS);
+
+	static inline uint32_t pack(unsigned object, unsigned triangle) { return ((uint32_t)object << M3D_VISBUFFER_TRIANGLE_BITS) | triangle; }
+	static inline unsigned object(uint32_t id) { return id >> M3D_VISBUFFER_TRIANGLE_BITS; }
+	static inline unsigned triangle(uint32_t id) { return id & (max_triangles - 1); }
+
+	/*
+	 * Allocate the buffer for xres * yres pixels, if not done yet.
+	 * Return false if there is not enough memory.
+	 */
+	bool allocate(int xres, int yres);
+
+	/*
+	 * Release the memory, until the next allocate()
+	 */
+	void release(void);
+
+	bool allocated(void) const { return !ids.empty(); }
+
+	/*
+	 * Start a new epoch: all the blocks become stale
+	 */
+	void invalidate(void);
+
+	/*
+	 * Empty the stale blocks overlapping the rectangle from (xs, ys) to
+	 * (xe, ye), to be called before writing ids into it
+	 */
+	void prepare(int xs, int ys, int xe, int ye);
+
+	/*
+	 * The ids of row y, from pixel x
+	 */
+	inline uint32_t *at(int x, int y) { return ids.data() + (size_t)y * (size_t)xres + (size_t)x; }
+
+	/*
+	 * Number of blocks, and whether block index was written in the current
+	 * epoch. Blocks are numbered by rows.
+	 */
+	size_t block_count(void) const { return blocks.size(); }
+	inline bool block_written(size_t index) const { return blocks[index] == epoch; }
+
+	/*
+	 * Pixels of block index, limits are included
+	 */
+	void block_area(size_t index, int &xs, int &ys, int &xe, int &ye) const;
+
+private:
+	std::vector<uint32_t> ids;
+	// Epoch of the last prepare() of every block, and the current epoch
+	std::vector<uint32_t> blocks;
+	int xres, yres;
+	// Blocks in a row
+	int pitch;
+	uint32_t epoch;
+};
+
+#endif
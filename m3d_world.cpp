@@ -20,6 +20,7 @@
 #include <iostream>
 
 #include "m3d_world.hh"
+#include "m3d_profiler.hh"
 
 using namespace std;
 
@@ -79,6 +80,8 @@ void m3d_world::sort(list<m3d_render_object *> &_objects_list)
 {
 	m3d_point temp;
 
+	M3D_PROFILE_SCOPE(STAGE_SORT);
+
 	for (auto itro : _objects_list)
 	{
 		camera.projection(itro->center, temp);
@@ -15,4 +15,126 @@
  *
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
\ No newline at end of file
+ */
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#include "m3d_zbuffer.hh"
+#include "m3d_span.hh"
+
+using namespace std;
+
+// Fine blocks along a side of a coarse block
+static const int fine_per_coarse = M3D_HIZ_COARSE / M3D_HIZ_FINE;
+
+void m3d_zbuffer::release()
+{
+	delete[] zbuffer;
+	delete[] hizfine;
+	delete[] hizcoarse;
+	delete[] tags;
+	zbuffer = hizfine = hizcoarse = nullptr;
+	tags = nullptr;
+}
+
+bool m3d_zbuffer::allocate()
+{
+	if (allocated())
+		return true;
+
+	try
+	{
+		zbuffer = new float[(unsigned)size];
+		hizfine = new float[(unsigned)finesize];
+		hizcoarse = new float[(unsigned)coarsesize];
+		tags = new uint32_t[(unsigned)coarsesize];
+	}
+	catch (const bad_alloc &e)
+	{
+		cerr << "Out of memory " << e.what() << endl;
+		release();
+		return false;
+	}
+	reset();
+	return true;
+}
+
+void m3d_zbuffer::reset()
+{
+	const m3d_span &spans = m3d_span::inst();
+
+	if (!allocated())
+		return;
+
+	spans.fill_depth(zbuffer, 1.0f, (size_t)size);
+	spans.fill_depth(hizfine, 1.0f, (size_t)finesize);
+	spans.fill_depth(hizcoarse, 1.0f, (size_t)coarsesize);
+	spans.fill(tags, epoch, (size_t)coarsesize);
+}
+
+void m3d_zbuffer::clear_block(int bx, int by)
+{
+	const m3d_span &spans = m3d_span::inst();
+
+	int xs = bx * M3D_HIZ_COARSE, ys = by * M3D_HIZ_COARSE;
+	int xe = min(xs + M3D_HIZ_COARSE, (int)xres), ye = min(ys + M3D_HIZ_COARSE, (int)yres);
+	int fxs = bx * fine_per_coarse, fys = by * fine_per_coarse;
+	int fxe = min(fxs + fine_per_coarse, finepitch), fye = min(fys + fine_per_coarse, finesize / finepitch);
+
+	for (int y = ys; y < ye; y++)
+	{
+		spans.fill_depth(zbuffer + y * xres + xs, 1.0f, (size_t)(xe - xs));
+	}
+	for (int y = fys; y < fye; y++)
+	{
+		spans.fill_depth(hizfine + y * finepitch + fxs, 1.0f, (size_t)(fxe - fxs));
+	}
+	hizcoarse[by * coarsepitch + bx] = 1.0f;
+	tags[by * coarsepitch + bx] = epoch;
+}
+
+void m3d_zbuffer::validate(int xs, int ys, int xe, int ye)
+{
+	if (!allocated())
+		return;
+
+	for (int by = ys / M3D_HIZ_COARSE; by <= ye / M3D_HIZ_COARSE; by++)
+	{
+		for (int bx = xs / M3D_HIZ_COARSE; bx <= xe / M3D_HIZ_COARSE; bx++)
+		{
+			if (tags[by * coarsepitch + bx] != epoch)
+				clear_block(bx, by);
+		}
+	}
+}
+
+bool m3d_zbuffer::is_stale(int xs, int ys, int xe, int ye) const
+{
+	if (!allocated())
+		return true;
+
+	for (int by = ys / M3D_HIZ_COARSE; by <= ye / M3D_HIZ_COARSE; by++)
+	{
+		for (int bx = xs / M3D_HIZ_COARSE; bx <= xe / M3D_HIZ_COARSE; bx++)
+		{
+			if (tags[by * coarsepitch + bx] == epoch)
+				return false;
+		}
+	}
+	return true;
+}
+
+void m3d_zbuffer::set_valid(int xs, int ys, int xe, int ye)
+{
+	if (!allocated())
+		return;
+
+	for (int by = ys / M3D_HIZ_COARSE; by <= ye / M3D_HIZ_COARSE; by++)
+	{
+		for (int bx = xs / M3D_HIZ_COARSE; bx <= xe / M3D_HIZ_COARSE; bx++)
+		{
+			tags[by * coarsepitch + bx] = epoch;
+		}
+	}
+}
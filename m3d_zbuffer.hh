@@ -22,34 +22,108 @@
 
 #include <cstdint>
 
+/*
+ * Sides in pixels of the blocks of the two levels of the hierarchical Z
+ */
+#define M3D_HIZ_FINE (8)
+#define M3D_HIZ_COARSE (32)
+
+/*
+ * Z buffer, plus a hierarchical Z: the farthest depth stored in every block of
+ * M3D_HIZ_FINE * M3D_HIZ_FINE pixels and of M3D_HIZ_COARSE * M3D_HIZ_COARSE pixels.
+ * Depths only decrease while drawing, so a stale block depth is still an upper
+ * bound of the block: a triangle nearest point farther than it is hidden in
+ * the whole block. The hierarchical Z is kept up to date by the half-space
+ * rasterizer, the scanline rasterizer leaves it as set by reset().
+ *
+ * The Z buffer can be cleared on demand, by blocks of M3D_HIZ_COARSE *
+ * M3D_HIZ_COARSE pixels. Every block is tagged with the epoch it was last
+ * cleared in: invalidate() starts a new epoch, so that all the blocks become
+ * stale without writing them, and validate() clears the stale blocks of a
+ * rectangle before it is accessed. A stale block reads as far.
+ */
 class m3d_zbuffer
 {
 public:
-	m3d_zbuffer() : zbuffer(nullptr), size(0), xres(0), yres(0) {}
-	m3d_zbuffer(int16_t xres, int16_t yres) : size(xres * yres), xres(xres), yres(yres)
+	m3d_zbuffer() : zbuffer(nullptr), hizfine(nullptr), hizcoarse(nullptr), tags(nullptr), epoch(1), size(0), finepitch(0), finesize(0), coarsepitch(0), coarsesize(0), xres(0), yres(0), tests(0), passes(0) {}
+	m3d_zbuffer(int16_t xres, int16_t yres) : zbuffer(nullptr), hizfine(nullptr), hizcoarse(nullptr), tags(nullptr), epoch(1), size(xres * yres), xres(xres), yres(yres), tests(0), passes(0)
 	{
+		finepitch = (xres + M3D_HIZ_FINE - 1) / M3D_HIZ_FINE;
+		finesize = finepitch * ((yres + M3D_HIZ_FINE - 1) / M3D_HIZ_FINE);
+		coarsepitch = (xres + M3D_HIZ_COARSE - 1) / M3D_HIZ_COARSE;
+		coarsesize = coarsepitch * ((yres + M3D_HIZ_COARSE - 1) / M3D_HIZ_COARSE);
 		zbuffer = new float[(unsigned)size];
+		hizfine = new float[(unsigned)finesize];
+		hizcoarse = new float[(unsigned)coarsesize];
+		tags = new uint32_t[(unsigned)coarsesize];
 		reset();
 	}
 
 	~m3d_zbuffer()
 	{
-		if (zbuffer)
-			delete zbuffer;
+		release();
 	}
 
-	void reset(void)
+	/*
+	 * Release the memory of the depths and of the hierarchical Z, e.g. while
+	 * triangles are drawn back to front with no depth test. Until the next
+	 * allocate() the clears do nothing, is_stale() is true and the depths
+	 * must not be accessed; the counters are kept.
+	 */
+	void release(void);
+
+	/*
+	 * Allocate the memory again after release(), and clear it. Return false
+	 * if there is not enough memory.
+	 */
+	bool allocate(void);
+
+	bool allocated(void) const { return zbuffer != nullptr; }
+
+	/*
+	 * Clear the whole Z buffer now
+	 */
+	void reset(void);
+
+	/*
+	 * Clear the whole Z buffer on demand: all the blocks become stale
+	 */
+	void invalidate(void)
 	{
-		for (int i = 0; i < size; i++)
-			zbuffer[i] = 1.0f;
+		if ((++epoch == 0) && tags)
+		{
+			// Blocks tagged 2^32 epochs ago would look up to date
+			for (int i = 0; i < coarsesize; i++)
+				tags[i] = 0;
+			epoch = 1;
+		}
 	}
 
+	/*
+	 * Clear the stale blocks overlapping the rectangle from (xs, ys) to (xe, ye),
+	 * limits included
+	 */
+	void validate(int xs, int ys, int xe, int ye);
+
+	/*
+	 * Return true if all the blocks overlapping the rectangle are stale
+	 */
+	bool is_stale(int xs, int ys, int xe, int ye) const;
+
+	/*
+	 * Tag the blocks overlapping the rectangle as up to date, the caller
+	 * has written all their depths and hierarchical Z
+	 */
+	void set_valid(int xs, int ys, int xe, int ye);
+
 	bool test_update(int16_t x0, int16_t y0, float z)
 	{
 		float *zb = get_zbuffer(x0, y0);
+		tests++;
 		if (z <= *zb)
 		{
 			*zb = z;
+			passes++;
 			return true;
 		}
 		return false;
@@ -57,9 +131,11 @@ public:
 
 	bool test_update(float *zbuf, float z)
 	{
+		tests++;
 		if (z <= *zbuf)
 		{
 			*zbuf = z;
+			passes++;
 			return true;
 		}
 		return false;
@@ -70,10 +146,58 @@ public:
 		return zbuffer + (y0 * xres) + x0;
 	}
 
+	/*
+	 * Number of calls to test_update() and number of successful tests since
+	 * the last call to reset_counters()
+	 */
+	unsigned long get_tests(void) const { return tests; }
+	unsigned long get_passes(void) const { return passes; }
+
+	void reset_counters(void)
+	{
+		tests = passes = 0;
+	}
+
+	/*
+	 * Add depth tests counted elsewhere, e.g. by the rasterizer threads
+	 */
+	void add_counters(unsigned long moretests, unsigned long morepasses)
+	{
+		tests += moretests;
+		passes += morepasses;
+	}
+
+	inline float *get_zbuffer(void)
+	{
+		return zbuffer;
+	}
+
+	int get_pitch(void) const { return xres; }
+
+	/*
+	 * Hierarchical Z levels, and their pitches in blocks
+	 */
+	inline float *get_hiz_fine(void) { return hizfine; }
+	inline float *get_hiz_coarse(void) { return hizcoarse; }
+	int get_hiz_fine_pitch(void) const { return finepitch; }
+	int get_hiz_coarse_pitch(void) const { return coarsepitch; }
+
 private:
+	/*
+	 * Clear coarse block (bx, by) and tag it with the current epoch
+	 */
+	void clear_block(int bx, int by);
+
 	float *zbuffer;
+	float *hizfine, *hizcoarse;
+	// Epoch of the last clear of every coarse block, and the current epoch
+	uint32_t *tags;
+	uint32_t epoch;
 	int size;
+	int finepitch, finesize;
+	int coarsepitch, coarsesize;
 	int16_t xres, yres;
+	unsigned long tests, passes;
 };
 
 #endif
\ No newline at end of file
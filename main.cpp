@@ -23,6 +23,7 @@
 #include "m3d_renderer_flat.hh"
 #include "m3d_renderer_gouraud.hh"
 #include "m3d_renderer_phong.hh"
+#include "m3d_cpu.hh"
 #include "cubeobject.mes"
 #include "sphereobject.mes"
 
@@ -197,9 +198,11 @@ INT WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, LPWSTR, INT nCmdShow)
 	renderer[2] = new m3d_renderer_shaded(display);
 	renderer[3] = new m3d_renderer_shaded_gouraud(display);
 	renderer[4] = new m3d_renderer_shaded_phong(display);
-	cubeo.create(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh), cubecolor);
-	cubeo2.create(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh), cubecolor2);
-	cubeo3.create(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh), cubecolor3);
+	// The three cubes are instances of the same mesh
+	std::shared_ptr<const m3d_mesh> cubeshape = m3d_mesh::make(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh));
+	cubeo.create(cubeshape, cubecolor);
+	cubeo2.create(cubeshape, cubecolor2);
+	cubeo3.create(cubeshape, cubecolor3);
 	sphereo.create(sphere, NELEMENTS(sphere), spheremesh, NELEMENTS(spheremesh), spherecolor);
 	m3d_vector newpos(300.0f, 0.0f, 0.0f);
 	m3d_vector newpos2(0.0f, 300.0f, 0.0f);
@@ -286,15 +289,18 @@ int main(int argc, char *argv[])
 	if (__builtin_cpu_supports("sse4a"))
 		std::cout << "with SSE4A instructions." << std::endl;
 #endif
+	std::cout << "using the " << m3d_cpu::level_name(m3d_cpu::get_level()) << " kernels." << std::endl;
 
 	renderer[0] = new m3d_renderer_wireframe(display);
 	renderer[1] = new m3d_renderer_flat(display);
 	renderer[2] = new m3d_renderer_shaded(display);
 	renderer[3] = new m3d_renderer_shaded_gouraud(display);
 	renderer[4] = new m3d_renderer_shaded_phong(display);
-	cubeo.create(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh), cubecolor);
-	cubeo2.create(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh), cubecolor2);
-	cubeo3.create(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh), cubecolor3);
+	// The three cubes are instances of the same mesh
+	std::shared_ptr<const m3d_mesh> cubeshape = m3d_mesh::make(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh));
+	cubeo.create(cubeshape, cubecolor);
+	cubeo2.create(cubeshape, cubecolor2);
+	cubeo3.create(cubeshape, cubecolor3);
 	sphereo.create(sphere, NELEMENTS(sphere), spheremesh, NELEMENTS(spheremesh), spherecolor);
 	m3d_vector newpos(300.0f, 0.0f, 0.0f);
 	m3d_vector newpos2(0.0f, 300.0f, 0.0f);
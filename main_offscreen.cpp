@@ -0,0 +1,134 @@
+/*
+ * Matrix3D
+ *
+ * Copyright (C) 1995 - 2025 Diego Gallizioli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Headless demo: renders the same scene of main.cpp with every renderer into
+ * an offscreen framebuffer, prints the time per frame and optionally dumps the
+ * last frame of every renderer as a PPM image.
+ *
+ * Usage: matrix3d_offscreen [frames] [dump prefix]
+ */
+
+#define NELEMENTS(x) (sizeof(x) / sizeof(x[0]))
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+#include "m3d_renderer_wireframe.hh"
+#include "m3d_renderer_flat.hh"
+#include "m3d_renderer_gouraud.hh"
+#include "m3d_renderer_phong.hh"
+#include "m3d_display_offscreen.hh"
+#include "cubeobject.mes"
+#include "sphereobject.mes"
+
+using namespace std;
+
+static struct m3d_input_point viewpoint = {{1000.0f, 1000.0f, 1000.0f, 1.0f}};
+static struct m3d_input_point viewpointat = {{0.0f, 0.0f, 0.0f, 1.0f}};
+static struct m3d_input_point lightpos = {{500.0f, 500.0f, 500.0f, 1.0f}};
+
+static const char *renderer_names[] = {"wireframe", "flat", "shaded", "gouraud", "phong"};
+
+int main(int argc, char *argv[])
+{
+	int xres = 1024;
+	int yres = 768;
+	unsigned frames = 360;
+	const char *prefix = nullptr;
+	m3d_render_object cubeo, cubeo2, cubeo3, sphereo;
+	m3d_render_object *objects[] = {&cubeo, &cubeo2, &cubeo3, &sphereo};
+	m3d_renderer *renderer[5];
+
+	if (argc > 1)
+	{
+		frames = (unsigned)strtoul(argv[1], nullptr, 10);
+	}
+
+	if (argc > 2)
+	{
+		prefix = argv[2];
+	}
+
+	m3d_color cubecolor(255, 1, 1, 0);
+	m3d_color cubecolor2(1, 255, 1, 0);
+	m3d_color cubecolor3(1, 1, 255, 0);
+	m3d_color spherecolor(64, 128, 255, 0);
+	m3d_color ambientcolor(255, 255, 255, 0);
+
+	m3d_point_light_source lsource(lightpos, ambientcolor, 100.0f, 1.0f, 0.1f, 20000.0f);
+	m3d_ambient_light ambient(ambientcolor, 0.4f);
+	m3d_camera camera(viewpoint, viewpointat, (int16_t)xres, (int16_t)yres);
+	m3d_world world(ambient, camera);
+	m3d_display_offscreen display(xres, yres);
+
+	renderer[0] = new m3d_renderer_wireframe(&display);
+	renderer[1] = new m3d_renderer_flat(&display);
+	renderer[2] = new m3d_renderer_shaded(&display);
+	renderer[3] = new m3d_renderer_shaded_gouraud(&display);
+	renderer[4] = new m3d_renderer_shaded_phong(&display);
+
+	// The three cubes are instances of the same mesh
+	std::shared_ptr<const m3d_mesh> cubeshape = m3d_mesh::make(cube, NELEMENTS(cube), cubemesh, NELEMENTS(cubemesh));
+	cubeo.create(cubeshape, cubecolor);
+	cubeo2.create(cubeshape, cubecolor2);
+	cubeo3.create(cubeshape, cubecolor3);
+	sphereo.create(sphere, NELEMENTS(sphere), spheremesh, NELEMENTS(spheremesh), spherecolor);
+	cubeo.move(m3d_vector(300.0f, 0.0f, 0.0f));
+	cubeo2.move(m3d_vector(0.0f, 300.0f, 0.0f));
+	cubeo3.move(m3d_vector(0.0f, 0.0f, 300.0f));
+	sphereo.move(m3d_vector(200.0f, 300.0f, -300.0f));
+	world.add_light_source(lsource);
+	for (auto obj : objects)
+	{
+		world.add_object(*obj);
+	}
+
+	for (unsigned i = 0; i < NELEMENTS(renderer); i++)
+	{
+		auto start = chrono::steady_clock::now();
+
+		for (unsigned frame = 0; frame < frames; frame++)
+		{
+			for (auto obj : objects)
+			{
+				obj->yaw(1.0f);
+				obj->pitch(1.0f);
+				obj->roll(1.0f);
+			}
+			renderer[i]->render(world);
+		}
+
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		cout << renderer_names[i] << ": " << frames << " frames, "
+		     << ((frames) ? elapsed.count() / frames : 0.0) << " ms/frame" << endl;
+
+		if (prefix)
+		{
+			string filename = string(prefix) + renderer_names[i] + ".ppm";
+			display.dump(filename.c_str());
+		}
+
+		delete renderer[i];
+	}
+
+	return 0;
+}